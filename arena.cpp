@@ -0,0 +1,114 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+// the transparent huge page size on x86-64 and most arm64 kernels
+static const size_t hugePageBytes = size_t(2) << 20;
+
+static size_t paddedStride(int cols)
+{
+    return size_t(cols + tensor::padding - 1) / tensor::padding * tensor::padding;
+}
+
+// ---------------------------- arena ----------------------------
+
+hhParameterArena::~hhParameterArena()
+{
+    Release();
+}
+
+size_t hhParameterArena::Place(int rows, int cols)
+{
+    // a whole number of padded rows keeps the next tensor on a cache line
+    const size_t offset = layoutFloats;
+    layoutFloats += size_t(rows) * paddedStride(cols);
+    return offset;
+}
+
+void hhParameterArena::Grow(int blocks)
+{
+    if (blocks <= numBlocks && blockFloats == layoutFloats)
+        return;
+
+    // a shared block 0 only stays outside while it still fits the layout
+    Rebuild(std::max(blocks, numBlocks), blockFloats == layoutFloats ? shared : nullptr);
+}
+
+void hhParameterArena::ShareParameters(float* external)
+{
+    assert(blockFloats == layoutFloats && numBlocks > 0);
+    if (external == shared)
+        return;
+    if (external != nullptr && shared != nullptr)
+    {
+        shared = external;
+        return;
+    }
+    Rebuild(numBlocks, external);
+}
+
+float* hhParameterArena::Block(int block)
+{
+    assert(block >= 0 && block < numBlocks);
+    if (block < firstOwned)
+        return shared;
+    return memory + size_t(block - firstOwned) * blockFloats;
+}
+
+const float* hhParameterArena::Block(int block) const
+{
+    return const_cast<hhParameterArena*>(this)->Block(block);
+}
+
+tensor hhParameterArena::View(int block, size_t offset, int rows, int cols)
+{
+    assert(offset + size_t(rows) * paddedStride(cols) <= blockFloats);
+    return tensor::Wrap(Block(block) + offset, rows, cols, int(paddedStride(cols)));
+}
+
+void hhParameterArena::Rebuild(int blocks, float* external)
+{
+    const int first = external != nullptr ? 1 : 0;
+    const size_t bytes = size_t(blocks - first) * layoutFloats * sizeof(float);
+
+    // regions a huge page or larger start on one, so the kernel can back them with huge pages from the start
+    const bool huge = useHugePages && bytes >= hugePageBytes;
+    const size_t alignment = huge ? hugePageBytes : size_t(tensorAlignment);
+    const size_t rounded = (bytes + alignment - 1) / alignment * alignment;
+    float* next = nullptr;
+    bool nextAdvised = false;
+    if (rounded > 0)
+    {
+        next = static_cast<float*>(::operator new(rounded, std::align_val_t(alignment)));
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        nextAdvised = huge && madvise(next, rounded, MADV_HUGEPAGE) == 0;
+#endif
+        std::memset(next, 0, rounded);
+    }
+
+    // every block that existed keeps its contents at the front of its new place
+    for (int b = first; b < numBlocks; b++)
+        std::memcpy(next + size_t(b - first) * layoutFloats, Block(b), blockFloats * sizeof(float));
+
+    Release();
+    memory = next;
+    memoryAlignment = alignment;
+    advised = nextAdvised;
+    shared = external;
+    firstOwned = first;
+    numBlocks = blocks;
+    blockFloats = layoutFloats;
+}
+
+void hhParameterArena::Release()
+{
+    if (memory != nullptr)
+        ::operator delete(memory, std::align_val_t(memoryAlignment));
+    memory = nullptr;
+    advised = false;
+}
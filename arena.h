@@ -0,0 +1,62 @@
+#pragma once
+
+#include "tensor.h"
+
+#include <cstddef>
+
+// One aligned region for every parameter of a model and the state that shadows it. tensors are placed once,
+// each on a cache line with its rows padded, and that layout repeats in every block: the parameters, each
+// worker's gradients and the optimizer moments. a tensor sits at the same offset in all of them, so an update
+// walks a parameter, its gradient and its moments in step and whole-model passes are sweeps over one range.
+// the parameter block is laid out exactly like the blobs of a checkpoint.
+class hhParameterArena
+{
+public:
+    hhParameterArena() = default;
+    ~hhParameterArena();
+
+    hhParameterArena(const hhParameterArena&) = delete;
+    hhParameterArena& operator=(const hhParameterArena&) = delete;
+
+    // appends a padded [rows x cols] tensor to the layout and returns its offset in floats. the blocks take
+    // the new layout at the next Grow.
+    size_t Place(int rows, int cols);
+
+    // brings every block to the current layout and adds zeroed ones up to numBlocks. contents move along,
+    // views taken before have to be taken again.
+    void Grow(int numBlocks);
+
+    // block 0 becomes external memory laid out like it, a mapped checkpoint, and the arena's own copy is
+    // released. nullptr copies it back in. a change of layout copies it back in too.
+    void ShareParameters(float* external);
+
+    float* Block(int block);
+    const float* Block(int block) const;
+
+    // non-owning [rows x cols] window at offset in block, rows padded as Place laid them out
+    tensor View(int block, size_t offset, int rows, int cols);
+
+    size_t Floats() const { return blockFloats; }   // per block, row padding and alignment gaps included
+    int Blocks() const { return numBlocks; }
+    bool IsShared() const { return shared != nullptr; }
+
+    // whether the region is backed by transparent huge pages, as far as the kernel took the advice
+    bool HugePages() const { return advised; }
+
+    // regions of a huge page or more are aligned to one and advised to use them, on Linux
+    bool useHugePages = true;
+
+private:
+    void Rebuild(int blocks, float* external);
+    void Release();
+
+    float* memory = nullptr;    // owned blocks, from firstOwned on
+    size_t memoryAlignment = 0;
+    bool advised = false;
+
+    float* shared = nullptr;    // block 0 when it lives outside
+    int firstOwned = 0;
+    int numBlocks = 0;
+    size_t blockFloats = 0;     // what the blocks are laid out for
+    size_t layoutFloats = 0;    // what Place has handed out
+};
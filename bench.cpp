@@ -0,0 +1,648 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "model.h"
+#include "dataset.h"
+#include "static_model.h"
+
+// Throughput benchmark. Runs a fixed matrix of scenarios and writes one JSON report, so runs of two builds
+// or two machines can be compared line for line.
+//
+//   bench [--warmup N] [--reps N] [--min-ms N] [--filter text] [--quick] [--out file.json]
+//
+// every scenario is calibrated during warm-up so one repetition lasts at least min-ms, then timed reps times.
+// the report holds ns/sample percentiles over the repetitions, and samples/sec and GFLOP/s at the median.
+
+using benchClock = std::chrono::steady_clock;
+
+// set by CMake from the build configuration, timings of unoptimized builds say little
+#ifndef HH_BUILD_TYPE
+#define HH_BUILD_TYPE ""
+#endif
+
+struct Options
+{
+    int warmup = 2;
+    int reps = 15;
+    double minSeconds = 0.02;
+    std::string filter;
+    bool quick = false;
+    const char* out = nullptr;
+};
+
+// ---------------------------- networks ----------------------------
+
+struct Network
+{
+    const char* name;
+    std::vector<hhTaskLayer> layers;
+
+    // a convolution does one multiply-add per output and window element, pooling none worth counting
+    static double MultiplyAdds(const hhTaskLayer& layer)
+    {
+        if (layer.type == hhLayerType::MaxPool)
+            return 0.0;
+        if (layer.type == hhLayerType::Conv2D)
+            return double(layer.numNeurons) * layer.shape.PatchSize();
+        return double(layer.numNeurons) * layer.numInputs;
+    }
+
+    // multiply-adds per sample through every layer, counted twice for GFLOP/s
+    double ForwardFlops() const
+    {
+        double flops = 0.0;
+        for (size_t l = 1; l < layers.size(); l++)
+            flops += 2.0 * MultiplyAdds(layers[l]);
+        return flops;
+    }
+
+    // the gradient of every layer, plus propagation below the first layer
+    double BackwardFlops() const
+    {
+        double flops = ForwardFlops();
+        for (size_t l = 2; l < layers.size(); l++)
+            flops += 2.0 * MultiplyAdds(layers[l]);
+        return flops;
+    }
+};
+
+static hhTaskLayer windowed(hhLayerType type, const hhConvShape& shape)
+{
+    return { type, shape.OutputSize(), shape.InputSize(), shape };
+}
+
+// the shapes main.cpp and images.cpp train. "images" is the fully connected net images.cpp used before its
+// convolutions, kept so reports stay comparable.
+static const std::vector<Network> networks = {
+    { "helper", { {hhLayerType::Input, 2, 0}, {hhLayerType::Sigmoid, 9, 2}, {hhLayerType::Sigmoid, 3, 9} } },
+    { "images", { {hhLayerType::Input, 3072, 0}, {hhLayerType::Relu, 200, 3072}, {hhLayerType::Sigmoid, 150, 200}, {hhLayerType::Softmax, 10, 150} } },
+    { "images-conv", { {hhLayerType::Input, 3072, 0},
+        windowed(hhLayerType::Conv2D, hhConvShape::Conv(3, 32, 32, 8, 3, 1, 1)),
+        windowed(hhLayerType::MaxPool, hhConvShape::Pool(8, 32, 32, 2, 2)),
+        windowed(hhLayerType::Conv2D, hhConvShape::Conv(8, 16, 16, 16, 3, 1, 1)),
+        windowed(hhLayerType::MaxPool, hhConvShape::Pool(16, 16, 16, 2, 2)),
+        {hhLayerType::Relu, 64, 1024}, {hhLayerType::Softmax, 10, 64} } },
+};
+
+// random samples in 0..1 with one hot targets, fixed seed so every run sees the same data
+class BenchTask : public hhTask
+{
+public:
+    BenchTask(const Network& network, int numSamples, int threads)
+        : network(network), numSamples(numSamples)
+    {
+        numThreads = threads;
+    }
+
+    void Configure(hhModel& model) override
+    {
+        // small steps keep the weights, and so the timings, steady over thousands of updates
+        learningRate = 0.001f;
+        epochs = 1;
+        batchSize = 32;
+        seed = 1234;
+        prefetchDepth = 0;
+        for (const hhTaskLayer& layer : network.layers)
+        {
+            if (isWindowed(layer.type))
+                AddLayer(layer.type, layer.shape);
+            else
+                AddLayer(layer.type, layer.numNeurons, layer.numInputs);
+        }
+        FillSamples();
+    }
+
+    void FillSamples()
+    {
+        std::mt19937 generator(5678);
+        std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+        const int numOutputs = network.layers.back().numNeurons;
+        inputs.Resize(numSamples, network.layers[0].numNeurons, true);
+        targets.Resize(numSamples, numOutputs, true);
+        for (int r = 0; r < numSamples; r++)
+        {
+            for (int c = 0; c < inputs.cols; c++)
+                inputs[r][c] = distribution(generator);
+            targets[r][r % numOutputs] = 1.0f;
+        }
+    }
+
+    const Network& network;
+    int numSamples;
+};
+
+// ---------------------------- measurement ----------------------------
+
+struct Scenario
+{
+    std::string name;
+    std::string network;
+    std::string op;
+    int batch = 1;
+    int threads = 1;
+    double flopsPerSample = 0.0;
+
+    // runs the operation count times over batch samples each and returns the seconds that count
+    std::function<double(int count)> run;
+};
+
+struct Result
+{
+    Scenario scenario;
+    int iterations = 0;
+    double p50 = 0.0, p90 = 0.0, p99 = 0.0, min = 0.0, mean = 0.0; // ns per sample
+};
+
+static double elapsed(benchClock::time_point start)
+{
+    return std::chrono::duration<double>(benchClock::now() - start).count();
+}
+
+// nearest rank on sorted values
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    const size_t rank = size_t(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+static Result measure(const Scenario& scenario, const Options& options)
+{
+    // grow the iteration count until a repetition lasts min-ms, that also serves as warm-up
+    int iterations = 1;
+    while (scenario.run(iterations) < options.minSeconds && iterations < (1 << 24))
+        iterations *= 2;
+    for (int w = 0; w < options.warmup; w++)
+        scenario.run(iterations);
+
+    std::vector<double> nsPerSample(options.reps);
+    for (int r = 0; r < options.reps; r++)
+        nsPerSample[r] = scenario.run(iterations) * 1e9 / (double(iterations) * scenario.batch);
+    std::sort(nsPerSample.begin(), nsPerSample.end());
+
+    Result result;
+    result.scenario = scenario;
+    result.iterations = iterations;
+    result.p50 = percentile(nsPerSample, 50.0);
+    result.p90 = percentile(nsPerSample, 90.0);
+    result.p99 = percentile(nsPerSample, 99.0);
+    result.min = nsPerSample.front();
+    for (double value : nsPerSample)
+        result.mean += value / nsPerSample.size();
+    return result;
+}
+
+// ---------------------------- scenarios ----------------------------
+
+// state a scenario's run closure keeps between calls
+struct ModelBench
+{
+    BenchTask task;
+    hhModel model;
+
+    ModelBench(const Network& network, int batch, int threads, hhOptimizerType optimizer = hhOptimizerType::Sgd)
+        : task(network, batch, threads)
+    {
+        model.Configure(task);
+        task.optimizer.type = optimizer;
+
+        // the layer clocks would be part of what is measured, the report is about the kernels
+        model.stats.layerTiming = false;
+    }
+};
+
+static void addModelScenarios(std::vector<Scenario>& scenarios, const Network& network, int batch, const std::vector<int>& threadCounts)
+{
+    const std::string prefix = std::string(network.name) + "/";
+    const std::string suffix = "/b" + std::to_string(batch);
+
+    // forward and backward run on the calling thread, the model has no threaded path for them
+    std::shared_ptr<ModelBench> single(new ModelBench(network, batch, 1));
+
+    Scenario forward;
+    forward.name = prefix + "forward" + suffix + "/t1";
+    forward.network = network.name;
+    forward.op = "forward";
+    forward.batch = batch;
+    forward.flopsPerSample = network.ForwardFlops();
+    forward.run = [single](int count)
+    {
+        const benchClock::time_point start = benchClock::now();
+        for (int i = 0; i < count; i++)
+            single->model.Forward(single->task.inputs);
+        return elapsed(start);
+    };
+    scenarios.push_back(forward);
+
+    // backward includes the weight update it is fused with, forward runs untimed before each call
+    Scenario backward = forward;
+    backward.name = prefix + "backward" + suffix + "/t1";
+    backward.op = "backward";
+    backward.flopsPerSample = network.BackwardFlops();
+    backward.run = [single](int count)
+    {
+        double seconds = 0.0;
+        for (int i = 0; i < count; i++)
+        {
+            single->model.Forward(single->task.inputs);
+            const benchClock::time_point start = benchClock::now();
+            single->model.Backward(single->task.targets);
+            seconds += elapsed(start);
+        }
+        return seconds;
+    };
+    scenarios.push_back(backward);
+
+    for (int threads : threadCounts)
+    {
+        // a worker needs at least one sample of the batch
+        if (threads > batch)
+            continue;
+
+        std::shared_ptr<ModelBench> bench = threads == 1 ? single : std::shared_ptr<ModelBench>(new ModelBench(network, batch, threads));
+        Scenario train = forward;
+        train.name = prefix + "train" + suffix + "/t" + std::to_string(threads);
+        train.op = "train";
+        train.threads = threads;
+        train.flopsPerSample = network.ForwardFlops() + network.BackwardFlops();
+        train.run = [bench](int count)
+        {
+            const benchClock::time_point start = benchClock::now();
+            for (int i = 0; i < count; i++)
+                bench->model.TrainBatch(bench->task.inputs, bench->task.targets);
+            return elapsed(start);
+        };
+        scenarios.push_back(train);
+    }
+}
+
+// a training step under each update rule. plain SGD fuses the update into backward, the others keep the
+// gradients and make a second pass over them and their moments.
+static void addOptimizerScenarios(std::vector<Scenario>& scenarios, const Network& network, int batch)
+{
+    const std::pair<hhOptimizerType, const char*> optimizers[] = {
+        { hhOptimizerType::Sgd, "sgd" }, { hhOptimizerType::Momentum, "momentum" }, { hhOptimizerType::Nesterov, "nesterov" },
+        { hhOptimizerType::Adam, "adam" }, { hhOptimizerType::AdamW, "adamw" } };
+    for (const auto& optimizer : optimizers)
+    {
+        std::shared_ptr<ModelBench> bench(new ModelBench(network, batch, 1, optimizer.first));
+        Scenario train;
+        train.name = std::string(network.name) + "/train-" + optimizer.second + "/b" + std::to_string(batch) + "/t1";
+        train.network = network.name;
+        train.op = std::string("train-") + optimizer.second;
+        train.batch = batch;
+        train.flopsPerSample = network.ForwardFlops() + network.BackwardFlops();
+        train.run = [bench](int count)
+        {
+            const benchClock::time_point start = benchClock::now();
+            for (int i = 0; i < count; i++)
+                bench->model.TrainBatch(bench->task.inputs, bench->task.targets);
+            return elapsed(start);
+        };
+        scenarios.push_back(train);
+    }
+}
+
+// backward with a share of the first relu layer's units held off for every sample, once through the path that
+// skips them and once dense. plain SGD runs the fused sweep, Adam keeps gradients and updates separately.
+static void addSparseScenarios(std::vector<Scenario>& scenarios, const Network& network, int batch)
+{
+    size_t relu = 1;
+    while (relu < network.layers.size() && network.layers[relu].type != hhLayerType::Relu)
+        relu++;
+    if (relu == network.layers.size())
+        return;
+
+    const std::pair<hhOptimizerType, const char*> optimizers[] = { { hhOptimizerType::Sgd, "sgd" }, { hhOptimizerType::Adam, "adam" } };
+    for (int deadPercent : { 50, 90 })
+    {
+        for (const auto& optimizer : optimizers)
+        {
+            for (bool sparse : { true, false })
+            {
+                std::shared_ptr<ModelBench> bench(new ModelBench(network, batch, 1, optimizer.first));
+                hhLayer& layer = *bench->model.layers[relu];
+                layer.sparseBackward = sparse;
+
+                // spread over the layer, so the live units are not one block of rows
+                for (int n = 0; n < layer.numNeurons; n++)
+                    if (n % 10 < deadPercent / 10)
+                        layer.biases[0][n] = -1e4f;
+
+                const std::string op = std::string("backward-") + optimizer.second + "-dead" + std::to_string(deadPercent);
+                Scenario backward;
+                backward.name = std::string(network.name) + "/" + op + (sparse ? "-sparse" : "-dense") + "/b" + std::to_string(batch) + "/t1";
+                backward.network = network.name;
+                backward.op = op + (sparse ? "-sparse" : "-dense");
+                backward.batch = batch;
+                backward.flopsPerSample = network.BackwardFlops();
+                backward.run = [bench](int count)
+                {
+                    double seconds = 0.0;
+                    for (int i = 0; i < count; i++)
+                    {
+                        bench->model.Forward(bench->task.inputs);
+                        const benchClock::time_point start = benchClock::now();
+                        bench->model.Backward(bench->task.targets);
+                        seconds += elapsed(start);
+                    }
+                    return seconds;
+                };
+                scenarios.push_back(backward);
+            }
+        }
+    }
+}
+
+// the helper shape compiled in, next to the dynamic model's numbers for it
+using StaticHelper = hhStaticModel<hhInput<2>, hhSigmoid<9>, hhSigmoid<3>>;
+
+struct StaticBench
+{
+    BenchTask task;
+    StaticHelper model;
+    tensor outputs;
+
+    StaticBench(const Network& network, int batch) : task(network, batch, 1)
+    {
+        model.Configure(task);
+    }
+};
+
+static void addStaticScenarios(std::vector<Scenario>& scenarios, const Network& network, int batch)
+{
+    const std::string suffix = "/b" + std::to_string(batch) + "/t1";
+    std::shared_ptr<StaticBench> bench(new StaticBench(network, batch));
+
+    Scenario forward;
+    forward.name = std::string(network.name) + "-static/forward" + suffix;
+    forward.network = network.name;
+    forward.op = "forward-static";
+    forward.batch = batch;
+    forward.flopsPerSample = network.ForwardFlops();
+    forward.run = [bench](int count)
+    {
+        const benchClock::time_point start = benchClock::now();
+        for (int i = 0; i < count; i++)
+            bench->model.PredictBatch(bench->task.inputs, bench->outputs);
+        return elapsed(start);
+    };
+    scenarios.push_back(forward);
+
+    Scenario train = forward;
+    train.name = std::string(network.name) + "-static/train" + suffix;
+    train.op = "train-static";
+    train.flopsPerSample = network.ForwardFlops() + network.BackwardFlops();
+    train.run = [bench](int count)
+    {
+        const benchClock::time_point start = benchClock::now();
+        for (int i = 0; i < count; i++)
+            bench->model.TrainBatch(bench->task.inputs, bench->task.targets, bench->task.learningRate);
+        return elapsed(start);
+    };
+    scenarios.push_back(train);
+}
+
+// synthetic CIFAR-10 batch file, the same layout the real ones have
+static bool writeCifar(const std::string& filename, int count)
+{
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    std::vector<unsigned char> record(hhCifarDataset::recordSize);
+    bool ok = true;
+    for (int i = 0; i < count && ok; i++)
+    {
+        record[0] = (unsigned char)(i % hhCifarDataset::numCategories);
+        for (int p = 1; p < hhCifarDataset::recordSize; p++)
+            record[p] = (unsigned char)((i * 7 + p) & 255);
+        ok = fwrite(record.data(), 1, record.size(), file) == record.size();
+    }
+    return fclose(file) == 0 && ok;
+}
+
+// state of the data loading scenarios, shared by every batch size
+struct LoadBench
+{
+    BenchTask task;
+    hhCifarDataset cifar;
+    std::vector<int> order;
+    std::mt19937 shuffler;
+    hhBatchPrefetcher prefetcher;
+    tensor batchInputs;
+    tensor batchTargets;
+
+    LoadBench(const Network& network, int numSamples) : task(network, numSamples, 1), order(numSamples), shuffler(1234)
+    {
+        task.FillSamples();
+        for (int i = 0; i < numSamples; i++)
+            order[i] = i;
+        std::shuffle(order.begin(), order.end(), shuffler);
+    }
+};
+
+static void addLoadScenarios(std::vector<Scenario>& scenarios, const std::shared_ptr<LoadBench>& load, int batch)
+{
+    const int numSamples = int(load->order.size());
+    const std::string suffix = "/b" + std::to_string(batch) + "/t1";
+
+    // shuffled rows copied out of the task's in-memory tensors
+    Scenario gather;
+    gather.name = "load/gather" + suffix;
+    gather.network = load->task.network.name;
+    gather.op = "gather";
+    gather.batch = batch;
+    gather.run = [load, batch, numSamples](int count)
+    {
+        const benchClock::time_point start = benchClock::now();
+        for (int i = 0; i < count; i++)
+        {
+            const int first = (i * batch) % (numSamples - batch + 1);
+            load->task.GatherBatch(&load->order[first], batch, load->batchInputs, load->batchTargets);
+        }
+        return elapsed(start);
+    };
+    scenarios.push_back(gather);
+
+    // CIFAR records decoded from the mapped file, the images.cpp path
+    if (load->cifar.Count() >= batch)
+    {
+        Scenario decode = gather;
+        decode.name = "load/decode" + suffix;
+        decode.op = "decode";
+        decode.run = [load, batch](int count)
+        {
+            const int records = load->cifar.Count();
+            const benchClock::time_point start = benchClock::now();
+            for (int i = 0; i < count; i++)
+            {
+                const int first = (i * batch) % (records - batch + 1);
+                load->cifar.Decode(&load->order[first], batch, load->batchInputs, load->batchTargets);
+            }
+            return elapsed(start);
+        };
+        scenarios.push_back(decode);
+    }
+
+    // batches pulled through the background loader as fast as the consumer can take them
+    Scenario prefetch = gather;
+    prefetch.name = "load/prefetch" + suffix;
+    prefetch.op = "prefetch";
+    prefetch.run = [load, batch, numSamples](int count)
+    {
+        // whole epochs, enough of them to cover count batches
+        const int batchesPerEpoch = (numSamples + batch - 1) / batch;
+        const int epochs = (count + batchesPerEpoch - 1) / batchesPerEpoch;
+        const benchClock::time_point start = benchClock::now();
+        load->prefetcher.Start(load->task, load->order, load->shuffler, batch, epochs, 2);
+        while (load->prefetcher.Next() != nullptr)
+        {
+        }
+        load->prefetcher.Finish();
+
+        // reported per requested batch, the partial last batch of an epoch is small enough to ignore
+        return elapsed(start) * count / (double(epochs) * batchesPerEpoch);
+    };
+    scenarios.push_back(prefetch);
+}
+
+// ---------------------------- report ----------------------------
+
+static void writeReport(FILE* file, const std::vector<Result>& results, const Options& options)
+{
+#if defined(_MSC_VER)
+    const char* compiler = "msvc";
+#elif defined(__clang__)
+    const char* compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    const char* compiler = "gcc " __VERSION__;
+#else
+    const char* compiler = "unknown";
+#endif
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"schema\": 1,\n");
+    fprintf(file, "  \"config\": {\n");
+    fprintf(file, "    \"warmup\": %d,\n", options.warmup);
+    fprintf(file, "    \"reps\": %d,\n", options.reps);
+    fprintf(file, "    \"minMs\": %.1f,\n", options.minSeconds * 1000.0);
+    fprintf(file, "    \"quick\": %s,\n", options.quick ? "true" : "false");
+    fprintf(file, "    \"simd\": \"%s\",\n", activeKernels().name);
+    fprintf(file, "    \"hardwareThreads\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(file, "    \"compiler\": \"%s\",\n", compiler);
+    fprintf(file, "    \"build\": \"%s\",\n", HH_BUILD_TYPE);
+    fprintf(file, "    \"stats\": %s\n", HH_STATS ? "true" : "false");
+    fprintf(file, "  },\n");
+    fprintf(file, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& r = results[i];
+        const Scenario& s = r.scenario;
+        const double samplesPerSec = 1e9 / r.p50;
+        fprintf(file, "    { \"name\": \"%s\", \"network\": \"%s\", \"op\": \"%s\", \"batch\": %d, \"threads\": %d, \"iterations\": %d,\n",
+            s.name.c_str(), s.network.c_str(), s.op.c_str(), s.batch, s.threads, r.iterations);
+        fprintf(file, "      \"samplesPerSec\": %.1f, \"nsPerSample\": { \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"min\": %.1f, \"mean\": %.1f },\n",
+            samplesPerSec, r.p50, r.p90, r.p99, r.min, r.mean);
+        fprintf(file, "      \"gflops\": %.3f }%s\n", s.flopsPerSample * samplesPerSec * 1e-9, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--warmup") == 0 && hasValue) options.warmup = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--reps") == 0 && hasValue) options.reps = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--min-ms") == 0 && hasValue) options.minSeconds = std::max(0.0, std::atof(argv[++i]) / 1000.0);
+        else if (std::strcmp(argv[i], "--filter") == 0 && hasValue) options.filter = argv[++i];
+        else if (std::strcmp(argv[i], "--out") == 0 && hasValue) options.out = argv[++i];
+        else if (std::strcmp(argv[i], "--quick") == 0) options.quick = true;
+        else
+        {
+            fprintf(stderr, "usage: bench [--warmup N] [--reps N] [--min-ms N] [--filter text] [--quick] [--out file.json]\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+    if (options.quick)
+        options.reps = std::min(options.reps, 5);
+
+    // powers of two up to every core, and every core itself
+    const int cores = std::max(1, int(std::thread::hardware_concurrency()));
+    std::vector<int> threadCounts;
+    for (int t = 1; t < cores; t *= 2)
+        threadCounts.push_back(t);
+    threadCounts.push_back(cores);
+    if (options.quick && threadCounts.size() > 2)
+        threadCounts = { 1, cores };
+
+    const std::vector<int> batches = options.quick ? std::vector<int>{ 1, 64 } : std::vector<int>{ 1, 4, 16, 64, 256 };
+
+    std::vector<Scenario> scenarios;
+    for (const Network& network : networks)
+        for (int batch : batches)
+            addModelScenarios(scenarios, network, batch, threadCounts);
+    for (int batch : batches)
+        addStaticScenarios(scenarios, networks[0], batch);
+    addOptimizerScenarios(scenarios, networks[1], 64);
+    addSparseScenarios(scenarios, networks[1], 32);
+    addSparseScenarios(scenarios, networks[1], 1);
+
+    // the loader is measured at the images shape, decode on a synthetic batch file in the temp directory
+    std::error_code error;
+    const std::string cifarFile = (std::filesystem::temp_directory_path(error) / "hh_bench_cifar.bin").string();
+    const int loadSamples = 2048;
+    std::shared_ptr<LoadBench> load(new LoadBench(networks[1], loadSamples));
+    if (!writeCifar(cifarFile, loadSamples) || !load->cifar.Open({ cifarFile }))
+        fprintf(stderr, "could not write %s, skipping decode\n", cifarFile.c_str());
+    for (int batch : batches)
+        addLoadScenarios(scenarios, load, batch);
+
+    std::vector<Result> results;
+    for (const Scenario& scenario : scenarios)
+    {
+        if (!options.filter.empty() && scenario.name.find(options.filter) == std::string::npos)
+            continue;
+
+        // progress goes to stderr so stdout stays valid JSON
+        results.push_back(measure(scenario, options));
+        const Result& r = results.back();
+        fprintf(stderr, "%-28s %12.1f samples/s %10.1f ns/sample (p90 %.1f) %8.3f GFLOP/s\n",
+            scenario.name.c_str(), 1e9 / r.p50, r.p50, r.p90, scenario.flopsPerSample / r.p50);
+    }
+
+    load->cifar.Close();
+    std::filesystem::remove(cifarFile, error);
+
+    FILE* file = options.out != nullptr ? fopen(options.out, "w") : stdout;
+    if (file == nullptr)
+    {
+        fprintf(stderr, "could not open %s\n", options.out);
+        return 1;
+    }
+    writeReport(file, results, options);
+    if (file != stdout)
+        fclose(file);
+    return 0;
+}
@@ -0,0 +1,271 @@
+#include "model.h"
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+static bool isLittleEndian()
+{
+    const uint32_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+static uint64_t alignUp(uint64_t offset)
+{
+    return (offset + checkpointAlignment - 1) / checkpointAlignment * checkpointAlignment;
+}
+
+static int paddedStride(int cols)
+{
+    return (cols + tensor::padding - 1) / tensor::padding * tensor::padding;
+}
+
+static hhConvShape entryShape(const hhCheckpointLayer& entry)
+{
+    return { entry.channels, entry.height, entry.width, entry.filters, entry.kernel, entry.stride, entry.padding };
+}
+
+static bool sameShape(const hhConvShape& a, const hhConvShape& b)
+{
+    return a.channels == b.channels && a.height == b.height && a.width == b.width && a.filters == b.filters
+        && a.kernel == b.kernel && a.stride == b.stride && a.padding == b.padding;
+}
+
+// weights and biases of the layer an entry describes, as the layer constructors shape them
+static int weightRows(const hhCheckpointLayer& entry)
+{
+    switch (hhLayerType(entry.type))
+    {
+        case hhLayerType::Input: case hhLayerType::MaxPool: return 0;
+        case hhLayerType::Conv2D: return entry.filters;
+        default: return entry.numNeurons;
+    }
+}
+
+static int weightCols(const hhCheckpointLayer& entry)
+{
+    return hhLayerType(entry.type) == hhLayerType::Conv2D ? entryShape(entry).PatchSize() : entry.numInputs;
+}
+
+static int biasCount(const hhCheckpointLayer& entry)
+{
+    return hhLayerType(entry.type) == hhLayerType::Input ? entry.numNeurons : weightRows(entry);
+}
+
+// ---------------------------- save ----------------------------
+
+bool hhModel::Save(const char* filename) const
+{
+    if (!isLittleEndian() || layers.empty())
+        return false;
+
+    hhCheckpointHeader header = {};
+    std::memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+    header.version = checkpointVersion;
+    header.numLayers = uint32_t(layers.size());
+    header.layerBytes = sizeof(hhCheckpointLayer);
+
+    // the blobs are the arena's parameter block, placed after the tables
+    std::vector<hhCheckpointLayer> table(layers.size());
+    const uint64_t base = alignUp(sizeof(header) + table.size() * sizeof(hhCheckpointLayer));
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const hhLayer& layer = *layers[i];
+        hhCheckpointLayer& entry = table[i];
+        entry.type = uint32_t(layer.type);
+        entry.numNeurons = layer.numNeurons;
+        entry.numInputs = layer.numInputs;
+        if (isWindowed(layer.type))
+        {
+            entry.channels = layer.shape.channels;
+            entry.height = layer.shape.height;
+            entry.width = layer.shape.width;
+            entry.filters = layer.shape.filters;
+            entry.kernel = layer.shape.kernel;
+            entry.stride = layer.shape.stride;
+            entry.padding = layer.shape.padding;
+        }
+
+        const uint64_t weightsAt = base + uint64_t(layer.arenaOffset) * sizeof(float);
+        if (layer.weights.rows > 0)
+        {
+            entry.weightStride = paddedStride(layer.weights.cols);
+            entry.weightsOffset = weightsAt;
+        }
+        if (layer.biases.cols > 0)
+            entry.biasesOffset = weightsAt + uint64_t(layer.weights.rows) * paddedStride(layer.weights.cols) * sizeof(float);
+    }
+    header.fileBytes = base + uint64_t(arena.Floats()) * sizeof(float);
+
+    // written beside the target and renamed over it, a model mapped from the old file keeps its pages
+    const std::string temporary = std::string(filename) + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(table.data(), sizeof(hhCheckpointLayer), table.size(), file) == table.size();
+
+    // zeros up to the first boundary, then the whole block in one write, its padding is zero already
+    const unsigned char zeros[checkpointAlignment] = {};
+    const size_t gap = size_t(base - sizeof(header) - table.size() * sizeof(hhCheckpointLayer));
+    ok = ok && fwrite(zeros, 1, gap, file) == gap;
+    ok = ok && fwrite(arena.Block(0), sizeof(float), arena.Floats(), file) == arena.Floats();
+
+    ok = fclose(file) == 0 && ok;
+    if (ok)
+    {
+        std::remove(filename);
+        ok = std::rename(temporary.c_str(), filename) == 0;
+    }
+    if (!ok)
+        std::remove(temporary.c_str());
+    return ok;
+}
+
+// ---------------------------- load ----------------------------
+
+// checks a table entry against the file size and the layer before it
+static bool validEntry(const hhCheckpointLayer& entry, const hhCheckpointLayer* previous, uint64_t fileBytes)
+{
+    const hhLayerType type = hhLayerType(entry.type);
+    const bool input = type == hhLayerType::Input;
+    if (entry.type > uint32_t(hhLayerType::MaxPool) || type == hhLayerType::None)
+        return false;
+    if (entry.numNeurons < 1 || input != (previous == nullptr))
+        return false;
+    if (previous != nullptr && entry.numInputs != previous->numNeurons)
+        return false;
+
+    // the geometry has to be one AddLayer accepts and size the layer exactly
+    const hhConvShape shape = entryShape(entry);
+    if (isWindowed(type))
+    {
+        if (!shape.IsValid() || shape.OutputSize() != entry.numNeurons || shape.InputSize() != entry.numInputs)
+            return false;
+        if (type == hhLayerType::MaxPool && (shape.padding != 0 || shape.filters != shape.channels))
+            return false;
+    }
+
+    const int biases = biasCount(entry);
+    if (biases == 0 && entry.biasesOffset != 0)
+        return false;
+    if (biases > 0 && (entry.biasesOffset == 0 || entry.biasesOffset % checkpointAlignment != 0
+        || entry.biasesOffset + uint64_t(paddedStride(biases)) * sizeof(float) > fileBytes))
+        return false;
+
+    const int rows = weightRows(entry);
+    if (rows == 0)
+        return entry.weightsOffset == 0;
+
+    return entry.weightStride == paddedStride(weightCols(entry))
+        && entry.weightsOffset != 0 && entry.weightsOffset % checkpointAlignment == 0
+        && entry.weightsOffset + uint64_t(rows) * entry.weightStride * sizeof(float) <= fileBytes;
+}
+
+bool hhModel::Load(const char* filename)
+{
+    if (!isLittleEndian())
+        return false;
+
+    std::unique_ptr<hhMappedFile> file(new hhMappedFile());
+    if (!file->Open(filename, true) || file->Size() < sizeof(hhCheckpointHeader))
+        return false;
+
+    hhCheckpointHeader header;
+    std::memcpy(&header, file->Data(), sizeof(header));
+    if (std::memcmp(header.magic, checkpointMagic, sizeof(header.magic)) != 0 || header.version < 1 || header.version > checkpointVersion)
+        return false;
+    const uint32_t layerBytes = header.version == 1 ? checkpointLayerBytesV1 : uint32_t(sizeof(hhCheckpointLayer));
+    if (header.fileBytes != file->Size() || header.layerBytes < layerBytes || header.numLayers == 0)
+        return false;
+    if (sizeof(header) + uint64_t(header.numLayers) * header.layerBytes > header.fileBytes)
+        return false;
+
+    // validate everything before touching the model. fields a version 1 entry lacks stay zero.
+    std::vector<hhCheckpointLayer> table(header.numLayers, hhCheckpointLayer{});
+    for (uint32_t i = 0; i < header.numLayers; i++)
+    {
+        std::memcpy(&table[i], file->Data() + sizeof(header) + size_t(i) * header.layerBytes, layerBytes);
+        if (!validEntry(table[i], i > 0 ? &table[i - 1] : nullptr, header.fileBytes))
+            return false;
+    }
+
+    if (!layers.empty())
+    {
+        if (layers.size() != table.size())
+            return false;
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            if (uint32_t(layers[i]->type) != table[i].type || layers[i]->numNeurons != table[i].numNeurons || layers[i]->numInputs != table[i].numInputs)
+                return false;
+            if (isWindowed(layers[i]->type) && !sameShape(layers[i]->shape, entryShape(table[i])))
+                return false;
+        }
+    }
+    else
+    {
+        for (const hhCheckpointLayer& entry : table)
+        {
+            if (isWindowed(hhLayerType(entry.type)))
+                AddLayer(hhLayerType(entry.type), entryShape(entry));
+            else
+                AddLayer(hhLayerType(entry.type), entry.numNeurons, entry.numInputs);
+        }
+    }
+
+    if (hasQuantized)
+        DropQuantized();
+
+    // a file laid out like the arena, every one Save writes, becomes its parameter block as it is
+    const uint64_t base = table[0].biasesOffset;
+    bool sameLayout = base + uint64_t(arena.Floats()) * sizeof(float) <= header.fileBytes;
+    for (size_t i = 0; i < layers.size() && sameLayout; i++)
+    {
+        const hhLayer& layer = *layers[i];
+        const uint64_t weightsAt = base + uint64_t(layer.arenaOffset) * sizeof(float);
+        const uint64_t biasesAt = weightsAt + uint64_t(layer.weights.rows) * layer.weights.stride * sizeof(float);
+        sameLayout = (table[i].weightsOffset == 0 || table[i].weightsOffset == weightsAt)
+            && (table[i].biasesOffset == 0 || table[i].biasesOffset == biasesAt);
+    }
+
+    unsigned char* data = file->Data();
+    if (sameLayout)
+    {
+        arena.ShareParameters(reinterpret_cast<float*>(data + base));
+        BindArena();
+    }
+    else
+    {
+        // any other layout is copied in blob by blob
+        arena.ShareParameters(nullptr);
+        BindArena();
+        for (size_t i = 0; i < layers.size(); i++)
+        {
+            hhLayer& layer = *layers[i];
+            const hhCheckpointLayer& entry = table[i];
+            for (int n = 0; n < layer.weights.rows; n++)
+                std::memcpy(layer.weights[n], data + entry.weightsOffset + uint64_t(n) * entry.weightStride * sizeof(float), layer.weights.cols * sizeof(float));
+            if (entry.biasesOffset != 0)
+                std::memcpy(layer.biases[0], data + entry.biasesOffset, layer.biases.cols * sizeof(float));
+        }
+    }
+
+    // the 16-bit copy keeps its shape, so replica views of it stay valid
+    for (const std::unique_ptr<hhLayer>& layer : layers)
+    {
+        if (hasWeights(layer->type))
+            static_cast<hhDenseLayer&>(*layer).StoreWeights();
+    }
+
+    // moments of the weights that were replaced mean nothing for the loaded ones
+    ResetOptimizer();
+
+    // the previous mapping is released only once nothing points into it, a copied file is not kept
+    checkpoint.reset(sameLayout ? file.release() : nullptr);
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+// On-disk layout of a saved hhModel, little-endian throughout:
+//
+//   hhCheckpointHeader
+//   hhCheckpointLayer    one per layer, in model order
+//   blobs                weights and biases, each starting on a 64-byte boundary
+//
+// Blobs keep the padded row stride of the in-memory tensors, so a mapped file is
+// wrapped directly as layer weights with no copying or conversion.
+
+const char checkpointMagic[4] = { 'H', 'H', 'C', 'K' };
+const uint32_t checkpointVersion = 2;   // 2 added the window geometry, version 1 files still load
+const uint64_t checkpointAlignment = 64;
+
+struct hhCheckpointHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t numLayers;
+    uint32_t layerBytes;    // sizeof(hhCheckpointLayer), so readers can skip fields added later
+    uint64_t fileBytes;
+};
+
+struct hhCheckpointLayer
+{
+    uint32_t type;          // hhLayerType
+    int32_t numNeurons;
+    int32_t numInputs;
+    int32_t weightStride;   // floats per weights row, numInputs rounded up to the alignment
+    uint64_t weightsOffset; // [rows x weightStride] floats, 0 for layers without weights
+    uint64_t biasesOffset;  // one float per weights row, numNeurons for the input layer, zero padded to the
+                            // alignment. 0 for layers without biases.
+
+    // hhConvShape of Conv2D and MaxPool layers, zero for the rest. their weights are [filters x kernel*kernel*channels],
+    // everyone else's [numNeurons x numInputs].
+    int32_t channels;
+    int32_t height;
+    int32_t width;
+    int32_t filters;
+    int32_t kernel;
+    int32_t stride;
+    int32_t padding;
+    int32_t reserved;
+};
+
+// version 1 entries end before the window geometry
+const uint32_t checkpointLayerBytesV1 = 32;
+
+static_assert(sizeof(hhCheckpointHeader) == 24, "checkpoint header must not be padded");
+static_assert(sizeof(hhCheckpointLayer) == 64, "checkpoint layer must not be padded");
@@ -0,0 +1,70 @@
+#include "dataset.h"
+
+#include <algorithm>
+#include <cassert>
+
+// ---------------------------- CIFAR ----------------------------
+
+bool hhCifarDataset::Open(const std::vector<std::string>& filenames)
+{
+    Close();
+
+    firstRecord.push_back(0);
+    for (const std::string& filename : filenames)
+    {
+        std::unique_ptr<hhMappedFile> file(new hhMappedFile());
+        if (!file->Open(filename.c_str()) || file->Size() % recordSize != 0)
+        {
+            Close();
+            return false;
+        }
+
+        numRecords += int(file->Size() / recordSize);
+        firstRecord.push_back(numRecords);
+        files.push_back(std::move(file));
+    }
+    return true;
+}
+
+void hhCifarDataset::Close()
+{
+    files.clear();
+    firstRecord.clear();
+    numRecords = 0;
+}
+
+const unsigned char* hhCifarDataset::Record(int index) const
+{
+    assert(index >= 0 && index < numRecords);
+
+    // the file whose range holds index, there are only a handful so this stays cheap
+    const size_t f = std::upper_bound(firstRecord.begin(), firstRecord.end(), index) - firstRecord.begin() - 1;
+    return files[f]->Data() + size_t(index - firstRecord[f]) * recordSize;
+}
+
+void hhCifarDataset::Decode(const int* indices, int count, tensor& images, tensor& categories) const
+{
+    // scales bytes to the 0..1 range
+    const float convert255 = 1.0f / 255.0f;
+
+    if (images.rows != count || images.cols != imageSize)
+        images.Resize(count, imageSize, true);
+    if (categories.rows != count || categories.cols != numCategories)
+        categories.Resize(count, numCategories, true);
+
+    for (int i = 0; i < count; i++)
+    {
+        const unsigned char* record = Record(indices[i]);
+        const unsigned char* pixels = record + 1;
+
+        // the red, green and blue planes keep the file's order, which is what Conv2D layers read
+        float* image = images[i];
+        for (int p = 0; p < imageSize; p++)
+            image[p] = pixels[p] * convert255;
+
+        // hot encode categories
+        float* category = categories[i];
+        for (int c = 0; c < numCategories; c++)
+            category[c] = (record[0] == c) ? 1.0f : 0.0f;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "tensor.h"
+#include "mapped.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// CIFAR-10 binary batches mapped straight from disk. Every record is one label byte followed by
+// 1024 red, 1024 green and 1024 blue bytes; nothing is decoded until a batch asks for it.
+class hhCifarDataset
+{
+public:
+    static const int imageSide = 32;
+    static const int imageSize = imageSide * imageSide * 3;
+    static const int recordSize = 1 + imageSize;
+    static const int numCategories = 10;
+
+    // maps every file in order, records are numbered across them.
+    // returns false if a file is missing or does not hold whole records.
+    bool Open(const std::vector<std::string>& filenames);
+    void Close();
+
+    int Count() const { return numRecords; }
+
+    // zero copy view of a record, label byte first
+    const unsigned char* Record(int index) const;
+    int Label(int index) const { return Record(index)[0]; }
+
+    // decodes the listed records into [count x imageSize] pixels in 0..1, red, green and blue planes,
+    // and [count x numCategories] one hot targets. the tensors are only reallocated on a shape change.
+    void Decode(const int* indices, int count, tensor& images, tensor& categories) const;
+
+private:
+    std::vector<std::unique_ptr<hhMappedFile>> files;
+    std::vector<int> firstRecord; // index of each file's first record, plus the total at the end
+    int numRecords = 0;
+};
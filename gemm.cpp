@@ -0,0 +1,294 @@
+#include "gemm.h"
+#include "tensor.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Goto-style blocking. A kc x nc panel of B is packed once and reused for every
+// block of A, an mc x kc block of A stays in L2, and one kc x nr sliver of B plus
+// the mr x kc sliver of A stream through L1 while the microkernel runs.
+static const int blockM = 144;  // divisible by every microkernel's mr
+static const int blockK = 256;
+static const int blockN = 3072; // divisible by every microkernel's nr
+
+// largest mr * nr of any microkernel, for partial edge tiles
+static const int maxTile = 8 * 32;
+
+// packs op(A)[i0 .. i0+mc, p0 .. p0+kc] into mr-row panels, zero filling the last one
+static void packA(bool transA, const float* a, int lda, int i0, int p0, int mc, int kc, int mr, float alpha, float* dst)
+{
+    for (int i = 0; i < mc; i += mr)
+    {
+        const int rows = std::min(mr, mc - i);
+        if (transA)
+        {
+            for (int p = 0; p < kc; p++)
+            {
+                const float* src = a + size_t(p0 + p) * lda + i0 + i;
+                for (int ii = 0; ii < rows; ii++)
+                    dst[p * mr + ii] = alpha * src[ii];
+                for (int ii = rows; ii < mr; ii++)
+                    dst[p * mr + ii] = 0.0f;
+            }
+        }
+        else
+        {
+            for (int ii = 0; ii < mr; ii++)
+            {
+                const float* src = a + size_t(i0 + i + ii) * lda + p0;
+                for (int p = 0; p < kc; p++)
+                    dst[p * mr + ii] = ii < rows ? alpha * src[p] : 0.0f;
+            }
+        }
+        dst += size_t(mr) * kc;
+    }
+}
+
+// B operand stored as floats, rows are read in place
+struct hhFloatRows
+{
+    const float* b;
+    const float* Row(size_t offset, int, float*) const { return b + offset; }
+};
+
+// B operand stored as 16-bit floats, rows are widened into the scratch space
+struct hhHalfRows
+{
+    const uint16_t* b;
+    void (*widen)(const uint16_t* x, float* y, int n);
+    const float* Row(size_t offset, int count, float* scratch) const
+    {
+        widen(b + offset, scratch, count);
+        return scratch;
+    }
+};
+
+// packs op(B)[p0 .. p0+kc, j0 .. j0+nc] into nr-column panels, zero filling the last one
+template <typename Rows>
+static void packB(bool transB, const Rows& b, int ldb, int p0, int j0, int kc, int nc, int nr, float* dst)
+{
+    // transposing takes rows in groups so every step stores a run of neighbouring floats.
+    // every microkernel's nr is a multiple of the group, rows past the edge read zeros.
+    const int group = 8;
+    static const float zeros[blockK] = {};
+    alignas(64) float scratch[group][blockK];
+    for (int j = 0; j < nc; j += nr)
+    {
+        const int cols = std::min(nr, nc - j);
+        if (transB)
+        {
+            for (int jj = 0; jj < nr; jj += group)
+            {
+                const float* src[group];
+                for (int g = 0; g < group; g++)
+                    src[g] = jj + g < cols ? b.Row(size_t(j0 + j + jj + g) * ldb + p0, kc, scratch[g]) : zeros;
+
+                // spelled out so the eight row pointers stay in registers
+                const float* s0 = src[0];
+                const float* s1 = src[1];
+                const float* s2 = src[2];
+                const float* s3 = src[3];
+                const float* s4 = src[4];
+                const float* s5 = src[5];
+                const float* s6 = src[6];
+                const float* s7 = src[7];
+                for (int p = 0; p < kc; p++)
+                {
+                    float* out = dst + p * nr + jj;
+                    out[0] = s0[p];
+                    out[1] = s1[p];
+                    out[2] = s2[p];
+                    out[3] = s3[p];
+                    out[4] = s4[p];
+                    out[5] = s5[p];
+                    out[6] = s6[p];
+                    out[7] = s7[p];
+                }
+            }
+        }
+        else
+        {
+            for (int p = 0; p < kc; p++)
+            {
+                // 16-bit rows widen straight into the panel
+                const float* src = b.Row(size_t(p0 + p) * ldb + j0 + j, cols, dst + p * nr);
+                if (src != dst + p * nr)
+                    std::memcpy(dst + p * nr, src, cols * sizeof(float));
+                for (int jj = cols; jj < nr; jj++)
+                    dst[p * nr + jj] = 0.0f;
+            }
+        }
+        dst += size_t(nr) * kc;
+    }
+}
+
+static void scaleC(int m, int n, float beta, float* c, int ldc)
+{
+    for (int i = 0; i < m; i++)
+    {
+        float* row = c + size_t(i) * ldc;
+        if (beta == 0.0f)
+        {
+            std::memset(row, 0, n * sizeof(float));
+        }
+        else
+        {
+            for (int j = 0; j < n; j++)
+                row[j] *= beta;
+        }
+    }
+}
+
+void applyEpilogue(const hhKernels& kernels, const hhGemmEpilogue& epilogue, float* row, int first, int count)
+{
+    if (epilogue.op == hhEpilogueOp::None)
+        return;
+
+    kernels.biasAdd(row, epilogue.bias + first, count);
+    if (epilogue.op == hhEpilogueOp::BiasSigmoid)
+    {
+        kernels.fastSigmoid(row, row, count);
+    }
+    else if (epilogue.op == hhEpilogueOp::BiasRelu)
+    {
+        for (int j = 0; j < count; j++)
+            row[j] = std::max(0.0f, row[j]);
+    }
+}
+
+static void applyEpilogue(const hhKernels& kernels, const hhGemmEpilogue& epilogue, float* c, int ldc, int rows, int first, int count)
+{
+    for (int i = 0; i < rows; i++)
+        applyEpilogue(kernels, epilogue, c + size_t(i) * ldc, first, count);
+}
+
+template <typename Rows>
+static void blockedGemm(const hhKernels& kernels, bool transA, bool transB, int m, int n, int k,
+    float alpha, const float* a, int lda,
+    const Rows& b, int ldb,
+    float beta, float* c, int ldc, const hhGemmEpilogue& epilogue)
+{
+    if (beta != 1.0f)
+        scaleC(m, n, beta, c, ldc);
+    if (k <= 0 || alpha == 0.0f)
+    {
+        applyEpilogue(kernels, epilogue, c, ldc, m, 0, n);
+        return;
+    }
+
+    const int mr = kernels.gemmMr;
+    const int nr = kernels.gemmNr;
+    const int mc = blockM / mr * mr;
+
+    // per thread so concurrent callers never share packing space
+    static thread_local tensor packedA;
+    static thread_local tensor packedB;
+    packedA.Resize(1, blockM * blockK);
+    packedB.Resize(1, blockK * blockN);
+
+    alignas(64) float tile[maxTile];
+
+    for (int j0 = 0; j0 < n; j0 += blockN)
+    {
+        const int nc = std::min(blockN, n - j0);
+        for (int p0 = 0; p0 < k; p0 += blockK)
+        {
+            const int kc = std::min(blockK, k - p0);
+            const bool last = p0 + kc == k;
+            packB(transB, b, ldb, p0, j0, kc, nc, nr, packedB.Data());
+
+            for (int i0 = 0; i0 < m; i0 += mc)
+            {
+                const int mcc = std::min(mc, m - i0);
+                packA(transA, a, lda, i0, p0, mcc, kc, mr, alpha, packedA.Data());
+
+                for (int j = 0; j < nc; j += nr)
+                {
+                    const int cols = std::min(nr, nc - j);
+                    const float* panelB = packedB.Data() + size_t(j) * kc;
+                    for (int i = 0; i < mcc; i += mr)
+                    {
+                        const int rows = std::min(mr, mcc - i);
+                        const float* panelA = packedA.Data() + size_t(i) * kc;
+                        float* out = c + size_t(i0 + i) * ldc + j0 + j;
+
+                        if (rows == mr && cols == nr)
+                        {
+                            kernels.gemmMicro(kc, panelA, panelB, out, ldc);
+                        }
+                        else
+                        {
+                            // edge tile, run the full microkernel into scratch and add back what fits
+                            std::memset(tile, 0, sizeof(tile));
+                            kernels.gemmMicro(kc, panelA, panelB, tile, nr);
+                            for (int ii = 0; ii < rows; ii++)
+                                for (int jj = 0; jj < cols; jj++)
+                                    out[size_t(ii) * ldc + jj] += tile[ii * nr + jj];
+                        }
+
+                        // the tile the microkernel just stored is final after the last k block
+                        if (last)
+                            applyEpilogue(kernels, epilogue, out, ldc, rows, j0 + j, cols);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void gemm(const hhKernels& kernels, bool transA, bool transB, int m, int n, int k,
+    float alpha, const float* a, int lda,
+    const float* b, int ldb,
+    float beta, float* c, int ldc, const hhGemmEpilogue& epilogue)
+{
+    if (m <= 0 || n <= 0)
+        return;
+
+    // a single row against a transposed matrix is a plain matrix-vector product, packing would only add traffic
+    if (m == 1 && !transA && transB && alpha == 1.0f && beta == 0.0f)
+    {
+        kernels.gemv(b, ldb, a, c, n, k);
+        applyEpilogue(kernels, epilogue, c, 0, n);
+        return;
+    }
+
+    blockedGemm(kernels, transA, transB, m, n, k, alpha, a, lda, hhFloatRows{ b }, ldb, beta, c, ldc, epilogue);
+}
+
+void gemm(bool transA, bool transB, int m, int n, int k,
+    float alpha, const float* a, int lda,
+    const float* b, int ldb,
+    float beta, float* c, int ldc, const hhGemmEpilogue& epilogue)
+{
+    gemm(activeKernels(), transA, transB, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, epilogue);
+}
+
+void gemm(const hhKernels& kernels, bool transA, bool transB, int m, int n, int k,
+    float alpha, const float* a, int lda,
+    const uint16_t* b, int ldb, hhPrecision precision,
+    float beta, float* c, int ldc, const hhGemmEpilogue& epilogue)
+{
+    if (m <= 0 || n <= 0)
+        return;
+
+    const bool bfloat16 = precision == hhPrecision::BFloat16;
+
+    // the matrix-vector product widens in registers, B is read exactly once at 16 bits
+    if (m == 1 && !transA && transB && alpha == 1.0f && beta == 0.0f)
+    {
+        (bfloat16 ? kernels.gemvBfloat16 : kernels.gemvHalf)(b, ldb, a, c, n, k);
+        applyEpilogue(kernels, epilogue, c, 0, n);
+        return;
+    }
+
+    const hhHalfRows rows = { b, bfloat16 ? kernels.bfloat16ToFloat : kernels.halfToFloat };
+    blockedGemm(kernels, transA, transB, m, n, k, alpha, a, lda, rows, ldb, beta, c, ldc, epilogue);
+}
+
+void gemm(bool transA, bool transB, int m, int n, int k,
+    float alpha, const float* a, int lda,
+    const uint16_t* b, int ldb, hhPrecision precision,
+    float beta, float* c, int ldc, const hhGemmEpilogue& epilogue)
+{
+    gemm(activeKernels(), transA, transB, m, n, k, alpha, a, lda, b, ldb, precision, beta, c, ldc, epilogue);
+}
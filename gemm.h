@@ -0,0 +1,48 @@
+#pragma once
+
+#include "kernels.h"
+
+// work gemm does on each finished tile of C while it is still in L1, instead of another pass over C
+enum class hhEpilogueOp
+{
+    None,
+    Bias,           // c[i][j] += bias[j]
+    BiasSigmoid,    // then fastSigmoid
+    BiasRelu,       // then max(0, c)
+};
+
+struct hhGemmEpilogue
+{
+    hhEpilogueOp op = hhEpilogueOp::None;
+    const float* bias = nullptr;    // one value per column of C
+};
+
+// applies the epilogue to count values of one row of C that start at column first
+void applyEpilogue(const hhKernels& kernels, const hhGemmEpilogue& epilogue, float* row, int first, int count);
+
+// C = alpha * op(A) * op(B) + beta * C on row-major matrices,
+// where op(A) is [m x k], op(B) is [k x n] and C is [m x n].
+// op(X) is X, or X transposed when the matching trans flag is set.
+// the epilogue runs once on every element of C, after its sum is complete.
+void gemm(bool transA, bool transB, int m, int n, int k,
+    float alpha, const float* a, int lda,
+    const float* b, int ldb,
+    float beta, float* c, int ldc, const hhGemmEpilogue& epilogue = hhGemmEpilogue());
+
+// same, with an explicit kernel table instead of activeKernels()
+void gemm(const hhKernels& kernels, bool transA, bool transB, int m, int n, int k,
+    float alpha, const float* a, int lda,
+    const float* b, int ldb,
+    float beta, float* c, int ldc, const hhGemmEpilogue& epilogue = hhGemmEpilogue());
+
+// same, with op(B) stored as 16-bit floats of the given precision and widened to float32 while packing,
+// so B is streamed from memory at half the bytes
+void gemm(bool transA, bool transB, int m, int n, int k,
+    float alpha, const float* a, int lda,
+    const uint16_t* b, int ldb, hhPrecision precision,
+    float beta, float* c, int ldc, const hhGemmEpilogue& epilogue = hhGemmEpilogue());
+
+void gemm(const hhKernels& kernels, bool transA, bool transB, int m, int n, int k,
+    float alpha, const float* a, int lda,
+    const uint16_t* b, int ldb, hhPrecision precision,
+    float beta, float* c, int ldc, const hhGemmEpilogue& epilogue = hhGemmEpilogue());
@@ -1,83 +1,23 @@
 #include <iostream>
 #include <random>
 #include <cassert>
-#include <array>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
 
-#include <fstream>
-#include <iterator>
+#include <cstdio>
 
 #include "model.h"
+#include "dataset.h"
 #include "render.h"
+#include "tasks.h"
 
-// each image is 32 x 32 x 3
-const int imageArraySize = 32 * 32 * 3;
-const int numImages = 400;
-const int numCategories = 10;
-
-// each image in the data is this many bytes
-const int imageDataSize = 1 + 1024*3;
-
-// constant to covert from 255 to float in 0-to-1 range
-const float convert255 = float(1) / float(255);
-
-void loadImages(const char* filename, matrix& images, matrix& categories)
+int main(int argc, char** argv)
 {
-    std::ifstream input(filename, std::ios::binary );
-    std::vector<unsigned char> buffer(std::istreambuf_iterator<char>(input), {});
-
-    // flatten and scale image data from the file into a matrix
-    for (int i=0; i < numImages; i++)
-    {
-        images[i].resize(1024 * 3);
-
-        unsigned char* imagePtr = &buffer[i*imageDataSize];
-        unsigned char* r = &imagePtr[1];
-        unsigned char* g = &imagePtr[1+1024];
-        unsigned char* b = &imagePtr[1+1024+1024];
-
-        for (int pixel = 0; pixel < 1024; pixel++)
-        {
-            const int o = pixel*3;
-            images[i][o+0] = (*r++) * convert255;
-            images[i][o+1] = (*g++) * convert255;
-            images[i][o+2] = (*b++) * convert255;
-        }
-
-        // hot encode categories
-        categories[i].resize(numCategories);
-        unsigned char category = *imagePtr;
-        for (int c=0; c < numCategories; c++)
-        {
-            categories[i][c] = (int(category) == c) ? 1.0f : 0.0f;
-        }
-    }
-}
-
-
-class ImageTask : public hhTask
-{
-public:
-
-    void Configure(hhModel& model) override
-    {
-        learningRate = 0.1f;
-        epochs = 1;
-        batchSize = 24;
-
-        AddLayer(hhLayerType::Input, imageArraySize, 0);
-        AddLayer(hhLayerType::Relu, 200, imageArraySize);
-        AddLayer(hhLayerType::Sigmoid, 150, 200);
-        AddLayer(hhLayerType::Softmax, numCategories, 150);
-
-        inputs.resize(numImages);
-        targets.resize(numImages);        
-        loadImages("Resources/Data/data_batch_1.bin", inputs, targets);
-    }
-};
+    // --lockstep trains and draws in turn on one thread, as before the trainer had its own
+    const bool lockstep = argc > 1 && std::strcmp(argv[1], "--lockstep") == 0;
 
-
-int main(int, char**)
-{
     // stable random values
     srand(101010101);
 
@@ -85,9 +25,16 @@ int main(int, char**)
     hhModel model;
     model.Configure(task);
 
-    matrix testImages(numImages);
-    matrix testCategories(numImages);
-    loadImages("Resources/Data/test_batch.bin", testImages, testCategories);
+    // pick up where the last run stopped
+    if (model.Load("images.hhm"))
+        printf("loaded images.hhm\n");
+
+    hhCifarDataset testImages;
+    if (!testImages.Open({ "Resources/Data/test_batch.bin" }) || task.images.Count() == 0)
+    {
+        printf("CIFAR-10 batches not found in Resources/Data\n");
+        return 1;
+    }
 
     renderWindow rw;
 
@@ -95,46 +42,54 @@ int main(int, char**)
     //std::ifstream input("Resources/Data/test_batch.bin", std::ios::binary );
     //std::vector<unsigned char> buffer(std::istreambuf_iterator<char>(input), {});
 
-    // stable random set of test indices
-    const int numTests = 32;    
-    std::array<int, numTests> testIds;
-    for (int j=0; j< numTests; j++)
-    testIds[j] = rand() % numTests;
+    // training runs flat out on its own thread and publishes after every epoch, the window shows the newest
+    // progress at its own pace. accuracy comes from the validation thread, training never stops to measure it.
+    hhTripleBuffer<hhModelSnapshot> snapshots;
+    model.PublishSnapshot(snapshots);
 
-    float loss = 0;
-    int trainingRuns = 0;
-    bool running = 1;
-    while (running)
+    // one epoch per Train call. false once early stopping has ended training.
+    auto trainEpoch = [&]()
     {
-        model.Train();
-
-        trainingRuns++;
+        const bool more = model.Train();
+        if (!more)
+            printf("validation loss stopped improving after %d epochs, best %.4f at epoch %d\n",
+                model.trainedEpochs, model.bestValidation.loss, model.bestValidation.epoch);
+
+        // the compute loop should never wait on decoding, report it if it does
+        const hhPrefetchStats& stats = model.prefetcher.stats;
+        if (stats.stalls > 0)
+            printf("data stalls: %d of %d batches, %.1f ms\n", stats.stalls, stats.batches, stats.stallSeconds * 1000.0);
+        model.PublishSnapshot(snapshots);
+        return more;
+    };
+
+    std::atomic<bool> finished{false};
+    std::thread trainer;
+    if (!lockstep)
+    {
+        trainer = std::thread([&]()
         {
-            column predictions(numCategories);
-
-            int numCorrect = 0;
-
-            // calculate accuracy on a subset of test images
-            for (int t=0; t < numTests; t++)
-            {
-                const int index = testIds[t];
-
-                column predictions = model.Predict(testImages[index]);
-                
-                int predictedCategory = argmax(predictions);
-                int testCategory = argmax(testCategories[index]);
+            while (trainEpoch())
+                ;
+            finished.store(true, std::memory_order_release);
+        });
+    }
 
-                if (predictedCategory == testCategory)
-                    numCorrect += 1;
+    bool running = 1;
+    while (running)
+    {
+        if (lockstep && !trainEpoch())
+            running = false;
+        if (finished.load(std::memory_order_acquire))
+            running = false;
 
-            }
-            loss = float(numCorrect) / numTests;
-        }
+        snapshots.Acquire();
+        const hhModelSnapshot& shown = snapshots.Front();
 
         rw.ProcessEvents(running);
 
         rw.BeginDisplay();
-        rw.DisplayTitle(model.numEpochs, loss, "Images");
+        rw.DisplayTitle(shown.numEpochs, shown.lastValidation.accuracy, "Images");
 
 
 
@@ -154,4 +109,28 @@ int main(int, char**)
         
         rw.EndDisplay();
     }
+
+    // a closed window cuts the epoch in progress short
+    model.interrupt.store(true, std::memory_order_relaxed);
+    if (trainer.joinable())
+        trainer.join();
+    model.interrupt.store(false, std::memory_order_relaxed);
+
+    model.Save("images.hhm");
+    model.PrintStats();
+
+    // how much the int8 weights cost in accuracy, measured on the first part of the test set
+    const int numCompared = std::min(1000, testImages.Count());
+    std::vector<int> compareIds(numCompared);
+    for (int j = 0; j < numCompared; j++)
+        compareIds[j] = j;
+    tensor compareImages, compareCategories;
+    testImages.Decode(compareIds.data(), numCompared, compareImages, compareCategories);
+
+    model.Quantize();
+    const hhQuantizationReport report = model.CompareQuantized(compareImages, compareCategories);
+    printf("int8: accuracy %.3f vs %.3f float, %.1f%% agreement, max output delta %.4f\n",
+        report.int8Accuracy, report.floatAccuracy, report.agreement * 100.0f, report.maxOutputDelta);
+    printf("int8: weights %zu vs %zu bytes, %.1f ms vs %.1f ms for %d images\n",
+        report.int8WeightBytes, report.floatWeightBytes, report.int8Seconds * 1000.0, report.floatSeconds * 1000.0, report.samples);
 }
@@ -0,0 +1,510 @@
+#include "kernels.h"
+#include "kernels_exp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if HH_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// ---------------------------- cpu detection ----------------------------
+
+#if HH_X86
+
+static void cpuid(unsigned regs[4], unsigned leaf, unsigned subleaf)
+{
+#if defined(_MSC_VER)
+    __cpuidex(reinterpret_cast<int*>(regs), int(leaf), int(subleaf));
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// register state the OS saves on context switch
+static unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+}
+
+#endif
+
+hhSimdLevel detectSimdLevel()
+{
+#if HH_X86
+    unsigned regs[4];
+    cpuid(regs, 0, 0);
+    const unsigned maxLeaf = regs[0];
+
+    cpuid(regs, 1, 0);
+    const bool sse2 = (regs[3] & (1u << 26)) != 0;
+    const bool fma = (regs[2] & (1u << 12)) != 0;
+    const bool f16c = (regs[2] & (1u << 29)) != 0;
+    const bool osxsave = (regs[2] & (1u << 27)) != 0;
+    const bool avx = (regs[2] & (1u << 28)) != 0;
+    if (!sse2)
+        return hhSimdLevel::Scalar;
+
+    // the OS must preserve the wider registers before we can touch them
+    const unsigned long long xcr0 = (osxsave && avx) ? xgetbv0() : 0;
+    const bool ymmState = (xcr0 & 0x6) == 0x6;
+    const bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+    bool avx2 = false;
+    bool avx512f = false;
+    if (maxLeaf >= 7)
+    {
+        cpuid(regs, 7, 0);
+        avx2 = (regs[1] & (1u << 5)) != 0;
+        avx512f = (regs[1] & (1u << 16)) != 0;
+    }
+
+    if (avx512f && zmmState)
+        return hhSimdLevel::AVX512;
+    if (avx2 && fma && f16c && ymmState)
+        return hhSimdLevel::AVX2;
+    return hhSimdLevel::SSE2;
+#else
+    return hhSimdLevel::Scalar;
+#endif
+}
+
+#if HH_X86
+
+bool detectAvx512Vnni()
+{
+    if (detectSimdLevel() < hhSimdLevel::AVX512)
+        return false;
+
+    unsigned regs[4];
+    cpuid(regs, 7, 0);
+    const bool avx512bw = (regs[1] & (1u << 30)) != 0;
+    const bool vnni = (regs[2] & (1u << 11)) != 0;
+    return avx512bw && vnni;
+}
+
+bool detectAvx512Bf16()
+{
+    if (detectSimdLevel() < hhSimdLevel::AVX512)
+        return false;
+
+    // reported in sub-leaf 1, which exists only when sub-leaf 0 says so
+    unsigned regs[4];
+    cpuid(regs, 7, 0);
+    if (regs[0] < 1)
+        return false;
+    cpuid(regs, 7, 1);
+    return (regs[0] & (1u << 5)) != 0;
+}
+
+// the AVX-512 table with the kernels of whichever extensions the CPU has swapped in
+static hhKernels withExtensions(hhKernels kernels, bool vnni, bool bf16)
+{
+    if (vnni)
+        kernels.gemmInt8 = avx512VnniGemmInt8;
+    if (bf16)
+        kernels.floatToBfloat16 = avx512Bf16FromFloat;
+
+    if (vnni || bf16)
+        kernels.name = !bf16 ? "avx512+vnni" : !vnni ? "avx512+bf16" : "avx512+vnni+bf16";
+    return kernels;
+}
+
+#endif
+
+const hhKernels* kernelsFor(hhSimdLevel level)
+{
+    if (level > detectSimdLevel())
+        return nullptr;
+
+    switch (level)
+    {
+        case hhSimdLevel::Scalar: return &scalarKernels;
+#if HH_X86
+        case hhSimdLevel::SSE2: return &sse2Kernels;
+        case hhSimdLevel::AVX2: return &avx2Kernels;
+        case hhSimdLevel::AVX512:
+        {
+            static const hhKernels extendedKernels = withExtensions(avx512Kernels, detectAvx512Vnni(), detectAvx512Bf16());
+            return &extendedKernels;
+        }
+#endif
+        default: return nullptr;
+    }
+}
+
+static const hhKernels& selectKernels()
+{
+    hhSimdLevel level = detectSimdLevel();
+
+    const char* requested = std::getenv("HH_SIMD");
+    if (requested != nullptr)
+    {
+        hhSimdLevel cap = level;
+        if (std::strcmp(requested, "scalar") == 0) cap = hhSimdLevel::Scalar;
+        else if (std::strcmp(requested, "sse2") == 0) cap = hhSimdLevel::SSE2;
+        else if (std::strcmp(requested, "avx2") == 0) cap = hhSimdLevel::AVX2;
+        else if (std::strcmp(requested, "avx512") == 0) cap = hhSimdLevel::AVX512;
+        if (cap < level)
+            level = cap;
+    }
+
+    const hhKernels* k = kernelsFor(level);
+    return k != nullptr ? *k : scalarKernels;
+}
+
+const hhKernels& activeKernels()
+{
+    static const hhKernels& selected = selectKernels();
+    return selected;
+}
+
+// ---------------------------- scalar ----------------------------
+
+static float scalarDot(const float* a, const float* b, int n)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static void scalarGemv(const float* w, int stride, const float* x, float* y, int rows, int cols)
+{
+    for (int r = 0; r < rows; r++)
+        y[r] = scalarDot(w + size_t(r) * stride, x, cols);
+}
+
+static void scalarAxpy(float a, const float* x, float* y, int n)
+{
+    for (int i = 0; i < n; i++)
+        y[i] += a * x[i];
+}
+
+static void scalarBiasAdd(float* y, const float* b, int n)
+{
+    for (int i = 0; i < n; i++)
+        y[i] += b[i];
+}
+
+static const int scalarMr = 4;
+static const int scalarNr = 8;
+
+static void scalarGemmMicro(int kc, const float* a, const float* b, float* c, int ldc)
+{
+    float acc[scalarMr][scalarNr] = {};
+    for (int p = 0; p < kc; p++)
+    {
+        for (int i = 0; i < scalarMr; i++)
+            for (int j = 0; j < scalarNr; j++)
+                acc[i][j] += a[i] * b[j];
+        a += scalarMr;
+        b += scalarNr;
+    }
+
+    for (int i = 0; i < scalarMr; i++)
+        for (int j = 0; j < scalarNr; j++)
+            c[i * ldc + j] += acc[i][j];
+}
+
+static float scalarExp1(float x)
+{
+    x = std::min(std::max(x, expLo), expHi);
+    const float n = std::nearbyint(x * expLog2e);
+    float r = x - n * expLn2Hi;
+    r = r - n * expLn2Lo;
+
+    float p = expP0;
+    p = p * r + expP1;
+    p = p * r + expP2;
+    p = p * r + expP3;
+    p = p * r + expP4;
+    p = p * r + expP5;
+    const float y = p * r * r + (r + 1.0f);
+
+    // 2^n built directly in the exponent field
+    const int32_t bits = (int32_t(n) + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(scale));
+    return y * scale;
+}
+
+static void scalarFastExp(const float* x, float* y, int n)
+{
+    for (int i = 0; i < n; i++)
+        y[i] = scalarExp1(x[i]);
+}
+
+static void scalarFastSigmoid(const float* x, float* y, int n)
+{
+    for (int i = 0; i < n; i++)
+        y[i] = 1.0f / (1.0f + scalarExp1(-x[i]));
+}
+
+static void scalarFastSoftmax(const float* x, float* y, int n)
+{
+    if (n <= 0)
+        return;
+
+    float highest = x[0];
+    for (int i = 1; i < n; i++)
+        highest = std::max(highest, x[i]);
+
+    float sum = 0.0f;
+    for (int i = 0; i < n; i++)
+    {
+        y[i] = scalarExp1(x[i] - highest);
+        sum += y[i];
+    }
+
+    const float scale = 1.0f / sum;
+    for (int i = 0; i < n; i++)
+        y[i] *= scale;
+}
+
+static void scalarGemmInt8(int batch, int rows, int cols, const int8_t* x, int ldx, const int8_t* w, int ldw, int32_t* y, int ldy)
+{
+    for (int b = 0; b < batch; b++)
+    {
+        const int8_t* sample = x + size_t(b) * ldx;
+        for (int r = 0; r < rows; r++)
+        {
+            const int8_t* row = w + size_t(r) * ldw;
+            int32_t sum = 0;
+            for (int i = 0; i < cols; i++)
+                sum += int32_t(row[i]) * sample[i];
+            y[size_t(b) * ldy + r] = sum;
+        }
+    }
+}
+
+static void scalarQuantizeInt8(const float* x, int8_t* q, float inverseScale, int n)
+{
+    for (int i = 0; i < n; i++)
+        q[i] = int8_t(std::nearbyint(std::min(127.0f, std::max(-127.0f, x[i] * inverseScale))));
+}
+
+static void scalarFloatToBytes(const float* x, uint8_t* y, int n)
+{
+    // the comparisons send NaN to zero, like the max of the SIMD versions
+    for (int i = 0; i < n; i++)
+    {
+        const float v = x[i] * 255.0f;
+        y[i] = uint8_t(v > 0.0f ? (v < 255.0f ? v : 255.0f) : 0.0f);
+    }
+}
+
+// rounding to nearest even happens in the float add for denormal results and in the carry
+// out of the dropped mantissa bits for normal ones
+static uint16_t halfFromFloat(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+    bits &= 0x7fffffff;
+
+    if (bits >= 0x47800000) // 65536 and up, infinity or NaN
+        return sign | (bits > 0x7f800000 ? 0x7e00 : 0x7c00);
+
+    if (bits < 0x38800000) // below 2^-14, the result is denormal or zero
+    {
+        // adding 0.5 lines the half denormal up with the bottom of the float mantissa
+        float shifted;
+        std::memcpy(&shifted, &bits, sizeof(shifted));
+        shifted += 0.5f;
+        std::memcpy(&bits, &shifted, sizeof(bits));
+        return sign | uint16_t(bits - 0x3f000000);
+    }
+
+    // rebias the exponent, then round on the 13 mantissa bits being dropped
+    bits += 0xc8000fff + ((bits >> 13) & 1);
+    return sign | uint16_t(bits >> 13);
+}
+
+static float floatFromHalf(uint16_t half)
+{
+    const uint32_t sign = uint32_t(half & 0x8000) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1f;
+    const uint32_t mantissa = half & 0x3ff;
+
+    uint32_t bits;
+    if (exponent == 0x1f)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else if (exponent == 0)
+    {
+        // zero or denormal, exact in float
+        const float magnitude = float(mantissa) * (1.0f / 16777216.0f);
+        std::memcpy(&bits, &magnitude, sizeof(bits));
+        bits |= sign;
+    }
+    else
+    {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint16_t bfloat16FromFloat(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffff) > 0x7f800000)
+        return uint16_t((bits >> 16) | 0x40);
+    if ((bits & 0x7f800000) == 0)
+        return uint16_t((bits >> 16) & 0x8000);
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return uint16_t(bits >> 16);
+}
+
+static void scalarFloatToHalf(const float* x, uint16_t* y, int n)
+{
+    for (int i = 0; i < n; i++)
+        y[i] = halfFromFloat(x[i]);
+}
+
+static void scalarHalfToFloat(const uint16_t* x, float* y, int n)
+{
+    for (int i = 0; i < n; i++)
+        y[i] = floatFromHalf(x[i]);
+}
+
+static void scalarFloatToBfloat16(const float* x, uint16_t* y, int n)
+{
+    for (int i = 0; i < n; i++)
+        y[i] = bfloat16FromFloat(x[i]);
+}
+
+static void scalarBfloat16ToFloat(const uint16_t* x, float* y, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        const uint32_t bits = uint32_t(x[i]) << 16;
+        std::memcpy(&y[i], &bits, sizeof(bits));
+    }
+}
+
+static void scalarGemvHalf(const uint16_t* w, int stride, const float* x, float* y, int rows, int cols)
+{
+    for (int r = 0; r < rows; r++)
+    {
+        const uint16_t* row = w + size_t(r) * stride;
+        float sum = 0.0f;
+        for (int i = 0; i < cols; i++)
+            sum += floatFromHalf(row[i]) * x[i];
+        y[r] = sum;
+    }
+}
+
+static void scalarGemvBfloat16(const uint16_t* w, int stride, const float* x, float* y, int rows, int cols)
+{
+    for (int r = 0; r < rows; r++)
+    {
+        const uint16_t* row = w + size_t(r) * stride;
+        float sum = 0.0f;
+        for (int i = 0; i < cols; i++)
+        {
+            const uint32_t bits = uint32_t(row[i]) << 16;
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            sum += value * x[i];
+        }
+        y[r] = sum;
+    }
+}
+
+static void scalarDenseBackward(int rows, int cols, int batch, const float* errors, int lde, const float* inputs, int ldi,
+    float* propagated, int ldp, float* w, int ldw, float rate)
+{
+    for (int r = 0; r < rows; r++)
+    {
+        float* row = w + size_t(r) * ldw;
+        for (int i = 0; i < cols; i++)
+        {
+            const float old = row[i];
+            float gradient = 0.0f;
+            for (int b = 0; b < batch; b++)
+            {
+                const float e = errors[size_t(b) * lde + r];
+                gradient += e * inputs[size_t(b) * ldi + i];
+                if (propagated != nullptr)
+                    propagated[size_t(b) * ldp + i] += e * old;
+            }
+            row[i] = old - rate * gradient;
+        }
+    }
+}
+
+static void scalarMomentumUpdate(const hhUpdateStep& step, float* w, const float* g, float* v, int n)
+{
+    // the look-ahead step adds the gradient once more and scales the velocity by momentum
+    const bool nesterov = step.type == hhOptimizerType::Nesterov;
+    const float gradientPart = nesterov ? 1.0f : 0.0f;
+    const float velocityPart = nesterov ? step.momentum : 1.0f;
+    for (int i = 0; i < n; i++)
+    {
+        const float gradient = step.scale * g[i] + step.decay * w[i];
+        const float velocity = step.momentum * v[i] + gradient;
+        v[i] = velocity;
+        w[i] -= step.rate * (gradientPart * gradient + velocityPart * velocity);
+    }
+}
+
+static void scalarAdamUpdate(const hhUpdateStep& step, float* w, const float* g, float* m, float* v, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        const float gradient = step.scale * g[i] + step.decay * w[i];
+        const float mean = step.momentum * m[i] + (1.0f - step.momentum) * gradient;
+        const float square = step.beta2 * v[i] + (1.0f - step.beta2) * gradient * gradient;
+        m[i] = mean;
+        v[i] = square;
+        const float adaptive = mean * step.firstCorrection / (std::sqrt(square * step.secondCorrection) + step.epsilon);
+        w[i] -= step.rate * (adaptive + step.decoupledDecay * w[i]);
+    }
+}
+
+const hhKernels scalarKernels =
+{
+    hhSimdLevel::Scalar,
+    "scalar",
+    scalarDot,
+    scalarGemv,
+    scalarAxpy,
+    scalarBiasAdd,
+    scalarMr,
+    scalarNr,
+    scalarGemmMicro,
+    scalarFastExp,
+    scalarFastSigmoid,
+    scalarFastSoftmax,
+    scalarGemmInt8,
+    scalarQuantizeInt8,
+    scalarFloatToHalf,
+    scalarHalfToFloat,
+    scalarFloatToBfloat16,
+    scalarBfloat16ToFloat,
+    scalarGemvHalf,
+    scalarGemvBfloat16,
+    scalarDenseBackward,
+    scalarMomentumUpdate,
+    scalarAdamUpdate,
+    scalarFloatToBytes,
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HH_X86 1
+#else
+#define HH_X86 0
+#endif
+
+// SSE2 enabled for every translation unit, not only the SSE2 table's, as on any x64 target
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HH_SSE2_BASELINE 1
+#else
+#define HH_SSE2_BASELINE 0
+#endif
+
+enum class hhSimdLevel
+{
+    Scalar,
+    SSE2,
+    AVX2,   // AVX2 + FMA + F16C
+    AVX512, // AVX-512F
+};
+
+// storage formats for weights, see the 16-bit conversions below
+enum class hhPrecision
+{
+    Float32,
+    Float16,    // IEEE half, 10 mantissa bits and a range of +-65504
+    BFloat16,   // float32 range with 7 mantissa bits
+};
+
+// update rules for the weights, see hhOptimizer in task.h
+enum class hhOptimizerType
+{
+    Sgd,
+    Momentum,   // heavy ball, w -= rate * v with v = momentum * v + g
+    Nesterov,   // momentum stepping from the look-ahead point, w -= rate * (g + momentum * v)
+    Adam,
+    AdamW,      // Adam with the weight decay applied to the weights instead of the gradient
+};
+
+// constants of one optimizer step, the same for every parameter of a layer. g enters summed over the batch.
+struct hhUpdateStep
+{
+    hhOptimizerType type = hhOptimizerType::Sgd;
+    float rate = 0.0f;
+    float scale = 1.0f;             // turns summed gradients into their mean
+    float decay = 0.0f;             // L2 penalty added to the gradient, g += decay * w
+    float decoupledDecay = 0.0f;    // AdamW's, w -= rate * decoupledDecay * w beside the adaptive step
+    float momentum = 0.0f;          // velocity decay, Adam's beta1
+    float beta2 = 0.0f;
+    float epsilon = 0.0f;
+    float firstCorrection = 1.0f;   // Adam's bias corrections, 1 / (1 - beta^t) at step t
+    float secondCorrection = 1.0f;
+};
+
+// Vector kernels for the layer hot loops. One table exists per instruction set,
+// each compiled in its own translation unit with matching compiler flags.
+struct hhKernels
+{
+    hhSimdLevel level;
+    const char* name;
+
+    // sum of a[i] * b[i]
+    float (*dot)(const float* a, const float* b, int n);
+
+    // y[r] = dot(w + r * stride, x) for r in [0, rows)
+    void (*gemv)(const float* w, int stride, const float* x, float* y, int rows, int cols);
+
+    // y[i] += a * x[i]
+    void (*axpy)(float a, const float* x, float* y, int n);
+
+    // y[i] += b[i]
+    void (*biasAdd)(float* y, const float* b, int n);
+
+    // gemm register tile, c[mr x nr] += a * b over kc steps.
+    // a is packed as kc groups of mr values, b as kc groups of nr values on a 64-byte boundary.
+    int gemmMr;
+    int gemmNr;
+    void (*gemmMicro)(int kc, const float* a, const float* b, float* c, int ldc);
+
+    // polynomial approximations, error bounds are in kernels_exp.h. y may alias x.
+    void (*fastExp)(const float* x, float* y, int n);
+    void (*fastSigmoid)(const float* x, float* y, int n);
+
+    // y = exp(x - max(x)) / sum, safe for any input range
+    void (*fastSoftmax)(const float* x, float* y, int n);
+
+    // y[b * ldy + r] = sum over i of x[b * ldx + i] * w[r * ldw + i], for batch samples and rows outputs.
+    // int8 values in [-127, 127], accumulated in int32.
+    void (*gemmInt8)(int batch, int rows, int cols, const int8_t* x, int ldx, const int8_t* w, int ldw, int32_t* y, int ldy);
+
+    // q[i] = x[i] * inverseScale rounded to nearest and clamped to [-127, 127]
+    void (*quantizeInt8)(const float* x, int8_t* q, float inverseScale, int n);
+
+    // 16-bit float storage. half is IEEE binary16, bfloat16 the upper half of a float32. narrowing rounds to
+    // nearest even, overflows to infinity and keeps NaNs quiet; bfloat16 also flushes denormals to signed zero.
+    void (*floatToHalf)(const float* x, uint16_t* y, int n);
+    void (*halfToFloat)(const uint16_t* x, float* y, int n);
+    void (*floatToBfloat16)(const float* x, uint16_t* y, int n);
+    void (*bfloat16ToFloat)(const uint16_t* x, float* y, int n);
+
+    // gemv with w stored as half or bfloat16, widened in registers as it streams
+    void (*gemvHalf)(const uint16_t* w, int stride, const float* x, float* y, int rows, int cols);
+    void (*gemvBfloat16)(const uint16_t* w, int stride, const float* x, float* y, int rows, int cols);
+
+    // backward pass and update of a dense block in one sweep over w. with e(b, r) = errors[b * lde + r]
+    // and w as it was on entry, for batch samples, rows outputs and cols inputs:
+    //   propagated[b * ldp + i] += sum over r of e(b, r) * w[r * ldw + i], skipped when propagated is null
+    //   w[r * ldw + i] -= rate * sum over b of e(b, r) * inputs[b * ldi + i]
+    void (*denseBackward)(int rows, int cols, int batch, const float* errors, int lde, const float* inputs, int ldi,
+        float* propagated, int ldp, float* w, int ldw, float rate);
+
+    // optimizer steps over n parameters, with g = scale * g + decay * w:
+    //   momentum  v = momentum * v + g, then w -= rate * v, or rate * (g + momentum * v) for Nesterov
+    //   adam      m = beta1 * m + (1 - beta1) * g, v = beta2 * v + (1 - beta2) * g * g, then
+    //             w -= rate * (m * firstCorrection / (sqrt(v * secondCorrection) + epsilon) + decoupledDecay * w)
+    void (*momentumUpdate)(const hhUpdateStep& step, float* w, const float* g, float* v, int n);
+    void (*adamUpdate)(const hhUpdateStep& step, float* w, const float* g, float* m, float* v, int n);
+
+    // y[i] = x[i] * 255 truncated, clamped to [0, 255] and 0 for NaN. colours in [0, 1] to display bytes.
+    void (*floatToBytes)(const float* x, uint8_t* y, int n);
+};
+
+// best instruction set this CPU and OS support
+hhSimdLevel detectSimdLevel();
+
+// kernel table for a level, nullptr when it was not compiled in or the CPU lacks it
+const hhKernels* kernelsFor(hhSimdLevel level);
+
+// kernels picked once on first use: the detected level, or HH_SIMD=scalar|sse2|avx2|avx512 to cap it
+const hhKernels& activeKernels();
+
+extern const hhKernels scalarKernels;
+#if HH_X86
+extern const hhKernels sse2Kernels;
+extern const hhKernels avx2Kernels;
+extern const hhKernels avx512Kernels;
+
+// AVX-512 VNNI with BW, used for gemmInt8 in the AVX-512 table when the CPU has it
+bool detectAvx512Vnni();
+void avx512VnniGemmInt8(int batch, int rows, int cols, const int8_t* x, int ldx, const int8_t* w, int ldw, int32_t* y, int ldy);
+
+// AVX-512 BF16, used for floatToBfloat16 in the AVX-512 table when the CPU has it
+bool detectAvx512Bf16();
+void avx512Bf16FromFloat(const float* x, uint16_t* y, int n);
+#endif
@@ -0,0 +1,727 @@
+#include "kernels.h"
+#include "kernels_exp.h"
+
+#if HH_X86
+
+#include <immintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#include "kernels_int8_avx2.h"
+
+static inline float hsum(__m256 v)
+{
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+    return _mm_cvtss_f32(lo);
+}
+
+static float avx2Dot(const float* a, const float* b, int n)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+    }
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    }
+
+    float sum = hsum(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static void avx2Gemv(const float* w, int stride, const float* x, float* y, int rows, int cols)
+{
+    // four rows at a time so each load of x feeds four FMAs
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const float* w0 = w + size_t(r) * stride;
+        const float* w1 = w0 + stride;
+        const float* w2 = w1 + stride;
+        const float* w3 = w2 + stride;
+
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 8 <= cols; i += 8)
+        {
+            const __m256 vx = _mm256_loadu_ps(x + i);
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w0 + i), vx, acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(w1 + i), vx, acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(w2 + i), vx, acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(w3 + i), vx, acc3);
+        }
+
+        float s0 = hsum(acc0), s1 = hsum(acc1), s2 = hsum(acc2), s3 = hsum(acc3);
+        for (; i < cols; i++)
+        {
+            s0 += w0[i] * x[i];
+            s1 += w1[i] * x[i];
+            s2 += w2[i] * x[i];
+            s3 += w3[i] * x[i];
+        }
+        y[r + 0] = s0;
+        y[r + 1] = s1;
+        y[r + 2] = s2;
+        y[r + 3] = s3;
+    }
+    for (; r < rows; r++)
+        y[r] = avx2Dot(w + size_t(r) * stride, x, cols);
+}
+
+static void avx2Axpy(float a, const float* x, float* y, int n)
+{
+    const __m256 va = _mm256_set1_ps(a);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    }
+    for (; i < n; i++)
+        y[i] += a * x[i];
+}
+
+static void avx2BiasAdd(float* y, const float* b, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_loadu_ps(b + i)));
+    }
+    for (; i < n; i++)
+        y[i] += b[i];
+}
+
+// 6x16 tile, twelve accumulators plus two b registers out of sixteen
+static void avx2GemmMicro(int kc, const float* a, const float* b, float* c, int ldc)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+    for (int p = 0; p < kc; p++)
+    {
+        const __m256 b0 = _mm256_load_ps(b);
+        const __m256 b1 = _mm256_load_ps(b + 8);
+        __m256 ai = _mm256_broadcast_ss(a + 0);
+        c00 = _mm256_fmadd_ps(ai, b0, c00);
+        c01 = _mm256_fmadd_ps(ai, b1, c01);
+        ai = _mm256_broadcast_ss(a + 1);
+        c10 = _mm256_fmadd_ps(ai, b0, c10);
+        c11 = _mm256_fmadd_ps(ai, b1, c11);
+        ai = _mm256_broadcast_ss(a + 2);
+        c20 = _mm256_fmadd_ps(ai, b0, c20);
+        c21 = _mm256_fmadd_ps(ai, b1, c21);
+        ai = _mm256_broadcast_ss(a + 3);
+        c30 = _mm256_fmadd_ps(ai, b0, c30);
+        c31 = _mm256_fmadd_ps(ai, b1, c31);
+        ai = _mm256_broadcast_ss(a + 4);
+        c40 = _mm256_fmadd_ps(ai, b0, c40);
+        c41 = _mm256_fmadd_ps(ai, b1, c41);
+        ai = _mm256_broadcast_ss(a + 5);
+        c50 = _mm256_fmadd_ps(ai, b0, c50);
+        c51 = _mm256_fmadd_ps(ai, b1, c51);
+        a += 6;
+        b += 16;
+    }
+
+    float* ci = c;
+    _mm256_storeu_ps(ci, _mm256_add_ps(_mm256_loadu_ps(ci), c00));
+    _mm256_storeu_ps(ci + 8, _mm256_add_ps(_mm256_loadu_ps(ci + 8), c01));
+    ci += ldc;
+    _mm256_storeu_ps(ci, _mm256_add_ps(_mm256_loadu_ps(ci), c10));
+    _mm256_storeu_ps(ci + 8, _mm256_add_ps(_mm256_loadu_ps(ci + 8), c11));
+    ci += ldc;
+    _mm256_storeu_ps(ci, _mm256_add_ps(_mm256_loadu_ps(ci), c20));
+    _mm256_storeu_ps(ci + 8, _mm256_add_ps(_mm256_loadu_ps(ci + 8), c21));
+    ci += ldc;
+    _mm256_storeu_ps(ci, _mm256_add_ps(_mm256_loadu_ps(ci), c30));
+    _mm256_storeu_ps(ci + 8, _mm256_add_ps(_mm256_loadu_ps(ci + 8), c31));
+    ci += ldc;
+    _mm256_storeu_ps(ci, _mm256_add_ps(_mm256_loadu_ps(ci), c40));
+    _mm256_storeu_ps(ci + 8, _mm256_add_ps(_mm256_loadu_ps(ci + 8), c41));
+    ci += ldc;
+    _mm256_storeu_ps(ci, _mm256_add_ps(_mm256_loadu_ps(ci), c50));
+    _mm256_storeu_ps(ci + 8, _mm256_add_ps(_mm256_loadu_ps(ci + 8), c51));
+}
+
+static inline __m256 exp8(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(expLo)), _mm256_set1_ps(expHi));
+    const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(expLog2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(expLn2Hi), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(expLn2Lo), r);
+
+    __m256 p = _mm256_set1_ps(expP0);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(expP1));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(expP2));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(expP3));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(expP4));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(expP5));
+    const __m256 y = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+    const __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(e));
+}
+
+static inline __m256 sigmoid8(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    return _mm256_div_ps(one, _mm256_add_ps(one, exp8(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+}
+
+// runs op over x eight lanes at a time, the tail goes through a zero padded buffer
+template <typename Op>
+static void apply8(const float* x, float* y, int n, Op op)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(y + i, op(_mm256_loadu_ps(x + i)));
+    if (i < n)
+    {
+        float buf[8] = {};
+        std::memcpy(buf, x + i, (n - i) * sizeof(float));
+        _mm256_storeu_ps(buf, op(_mm256_loadu_ps(buf)));
+        std::memcpy(y + i, buf, (n - i) * sizeof(float));
+    }
+}
+
+static void avx2FastExp(const float* x, float* y, int n)
+{
+    apply8(x, y, n, exp8);
+}
+
+static void avx2FastSigmoid(const float* x, float* y, int n)
+{
+    apply8(x, y, n, sigmoid8);
+}
+
+static void avx2FastSoftmax(const float* x, float* y, int n)
+{
+    if (n <= 0)
+        return;
+
+    float highest = x[0];
+    int i = 0;
+    if (n >= 8)
+    {
+        __m256 vmax = _mm256_loadu_ps(x);
+        for (i = 8; i + 8 <= n; i += 8)
+            vmax = _mm256_max_ps(vmax, _mm256_loadu_ps(x + i));
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(vmax), _mm256_extractf128_ps(vmax, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_movehdup_ps(m));
+        highest = _mm_cvtss_f32(m);
+    }
+    for (; i < n; i++)
+        highest = highest > x[i] ? highest : x[i];
+
+    const __m256 vh = _mm256_set1_ps(highest);
+    __m256 vsum = _mm256_setzero_ps();
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        const __m256 e = exp8(_mm256_sub_ps(_mm256_loadu_ps(x + i), vh));
+        _mm256_storeu_ps(y + i, e);
+        vsum = _mm256_add_ps(vsum, e);
+    }
+    float sum = hsum(vsum);
+    if (i < n)
+    {
+        float buf[8] = {};
+        std::memcpy(buf, x + i, (n - i) * sizeof(float));
+        _mm256_storeu_ps(buf, exp8(_mm256_sub_ps(_mm256_loadu_ps(buf), vh)));
+        for (int j = 0; j < n - i; j++)
+        {
+            y[i + j] = buf[j];
+            sum += buf[j];
+        }
+    }
+
+    const __m256 scale = _mm256_set1_ps(1.0f / sum);
+    for (i = 0; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(_mm256_loadu_ps(y + i), scale));
+    for (; i < n; i++)
+        y[i] *= 1.0f / sum;
+}
+
+static void avx2QuantizeInt8(const float* x, int8_t* q, float inverseScale, int n)
+{
+    // clamping before the conversion keeps every value inside the saturating packs
+    const __m256 scale = _mm256_set1_ps(inverseScale);
+    const __m256 hi = _mm256_set1_ps(127.0f);
+    const __m256 lo = _mm256_set1_ps(-127.0f);
+
+    // the packs work per 128-bit lane, this puts the four byte groups back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v[4];
+        for (int j = 0; j < 4; j++)
+            v[j] = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(x + i + 8 * j), scale), lo), hi));
+        const __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(q + i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    for (; i < n; i++)
+        q[i] = int8_t(std::nearbyint(std::min(127.0f, std::max(-127.0f, x[i] * inverseScale))));
+}
+
+static void avx2FloatToBytes(const float* x, uint8_t* y, int n)
+{
+    // max takes its second operand for NaN, so NaN lands on zero. clamped values pass the packs unchanged.
+    const __m256 scale = _mm256_set1_ps(255.0f);
+    const __m256 zero = _mm256_setzero_ps();
+
+    // the packs work per 128-bit lane, this puts the four byte groups back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v[4];
+        for (int j = 0; j < 4; j++)
+            v[j] = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(x + i + 8 * j), scale), zero), scale));
+        const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    for (; i < n; i++)
+    {
+        const float v = x[i] * 255.0f;
+        y[i] = uint8_t(v > 0.0f ? (v < 255.0f ? v : 255.0f) : 0.0f);
+    }
+}
+
+// ---------------------------- 16-bit floats ----------------------------
+
+static void avx2FloatToHalf(const float* x, uint16_t* y, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    if (i < n)
+    {
+        float buf[8] = {};
+        uint16_t out[8];
+        std::memcpy(buf, x + i, (n - i) * sizeof(float));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_cvtps_ph(_mm256_loadu_ps(buf), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        std::memcpy(y + i, out, (n - i) * sizeof(uint16_t));
+    }
+}
+
+static void avx2HalfToFloat(const uint16_t* x, float* y, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(y + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))));
+    if (i < n)
+    {
+        uint16_t buf[8] = {};
+        float out[8];
+        std::memcpy(buf, x + i, (n - i) * sizeof(uint16_t));
+        _mm256_storeu_ps(out, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf))));
+        std::memcpy(y + i, out, (n - i) * sizeof(float));
+    }
+}
+
+// round to nearest even on the dropped half, NaNs kept quiet and denormals flushed like the scalar version
+static inline __m256i bfloat16x8(__m256 x)
+{
+    const __m256i bits = _mm256_castps_si256(x);
+    const __m256i magnitude = _mm256_and_si256(bits, _mm256_set1_epi32(0x7fffffff));
+    const __m256i upper = _mm256_srli_epi32(bits, 16);
+    const __m256i odd = _mm256_and_si256(upper, _mm256_set1_epi32(1));
+    __m256i result = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(bits, _mm256_set1_epi32(0x7fff)), odd), 16);
+
+    const __m256i nan = _mm256_cmpgt_epi32(magnitude, _mm256_set1_epi32(0x7f800000));
+    result = _mm256_blendv_epi8(result, _mm256_or_si256(upper, _mm256_set1_epi32(0x40)), nan);
+    const __m256i denormal = _mm256_cmpgt_epi32(_mm256_set1_epi32(0x00800000), magnitude);
+    return _mm256_blendv_epi8(result, _mm256_and_si256(upper, _mm256_set1_epi32(0x8000)), denormal);
+}
+
+static void avx2FloatToBfloat16(const float* x, uint16_t* y, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        // packus works per 128-bit lane, the permute puts the two halves back in order
+        const __m256i packed = _mm256_packus_epi32(bfloat16x8(_mm256_loadu_ps(x + i)), bfloat16x8(_mm256_loadu_ps(x + i + 8)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    if (i < n)
+    {
+        float buf[16] = {};
+        uint16_t out[16];
+        std::memcpy(buf, x + i, (n - i) * sizeof(float));
+        const __m256i packed = _mm256_packus_epi32(bfloat16x8(_mm256_loadu_ps(buf)), bfloat16x8(_mm256_loadu_ps(buf + 8)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+        std::memcpy(y + i, out, (n - i) * sizeof(uint16_t));
+    }
+}
+
+static void avx2Bfloat16ToFloat(const uint16_t* x, float* y, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), _mm256_slli_epi32(wide, 16));
+    }
+    for (; i < n; i++)
+    {
+        const uint32_t bits = uint32_t(x[i]) << 16;
+        std::memcpy(&y[i], &bits, sizeof(bits));
+    }
+}
+
+static inline __m256 widenHalf8(const uint16_t* w)
+{
+    return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w)));
+}
+
+static inline __m256 widenBfloat8(const uint16_t* w)
+{
+    const __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w)));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16));
+}
+
+static inline float widenHalf1(uint16_t h)
+{
+    return _mm_cvtss_f32(_mm_cvtph_ps(_mm_cvtsi32_si128(h)));
+}
+
+static inline float widenBfloat1(uint16_t h)
+{
+    const uint32_t bits = uint32_t(h) << 16;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// same shape as avx2Gemv, the weights cost one conversion per eight lanes on top of the FMA
+template <__m256 (*widen8)(const uint16_t*), float (*widen1)(uint16_t)>
+static void gemv16(const uint16_t* w, int stride, const float* x, float* y, int rows, int cols)
+{
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const uint16_t* w0 = w + size_t(r) * stride;
+        const uint16_t* w1 = w0 + stride;
+        const uint16_t* w2 = w1 + stride;
+        const uint16_t* w3 = w2 + stride;
+
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 8 <= cols; i += 8)
+        {
+            const __m256 vx = _mm256_loadu_ps(x + i);
+            acc0 = _mm256_fmadd_ps(widen8(w0 + i), vx, acc0);
+            acc1 = _mm256_fmadd_ps(widen8(w1 + i), vx, acc1);
+            acc2 = _mm256_fmadd_ps(widen8(w2 + i), vx, acc2);
+            acc3 = _mm256_fmadd_ps(widen8(w3 + i), vx, acc3);
+        }
+
+        float s0 = hsum(acc0), s1 = hsum(acc1), s2 = hsum(acc2), s3 = hsum(acc3);
+        for (; i < cols; i++)
+        {
+            s0 += widen1(w0[i]) * x[i];
+            s1 += widen1(w1[i]) * x[i];
+            s2 += widen1(w2[i]) * x[i];
+            s3 += widen1(w3[i]) * x[i];
+        }
+        y[r + 0] = s0;
+        y[r + 1] = s1;
+        y[r + 2] = s2;
+        y[r + 3] = s3;
+    }
+    for (; r < rows; r++)
+    {
+        const uint16_t* row = w + size_t(r) * stride;
+        __m256 acc = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 8 <= cols; i += 8)
+            acc = _mm256_fmadd_ps(widen8(row + i), _mm256_loadu_ps(x + i), acc);
+        float sum = hsum(acc);
+        for (; i < cols; i++)
+            sum += widen1(row[i]) * x[i];
+        y[r] = sum;
+    }
+}
+
+// the denseBackward tiles keep the gradients of a block in registers while every sample of the batch passes over
+// it, then write the block of w once. each runs the whole blocks of a row group and returns where it stopped.
+
+// single rows and the columns the tiles leave, 8 at a time then scalar. propagated may be null.
+static void backwardTile1(int cols, int batch, const float* errors, int lde, const float* inputs, int ldi,
+    float* propagated, int ldp, float* w, float rate)
+{
+    const __m256 vrate = _mm256_set1_ps(rate);
+    int i = 0;
+    for (; i + 8 <= cols; i += 8)
+    {
+        const __m256 old = _mm256_loadu_ps(w + i);
+        __m256 g = _mm256_setzero_ps();
+        for (int b = 0; b < batch; b++)
+        {
+            const __m256 ve = _mm256_set1_ps(errors[size_t(b) * lde]);
+            g = _mm256_fmadd_ps(ve, _mm256_loadu_ps(inputs + size_t(b) * ldi + i), g);
+            if (propagated != nullptr)
+            {
+                float* p = propagated + size_t(b) * ldp + i;
+                _mm256_storeu_ps(p, _mm256_fmadd_ps(ve, old, _mm256_loadu_ps(p)));
+            }
+        }
+        _mm256_storeu_ps(w + i, _mm256_fnmadd_ps(vrate, g, old));
+    }
+    for (; i < cols; i++)
+    {
+        const float old = w[i];
+        float gradient = 0.0f;
+        for (int b = 0; b < batch; b++)
+        {
+            const float e = errors[size_t(b) * lde];
+            gradient += e * inputs[size_t(b) * ldi + i];
+            if (propagated != nullptr)
+                propagated[size_t(b) * ldp + i] += e * old;
+        }
+        w[i] = old - rate * gradient;
+    }
+}
+
+// w[0, 16) -= rate * g
+static inline void updateRow(float* w, __m256 rate, __m256 g0, __m256 g1)
+{
+    _mm256_storeu_ps(w, _mm256_fnmadd_ps(rate, g0, _mm256_loadu_ps(w)));
+    _mm256_storeu_ps(w + 8, _mm256_fnmadd_ps(rate, g1, _mm256_loadu_ps(w + 8)));
+}
+
+// 6 x 16 update without propagation, the gemm tile shape
+static int updateTile6(int cols, int batch, const float* errors, int lde, const float* inputs, int ldi, float* w, int ldw, float rate)
+{
+    const __m256 vrate = _mm256_set1_ps(rate);
+    int i = 0;
+    for (; i + 16 <= cols; i += 16)
+    {
+        __m256 g00 = _mm256_setzero_ps(), g01 = _mm256_setzero_ps();
+        __m256 g10 = _mm256_setzero_ps(), g11 = _mm256_setzero_ps();
+        __m256 g20 = _mm256_setzero_ps(), g21 = _mm256_setzero_ps();
+        __m256 g30 = _mm256_setzero_ps(), g31 = _mm256_setzero_ps();
+        __m256 g40 = _mm256_setzero_ps(), g41 = _mm256_setzero_ps();
+        __m256 g50 = _mm256_setzero_ps(), g51 = _mm256_setzero_ps();
+
+        for (int b = 0; b < batch; b++)
+        {
+            const float* e = errors + size_t(b) * lde;
+            const float* x = inputs + size_t(b) * ldi + i;
+            const __m256 x0 = _mm256_loadu_ps(x);
+            const __m256 x1 = _mm256_loadu_ps(x + 8);
+            __m256 ve;
+            ve = _mm256_set1_ps(e[0]);
+            g00 = _mm256_fmadd_ps(ve, x0, g00);
+            g01 = _mm256_fmadd_ps(ve, x1, g01);
+            ve = _mm256_set1_ps(e[1]);
+            g10 = _mm256_fmadd_ps(ve, x0, g10);
+            g11 = _mm256_fmadd_ps(ve, x1, g11);
+            ve = _mm256_set1_ps(e[2]);
+            g20 = _mm256_fmadd_ps(ve, x0, g20);
+            g21 = _mm256_fmadd_ps(ve, x1, g21);
+            ve = _mm256_set1_ps(e[3]);
+            g30 = _mm256_fmadd_ps(ve, x0, g30);
+            g31 = _mm256_fmadd_ps(ve, x1, g31);
+            ve = _mm256_set1_ps(e[4]);
+            g40 = _mm256_fmadd_ps(ve, x0, g40);
+            g41 = _mm256_fmadd_ps(ve, x1, g41);
+            ve = _mm256_set1_ps(e[5]);
+            g50 = _mm256_fmadd_ps(ve, x0, g50);
+            g51 = _mm256_fmadd_ps(ve, x1, g51);
+        }
+
+        float* out = w + i;
+        updateRow(out, vrate, g00, g01);
+        updateRow(out += ldw, vrate, g10, g11);
+        updateRow(out += ldw, vrate, g20, g21);
+        updateRow(out += ldw, vrate, g30, g31);
+        updateRow(out += ldw, vrate, g40, g41);
+        updateRow(out += ldw, vrate, g50, g51);
+    }
+    return i;
+}
+
+// 4 x 8 with propagation, the old weights stay in registers beside the gradients
+static int backwardTile4(int cols, int batch, const float* errors, int lde, const float* inputs, int ldi,
+    float* propagated, int ldp, float* w, int ldw, float rate)
+{
+    const __m256 vrate = _mm256_set1_ps(rate);
+    float* w0 = w;
+    float* w1 = w0 + ldw;
+    float* w2 = w1 + ldw;
+    float* w3 = w2 + ldw;
+    int i = 0;
+    for (; i + 8 <= cols; i += 8)
+    {
+        const __m256 v0 = _mm256_loadu_ps(w0 + i);
+        const __m256 v1 = _mm256_loadu_ps(w1 + i);
+        const __m256 v2 = _mm256_loadu_ps(w2 + i);
+        const __m256 v3 = _mm256_loadu_ps(w3 + i);
+        __m256 g0 = _mm256_setzero_ps();
+        __m256 g1 = _mm256_setzero_ps();
+        __m256 g2 = _mm256_setzero_ps();
+        __m256 g3 = _mm256_setzero_ps();
+
+        for (int b = 0; b < batch; b++)
+        {
+            const float* e = errors + size_t(b) * lde;
+            const __m256 x = _mm256_loadu_ps(inputs + size_t(b) * ldi + i);
+            float* p = propagated + size_t(b) * ldp + i;
+            __m256 acc = _mm256_loadu_ps(p);
+            __m256 ve;
+            ve = _mm256_set1_ps(e[0]);
+            g0 = _mm256_fmadd_ps(ve, x, g0);
+            acc = _mm256_fmadd_ps(ve, v0, acc);
+            ve = _mm256_set1_ps(e[1]);
+            g1 = _mm256_fmadd_ps(ve, x, g1);
+            acc = _mm256_fmadd_ps(ve, v1, acc);
+            ve = _mm256_set1_ps(e[2]);
+            g2 = _mm256_fmadd_ps(ve, x, g2);
+            acc = _mm256_fmadd_ps(ve, v2, acc);
+            ve = _mm256_set1_ps(e[3]);
+            g3 = _mm256_fmadd_ps(ve, x, g3);
+            acc = _mm256_fmadd_ps(ve, v3, acc);
+            _mm256_storeu_ps(p, acc);
+        }
+
+        _mm256_storeu_ps(w0 + i, _mm256_fnmadd_ps(vrate, g0, v0));
+        _mm256_storeu_ps(w1 + i, _mm256_fnmadd_ps(vrate, g1, v1));
+        _mm256_storeu_ps(w2 + i, _mm256_fnmadd_ps(vrate, g2, v2));
+        _mm256_storeu_ps(w3 + i, _mm256_fnmadd_ps(vrate, g3, v3));
+    }
+    return i;
+}
+
+static void avx2DenseBackward(int rows, int cols, int batch, const float* errors, int lde, const float* inputs, int ldi,
+    float* propagated, int ldp, float* w, int ldw, float rate)
+{
+    const int group = propagated != nullptr ? 4 : 6;
+    int r = 0;
+    for (; r + group <= rows; r += group)
+    {
+        const int done = propagated != nullptr
+            ? backwardTile4(cols, batch, errors + r, lde, inputs, ldi, propagated, ldp, w + size_t(r) * ldw, ldw, rate)
+            : updateTile6(cols, batch, errors + r, lde, inputs, ldi, w + size_t(r) * ldw, ldw, rate);
+
+        for (int t = r; t < r + group && done < cols; t++)
+            backwardTile1(cols - done, batch, errors + t, lde, inputs + done, ldi,
+                propagated != nullptr ? propagated + done : nullptr, ldp, w + size_t(t) * ldw + done, rate);
+    }
+    for (; r < rows; r++)
+        backwardTile1(cols, batch, errors + r, lde, inputs, ldi, propagated, ldp, w + size_t(r) * ldw, rate);
+}
+
+static void avx2MomentumUpdate(const hhUpdateStep& step, float* w, const float* g, float* v, int n)
+{
+    const bool nesterov = step.type == hhOptimizerType::Nesterov;
+    const float gradientPart = nesterov ? 1.0f : 0.0f;
+    const float velocityPart = nesterov ? step.momentum : 1.0f;
+    const __m256 scale = _mm256_set1_ps(step.scale), decay = _mm256_set1_ps(step.decay), momentum = _mm256_set1_ps(step.momentum);
+    const __m256 gradientRate = _mm256_set1_ps(step.rate * gradientPart), velocityRate = _mm256_set1_ps(step.rate * velocityPart);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256 wi = _mm256_loadu_ps(w + i);
+        const __m256 gradient = _mm256_fmadd_ps(scale, _mm256_loadu_ps(g + i), _mm256_mul_ps(decay, wi));
+        const __m256 velocity = _mm256_fmadd_ps(momentum, _mm256_loadu_ps(v + i), gradient);
+        _mm256_storeu_ps(v + i, velocity);
+        const __m256 delta = _mm256_fmadd_ps(gradientRate, gradient, _mm256_mul_ps(velocityRate, velocity));
+        _mm256_storeu_ps(w + i, _mm256_sub_ps(wi, delta));
+    }
+    for (; i < n; i++)
+    {
+        const float gradient = step.scale * g[i] + step.decay * w[i];
+        const float velocity = step.momentum * v[i] + gradient;
+        v[i] = velocity;
+        w[i] -= step.rate * (gradientPart * gradient + velocityPart * velocity);
+    }
+}
+
+static void avx2AdamUpdate(const hhUpdateStep& step, float* w, const float* g, float* m, float* v, int n)
+{
+    const __m256 scale = _mm256_set1_ps(step.scale), decay = _mm256_set1_ps(step.decay);
+    const __m256 beta1 = _mm256_set1_ps(step.momentum), keep1 = _mm256_set1_ps(1.0f - step.momentum);
+    const __m256 beta2 = _mm256_set1_ps(step.beta2), keep2 = _mm256_set1_ps(1.0f - step.beta2);
+    const __m256 first = _mm256_set1_ps(step.rate * step.firstCorrection), second = _mm256_set1_ps(step.secondCorrection);
+    const __m256 epsilon = _mm256_set1_ps(step.epsilon), shrink = _mm256_set1_ps(step.rate * step.decoupledDecay);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256 wi = _mm256_loadu_ps(w + i);
+        const __m256 gradient = _mm256_fmadd_ps(scale, _mm256_loadu_ps(g + i), _mm256_mul_ps(decay, wi));
+        const __m256 mean = _mm256_fmadd_ps(beta1, _mm256_loadu_ps(m + i), _mm256_mul_ps(keep1, gradient));
+        const __m256 square = _mm256_fmadd_ps(beta2, _mm256_loadu_ps(v + i), _mm256_mul_ps(keep2, _mm256_mul_ps(gradient, gradient)));
+        _mm256_storeu_ps(m + i, mean);
+        _mm256_storeu_ps(v + i, square);
+        const __m256 denominator = _mm256_add_ps(_mm256_sqrt_ps(_mm256_mul_ps(square, second)), epsilon);
+        const __m256 delta = _mm256_fmadd_ps(shrink, wi, _mm256_div_ps(_mm256_mul_ps(first, mean), denominator));
+        _mm256_storeu_ps(w + i, _mm256_sub_ps(wi, delta));
+    }
+    for (; i < n; i++)
+    {
+        const float gradient = step.scale * g[i] + step.decay * w[i];
+        const float mean = step.momentum * m[i] + (1.0f - step.momentum) * gradient;
+        const float square = step.beta2 * v[i] + (1.0f - step.beta2) * gradient * gradient;
+        m[i] = mean;
+        v[i] = square;
+        const float adaptive = mean * step.firstCorrection / (std::sqrt(square * step.secondCorrection) + step.epsilon);
+        w[i] -= step.rate * (adaptive + step.decoupledDecay * w[i]);
+    }
+}
+
+const hhKernels avx2Kernels =
+{
+    hhSimdLevel::AVX2,
+    "avx2",
+    avx2Dot,
+    avx2Gemv,
+    avx2Axpy,
+    avx2BiasAdd,
+    6,
+    16,
+    avx2GemmMicro,
+    avx2FastExp,
+    avx2FastSigmoid,
+    avx2FastSoftmax,
+    gemmInt8Avx2,
+    avx2QuantizeInt8,
+    avx2FloatToHalf,
+    avx2HalfToFloat,
+    avx2FloatToBfloat16,
+    avx2Bfloat16ToFloat,
+    gemv16<widenHalf8, widenHalf1>,
+    gemv16<widenBfloat8, widenBfloat1>,
+    avx2DenseBackward,
+    avx2MomentumUpdate,
+    avx2AdamUpdate,
+    avx2FloatToBytes,
+};
+
+#endif
@@ -0,0 +1,639 @@
+#include "kernels.h"
+#include "kernels_exp.h"
+
+#if HH_X86
+
+#include <immintrin.h>
+#include <cstddef>
+#include <cstring>
+
+#include "kernels_int8_avx2.h"
+
+// lanes [0, n) set, for masked tails
+static inline __mmask16 tailMask(int n)
+{
+    return static_cast<__mmask16>((1u << n) - 1);
+}
+
+static float avx512Dot(const float* a, const float* b, int n)
+{
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+    }
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    }
+    if (i < n)
+    {
+        const __mmask16 m = tailMask(n - i);
+        acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+static void avx512Gemv(const float* w, int stride, const float* x, float* y, int rows, int cols)
+{
+    // four rows at a time so each load of x feeds four FMAs
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const float* w0 = w + size_t(r) * stride;
+        const float* w1 = w0 + stride;
+        const float* w2 = w1 + stride;
+        const float* w3 = w2 + stride;
+
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+        for (int i = 0; i < cols; i += 16)
+        {
+            const __mmask16 m = cols - i >= 16 ? __mmask16(0xffff) : tailMask(cols - i);
+            const __m512 vx = _mm512_maskz_loadu_ps(m, x + i);
+            acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, w0 + i), vx, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, w1 + i), vx, acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, w2 + i), vx, acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, w3 + i), vx, acc3);
+        }
+        y[r + 0] = _mm512_reduce_add_ps(acc0);
+        y[r + 1] = _mm512_reduce_add_ps(acc1);
+        y[r + 2] = _mm512_reduce_add_ps(acc2);
+        y[r + 3] = _mm512_reduce_add_ps(acc3);
+    }
+    for (; r < rows; r++)
+        y[r] = avx512Dot(w + size_t(r) * stride, x, cols);
+}
+
+static void avx512Axpy(float a, const float* x, float* y, int n)
+{
+    const __m512 va = _mm512_set1_ps(a);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+    }
+    if (i < n)
+    {
+        const __mmask16 m = tailMask(n - i);
+        const __m512 r = _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, y + i));
+        _mm512_mask_storeu_ps(y + i, m, r);
+    }
+}
+
+static void avx512BiasAdd(float* y, const float* b, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(y + i, _mm512_add_ps(_mm512_loadu_ps(y + i), _mm512_loadu_ps(b + i)));
+    }
+    if (i < n)
+    {
+        const __mmask16 m = tailMask(n - i);
+        _mm512_mask_storeu_ps(y + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, y + i), _mm512_maskz_loadu_ps(m, b + i)));
+    }
+}
+
+// 8x32 tile, sixteen accumulators plus two b registers out of thirty-two
+static void avx512GemmMicro(int kc, const float* a, const float* b, float* c, int ldc)
+{
+    __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+    __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+    __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+    __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+    __m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps();
+    __m512 c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+    __m512 c60 = _mm512_setzero_ps(), c61 = _mm512_setzero_ps();
+    __m512 c70 = _mm512_setzero_ps(), c71 = _mm512_setzero_ps();
+
+    for (int p = 0; p < kc; p++)
+    {
+        const __m512 b0 = _mm512_load_ps(b);
+        const __m512 b1 = _mm512_load_ps(b + 16);
+        __m512 ai;
+        ai = _mm512_set1_ps(a[0]);
+        c00 = _mm512_fmadd_ps(ai, b0, c00);
+        c01 = _mm512_fmadd_ps(ai, b1, c01);
+        ai = _mm512_set1_ps(a[1]);
+        c10 = _mm512_fmadd_ps(ai, b0, c10);
+        c11 = _mm512_fmadd_ps(ai, b1, c11);
+        ai = _mm512_set1_ps(a[2]);
+        c20 = _mm512_fmadd_ps(ai, b0, c20);
+        c21 = _mm512_fmadd_ps(ai, b1, c21);
+        ai = _mm512_set1_ps(a[3]);
+        c30 = _mm512_fmadd_ps(ai, b0, c30);
+        c31 = _mm512_fmadd_ps(ai, b1, c31);
+        ai = _mm512_set1_ps(a[4]);
+        c40 = _mm512_fmadd_ps(ai, b0, c40);
+        c41 = _mm512_fmadd_ps(ai, b1, c41);
+        ai = _mm512_set1_ps(a[5]);
+        c50 = _mm512_fmadd_ps(ai, b0, c50);
+        c51 = _mm512_fmadd_ps(ai, b1, c51);
+        ai = _mm512_set1_ps(a[6]);
+        c60 = _mm512_fmadd_ps(ai, b0, c60);
+        c61 = _mm512_fmadd_ps(ai, b1, c61);
+        ai = _mm512_set1_ps(a[7]);
+        c70 = _mm512_fmadd_ps(ai, b0, c70);
+        c71 = _mm512_fmadd_ps(ai, b1, c71);
+        a += 8;
+        b += 32;
+    }
+
+    float* ci = c;
+    _mm512_storeu_ps(ci, _mm512_add_ps(_mm512_loadu_ps(ci), c00));
+    _mm512_storeu_ps(ci + 16, _mm512_add_ps(_mm512_loadu_ps(ci + 16), c01));
+    ci += ldc;
+    _mm512_storeu_ps(ci, _mm512_add_ps(_mm512_loadu_ps(ci), c10));
+    _mm512_storeu_ps(ci + 16, _mm512_add_ps(_mm512_loadu_ps(ci + 16), c11));
+    ci += ldc;
+    _mm512_storeu_ps(ci, _mm512_add_ps(_mm512_loadu_ps(ci), c20));
+    _mm512_storeu_ps(ci + 16, _mm512_add_ps(_mm512_loadu_ps(ci + 16), c21));
+    ci += ldc;
+    _mm512_storeu_ps(ci, _mm512_add_ps(_mm512_loadu_ps(ci), c30));
+    _mm512_storeu_ps(ci + 16, _mm512_add_ps(_mm512_loadu_ps(ci + 16), c31));
+    ci += ldc;
+    _mm512_storeu_ps(ci, _mm512_add_ps(_mm512_loadu_ps(ci), c40));
+    _mm512_storeu_ps(ci + 16, _mm512_add_ps(_mm512_loadu_ps(ci + 16), c41));
+    ci += ldc;
+    _mm512_storeu_ps(ci, _mm512_add_ps(_mm512_loadu_ps(ci), c50));
+    _mm512_storeu_ps(ci + 16, _mm512_add_ps(_mm512_loadu_ps(ci + 16), c51));
+    ci += ldc;
+    _mm512_storeu_ps(ci, _mm512_add_ps(_mm512_loadu_ps(ci), c60));
+    _mm512_storeu_ps(ci + 16, _mm512_add_ps(_mm512_loadu_ps(ci + 16), c61));
+    ci += ldc;
+    _mm512_storeu_ps(ci, _mm512_add_ps(_mm512_loadu_ps(ci), c70));
+    _mm512_storeu_ps(ci + 16, _mm512_add_ps(_mm512_loadu_ps(ci + 16), c71));
+}
+
+static inline __m512 exp16(__m512 x)
+{
+    x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(expLo)), _mm512_set1_ps(expHi));
+    const __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(expLog2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(expLn2Hi), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(expLn2Lo), r);
+
+    __m512 p = _mm512_set1_ps(expP0);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(expP1));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(expP2));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(expP3));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(expP4));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(expP5));
+    const __m512 y = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+
+    const __m512i e = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127)), 23);
+    return _mm512_mul_ps(y, _mm512_castsi512_ps(e));
+}
+
+static inline __m512 sigmoid16(__m512 x)
+{
+    const __m512 one = _mm512_set1_ps(1.0f);
+    return _mm512_div_ps(one, _mm512_add_ps(one, exp16(_mm512_sub_ps(_mm512_setzero_ps(), x))));
+}
+
+static void avx512FastExp(const float* x, float* y, int n)
+{
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        _mm512_mask_storeu_ps(y + i, m, exp16(_mm512_maskz_loadu_ps(m, x + i)));
+    }
+}
+
+static void avx512FastSigmoid(const float* x, float* y, int n)
+{
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        _mm512_mask_storeu_ps(y + i, m, sigmoid16(_mm512_maskz_loadu_ps(m, x + i)));
+    }
+}
+
+static void avx512FastSoftmax(const float* x, float* y, int n)
+{
+    if (n <= 0)
+        return;
+
+    __m512 vmax = _mm512_set1_ps(x[0]);
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        vmax = _mm512_mask_max_ps(vmax, m, vmax, _mm512_maskz_loadu_ps(m, x + i));
+    }
+    const __m512 vh = _mm512_set1_ps(_mm512_reduce_max_ps(vmax));
+
+    __m512 vsum = _mm512_setzero_ps();
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        const __m512 e = exp16(_mm512_sub_ps(_mm512_maskz_loadu_ps(m, x + i), vh));
+        _mm512_mask_storeu_ps(y + i, m, e);
+        vsum = _mm512_mask_add_ps(vsum, m, vsum, e);
+    }
+
+    const __m512 scale = _mm512_set1_ps(1.0f / _mm512_reduce_add_ps(vsum));
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        _mm512_mask_storeu_ps(y + i, m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, y + i), scale));
+    }
+}
+
+static void avx512QuantizeInt8(const float* x, int8_t* q, float inverseScale, int n)
+{
+    const __m512 scale = _mm512_set1_ps(inverseScale);
+    const __m512 hi = _mm512_set1_ps(127.0f);
+    const __m512 lo = _mm512_set1_ps(-127.0f);
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        const __m512 v = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_maskz_loadu_ps(m, x + i), scale), lo), hi);
+        _mm512_mask_cvtepi32_storeu_epi8(q + i, m, _mm512_cvtps_epi32(v));
+    }
+}
+
+static void avx512FloatToBytes(const float* x, uint8_t* y, int n)
+{
+    // max takes its second operand for NaN, so NaN lands on zero
+    const __m512 scale = _mm512_set1_ps(255.0f);
+    const __m512 zero = _mm512_setzero_ps();
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        const __m512 v = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_maskz_loadu_ps(m, x + i), scale), zero), scale);
+        _mm512_mask_cvtepi32_storeu_epi8(y + i, m, _mm512_cvttps_epi32(v));
+    }
+}
+
+// ---------------------------- 16-bit floats ----------------------------
+
+// 16-bit tails go through a buffer, masked word loads would need AVX-512BW
+static inline __m256i loadWords(const uint16_t* x, int count)
+{
+    if (count >= 16)
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x));
+    uint16_t buf[16] = {};
+    std::memcpy(buf, x, count * sizeof(uint16_t));
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf));
+}
+
+static void avx512FloatToHalf(const float* x, uint16_t* y, int n)
+{
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        const __m256i half = _mm512_cvtps_ph(_mm512_maskz_loadu_ps(m, x + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm512_mask_cvtepi32_storeu_epi16(y + i, m, _mm512_cvtepu16_epi32(half));
+    }
+}
+
+static void avx512HalfToFloat(const uint16_t* x, float* y, int n)
+{
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        _mm512_mask_storeu_ps(y + i, m, _mm512_cvtph_ps(loadWords(x + i, n - i)));
+    }
+}
+
+// round to nearest even on the dropped half, NaNs kept quiet and denormals flushed like the scalar version
+static void avx512FloatToBfloat16(const float* x, uint16_t* y, int n)
+{
+    const __m512i absMask = _mm512_set1_epi32(0x7fffffff);
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        const __m512i bits = _mm512_castps_si512(_mm512_maskz_loadu_ps(m, x + i));
+        const __m512i magnitude = _mm512_and_si512(bits, absMask);
+        const __m512i upper = _mm512_srli_epi32(bits, 16);
+        const __m512i odd = _mm512_and_si512(upper, _mm512_set1_epi32(1));
+        __m512i result = _mm512_srli_epi32(_mm512_add_epi32(_mm512_add_epi32(bits, _mm512_set1_epi32(0x7fff)), odd), 16);
+
+        const __mmask16 nan = _mm512_cmpgt_epi32_mask(magnitude, _mm512_set1_epi32(0x7f800000));
+        result = _mm512_mask_or_epi32(result, nan, upper, _mm512_set1_epi32(0x40));
+        const __mmask16 denormal = _mm512_cmplt_epi32_mask(magnitude, _mm512_set1_epi32(0x00800000));
+        result = _mm512_mask_and_epi32(result, denormal, upper, _mm512_set1_epi32(0x8000));
+        _mm512_mask_cvtepi32_storeu_epi16(y + i, m, result);
+    }
+}
+
+static void avx512Bfloat16ToFloat(const uint16_t* x, float* y, int n)
+{
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 m = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        const __m512i wide = _mm512_cvtepu16_epi32(loadWords(x + i, n - i));
+        _mm512_mask_storeu_ps(y + i, m, _mm512_castsi512_ps(_mm512_slli_epi32(wide, 16)));
+    }
+}
+
+static inline __m512 widenHalf16(__m256i words)
+{
+    return _mm512_cvtph_ps(words);
+}
+
+static inline __m512 widenBfloat16(__m256i words)
+{
+    return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(words), 16));
+}
+
+// same shape as avx512Gemv, the weights cost one conversion per sixteen lanes on top of the FMA
+template <__m512 (*widen16)(__m256i)>
+static void gemv16(const uint16_t* w, int stride, const float* x, float* y, int rows, int cols)
+{
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const uint16_t* w0 = w + size_t(r) * stride;
+        const uint16_t* w1 = w0 + stride;
+        const uint16_t* w2 = w1 + stride;
+        const uint16_t* w3 = w2 + stride;
+
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+        for (int i = 0; i < cols; i += 16)
+        {
+            const __mmask16 m = cols - i >= 16 ? __mmask16(0xffff) : tailMask(cols - i);
+            const __m512 vx = _mm512_maskz_loadu_ps(m, x + i);
+            acc0 = _mm512_fmadd_ps(widen16(loadWords(w0 + i, cols - i)), vx, acc0);
+            acc1 = _mm512_fmadd_ps(widen16(loadWords(w1 + i, cols - i)), vx, acc1);
+            acc2 = _mm512_fmadd_ps(widen16(loadWords(w2 + i, cols - i)), vx, acc2);
+            acc3 = _mm512_fmadd_ps(widen16(loadWords(w3 + i, cols - i)), vx, acc3);
+        }
+        y[r + 0] = _mm512_reduce_add_ps(acc0);
+        y[r + 1] = _mm512_reduce_add_ps(acc1);
+        y[r + 2] = _mm512_reduce_add_ps(acc2);
+        y[r + 3] = _mm512_reduce_add_ps(acc3);
+    }
+    for (; r < rows; r++)
+    {
+        const uint16_t* row = w + size_t(r) * stride;
+        __m512 acc = _mm512_setzero_ps();
+        for (int i = 0; i < cols; i += 16)
+        {
+            const __mmask16 m = cols - i >= 16 ? __mmask16(0xffff) : tailMask(cols - i);
+            acc = _mm512_fmadd_ps(widen16(loadWords(row + i, cols - i)), _mm512_maskz_loadu_ps(m, x + i), acc);
+        }
+        y[r] = _mm512_reduce_add_ps(acc);
+    }
+}
+
+// the denseBackward tiles sweep columns 32 at a time, the last block masked. the gradients of a block stay in
+// registers while every sample of the batch passes over it, then the block of w is written once.
+
+// w[0, 32) -= rate * g, through the masks of the two halves
+static inline void updateRow(float* w, __mmask16 m0, __mmask16 m1, __m512 rate, __m512 g0, __m512 g1)
+{
+    _mm512_mask_storeu_ps(w, m0, _mm512_fnmadd_ps(rate, g0, _mm512_maskz_loadu_ps(m0, w)));
+    _mm512_mask_storeu_ps(w + 16, m1, _mm512_fnmadd_ps(rate, g1, _mm512_maskz_loadu_ps(m1, w + 16)));
+}
+
+// 8 x 32 update without propagation, the gemm tile shape
+static void updateTile8(int cols, int batch, const float* errors, int lde, const float* inputs, int ldi, float* w, int ldw, float rate)
+{
+    const __m512 vrate = _mm512_set1_ps(rate);
+    for (int i = 0; i < cols; i += 32)
+    {
+        const __mmask16 m0 = cols - i >= 16 ? __mmask16(0xffff) : tailMask(cols - i);
+        const __mmask16 m1 = cols - i >= 32 ? __mmask16(0xffff) : cols - i > 16 ? tailMask(cols - i - 16) : __mmask16(0);
+
+        __m512 g00 = _mm512_setzero_ps(), g01 = _mm512_setzero_ps();
+        __m512 g10 = _mm512_setzero_ps(), g11 = _mm512_setzero_ps();
+        __m512 g20 = _mm512_setzero_ps(), g21 = _mm512_setzero_ps();
+        __m512 g30 = _mm512_setzero_ps(), g31 = _mm512_setzero_ps();
+        __m512 g40 = _mm512_setzero_ps(), g41 = _mm512_setzero_ps();
+        __m512 g50 = _mm512_setzero_ps(), g51 = _mm512_setzero_ps();
+        __m512 g60 = _mm512_setzero_ps(), g61 = _mm512_setzero_ps();
+        __m512 g70 = _mm512_setzero_ps(), g71 = _mm512_setzero_ps();
+
+        for (int b = 0; b < batch; b++)
+        {
+            const float* e = errors + size_t(b) * lde;
+            const float* x = inputs + size_t(b) * ldi + i;
+            const __m512 x0 = _mm512_maskz_loadu_ps(m0, x);
+            const __m512 x1 = _mm512_maskz_loadu_ps(m1, x + 16);
+            __m512 ve;
+            ve = _mm512_set1_ps(e[0]);
+            g00 = _mm512_fmadd_ps(ve, x0, g00);
+            g01 = _mm512_fmadd_ps(ve, x1, g01);
+            ve = _mm512_set1_ps(e[1]);
+            g10 = _mm512_fmadd_ps(ve, x0, g10);
+            g11 = _mm512_fmadd_ps(ve, x1, g11);
+            ve = _mm512_set1_ps(e[2]);
+            g20 = _mm512_fmadd_ps(ve, x0, g20);
+            g21 = _mm512_fmadd_ps(ve, x1, g21);
+            ve = _mm512_set1_ps(e[3]);
+            g30 = _mm512_fmadd_ps(ve, x0, g30);
+            g31 = _mm512_fmadd_ps(ve, x1, g31);
+            ve = _mm512_set1_ps(e[4]);
+            g40 = _mm512_fmadd_ps(ve, x0, g40);
+            g41 = _mm512_fmadd_ps(ve, x1, g41);
+            ve = _mm512_set1_ps(e[5]);
+            g50 = _mm512_fmadd_ps(ve, x0, g50);
+            g51 = _mm512_fmadd_ps(ve, x1, g51);
+            ve = _mm512_set1_ps(e[6]);
+            g60 = _mm512_fmadd_ps(ve, x0, g60);
+            g61 = _mm512_fmadd_ps(ve, x1, g61);
+            ve = _mm512_set1_ps(e[7]);
+            g70 = _mm512_fmadd_ps(ve, x0, g70);
+            g71 = _mm512_fmadd_ps(ve, x1, g71);
+        }
+
+        float* out = w + i;
+        updateRow(out, m0, m1, vrate, g00, g01);
+        updateRow(out += ldw, m0, m1, vrate, g10, g11);
+        updateRow(out += ldw, m0, m1, vrate, g20, g21);
+        updateRow(out += ldw, m0, m1, vrate, g30, g31);
+        updateRow(out += ldw, m0, m1, vrate, g40, g41);
+        updateRow(out += ldw, m0, m1, vrate, g50, g51);
+        updateRow(out += ldw, m0, m1, vrate, g60, g61);
+        updateRow(out += ldw, m0, m1, vrate, g70, g71);
+    }
+}
+
+// 4 x 32 with propagation, the old weights stay in registers beside the gradients
+static void backwardTile4(int cols, int batch, const float* errors, int lde, const float* inputs, int ldi,
+    float* propagated, int ldp, float* w, int ldw, float rate)
+{
+    const __m512 vrate = _mm512_set1_ps(rate);
+    float* w0 = w;
+    float* w1 = w0 + ldw;
+    float* w2 = w1 + ldw;
+    float* w3 = w2 + ldw;
+    for (int i = 0; i < cols; i += 32)
+    {
+        const __mmask16 m0 = cols - i >= 16 ? __mmask16(0xffff) : tailMask(cols - i);
+        const __mmask16 m1 = cols - i >= 32 ? __mmask16(0xffff) : cols - i > 16 ? tailMask(cols - i - 16) : __mmask16(0);
+
+        const __m512 w00 = _mm512_maskz_loadu_ps(m0, w0 + i), w01 = _mm512_maskz_loadu_ps(m1, w0 + i + 16);
+        const __m512 w10 = _mm512_maskz_loadu_ps(m0, w1 + i), w11 = _mm512_maskz_loadu_ps(m1, w1 + i + 16);
+        const __m512 w20 = _mm512_maskz_loadu_ps(m0, w2 + i), w21 = _mm512_maskz_loadu_ps(m1, w2 + i + 16);
+        const __m512 w30 = _mm512_maskz_loadu_ps(m0, w3 + i), w31 = _mm512_maskz_loadu_ps(m1, w3 + i + 16);
+        __m512 g00 = _mm512_setzero_ps(), g01 = _mm512_setzero_ps();
+        __m512 g10 = _mm512_setzero_ps(), g11 = _mm512_setzero_ps();
+        __m512 g20 = _mm512_setzero_ps(), g21 = _mm512_setzero_ps();
+        __m512 g30 = _mm512_setzero_ps(), g31 = _mm512_setzero_ps();
+
+        for (int b = 0; b < batch; b++)
+        {
+            const float* e = errors + size_t(b) * lde;
+            const float* x = inputs + size_t(b) * ldi + i;
+            float* p = propagated + size_t(b) * ldp + i;
+            const __m512 x0 = _mm512_maskz_loadu_ps(m0, x);
+            const __m512 x1 = _mm512_maskz_loadu_ps(m1, x + 16);
+            __m512 p0 = _mm512_maskz_loadu_ps(m0, p);
+            __m512 p1 = _mm512_maskz_loadu_ps(m1, p + 16);
+            __m512 ve;
+            ve = _mm512_set1_ps(e[0]);
+            g00 = _mm512_fmadd_ps(ve, x0, g00);
+            g01 = _mm512_fmadd_ps(ve, x1, g01);
+            p0 = _mm512_fmadd_ps(ve, w00, p0);
+            p1 = _mm512_fmadd_ps(ve, w01, p1);
+            ve = _mm512_set1_ps(e[1]);
+            g10 = _mm512_fmadd_ps(ve, x0, g10);
+            g11 = _mm512_fmadd_ps(ve, x1, g11);
+            p0 = _mm512_fmadd_ps(ve, w10, p0);
+            p1 = _mm512_fmadd_ps(ve, w11, p1);
+            ve = _mm512_set1_ps(e[2]);
+            g20 = _mm512_fmadd_ps(ve, x0, g20);
+            g21 = _mm512_fmadd_ps(ve, x1, g21);
+            p0 = _mm512_fmadd_ps(ve, w20, p0);
+            p1 = _mm512_fmadd_ps(ve, w21, p1);
+            ve = _mm512_set1_ps(e[3]);
+            g30 = _mm512_fmadd_ps(ve, x0, g30);
+            g31 = _mm512_fmadd_ps(ve, x1, g31);
+            p0 = _mm512_fmadd_ps(ve, w30, p0);
+            p1 = _mm512_fmadd_ps(ve, w31, p1);
+            _mm512_mask_storeu_ps(p, m0, p0);
+            _mm512_mask_storeu_ps(p + 16, m1, p1);
+        }
+
+        _mm512_mask_storeu_ps(w0 + i, m0, _mm512_fnmadd_ps(vrate, g00, w00));
+        _mm512_mask_storeu_ps(w0 + i + 16, m1, _mm512_fnmadd_ps(vrate, g01, w01));
+        _mm512_mask_storeu_ps(w1 + i, m0, _mm512_fnmadd_ps(vrate, g10, w10));
+        _mm512_mask_storeu_ps(w1 + i + 16, m1, _mm512_fnmadd_ps(vrate, g11, w11));
+        _mm512_mask_storeu_ps(w2 + i, m0, _mm512_fnmadd_ps(vrate, g20, w20));
+        _mm512_mask_storeu_ps(w2 + i + 16, m1, _mm512_fnmadd_ps(vrate, g21, w21));
+        _mm512_mask_storeu_ps(w3 + i, m0, _mm512_fnmadd_ps(vrate, g30, w30));
+        _mm512_mask_storeu_ps(w3 + i + 16, m1, _mm512_fnmadd_ps(vrate, g31, w31));
+    }
+}
+
+// single rows left over by the tiles, 16 columns at a time, propagated may be null
+static void backwardTile1(int cols, int batch, const float* errors, int lde, const float* inputs, int ldi,
+    float* propagated, int ldp, float* w, float rate)
+{
+    const __m512 vrate = _mm512_set1_ps(rate);
+    for (int i = 0; i < cols; i += 16)
+    {
+        const __mmask16 m = cols - i >= 16 ? __mmask16(0xffff) : tailMask(cols - i);
+        const __m512 old = _mm512_maskz_loadu_ps(m, w + i);
+        __m512 g = _mm512_setzero_ps();
+        for (int b = 0; b < batch; b++)
+        {
+            const __m512 ve = _mm512_set1_ps(errors[size_t(b) * lde]);
+            g = _mm512_fmadd_ps(ve, _mm512_maskz_loadu_ps(m, inputs + size_t(b) * ldi + i), g);
+            if (propagated != nullptr)
+            {
+                float* p = propagated + size_t(b) * ldp + i;
+                _mm512_mask_storeu_ps(p, m, _mm512_fmadd_ps(ve, old, _mm512_maskz_loadu_ps(m, p)));
+            }
+        }
+        _mm512_mask_storeu_ps(w + i, m, _mm512_fnmadd_ps(vrate, g, old));
+    }
+}
+
+static void avx512DenseBackward(int rows, int cols, int batch, const float* errors, int lde, const float* inputs, int ldi,
+    float* propagated, int ldp, float* w, int ldw, float rate)
+{
+    int r = 0;
+    if (propagated != nullptr)
+    {
+        for (; r + 4 <= rows; r += 4)
+            backwardTile4(cols, batch, errors + r, lde, inputs, ldi, propagated, ldp, w + size_t(r) * ldw, ldw, rate);
+    }
+    else
+    {
+        for (; r + 8 <= rows; r += 8)
+            updateTile8(cols, batch, errors + r, lde, inputs, ldi, w + size_t(r) * ldw, ldw, rate);
+    }
+    for (; r < rows; r++)
+        backwardTile1(cols, batch, errors + r, lde, inputs, ldi, propagated, ldp, w + size_t(r) * ldw, rate);
+}
+
+static void avx512MomentumUpdate(const hhUpdateStep& step, float* w, const float* g, float* v, int n)
+{
+    const bool nesterov = step.type == hhOptimizerType::Nesterov;
+    const __m512 scale = _mm512_set1_ps(step.scale), decay = _mm512_set1_ps(step.decay), momentum = _mm512_set1_ps(step.momentum);
+    const __m512 gradientRate = _mm512_set1_ps(nesterov ? step.rate : 0.0f);
+    const __m512 velocityRate = _mm512_set1_ps(nesterov ? step.rate * step.momentum : step.rate);
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 mask = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        const __m512 wi = _mm512_maskz_loadu_ps(mask, w + i);
+        const __m512 gradient = _mm512_fmadd_ps(scale, _mm512_maskz_loadu_ps(mask, g + i), _mm512_mul_ps(decay, wi));
+        const __m512 velocity = _mm512_fmadd_ps(momentum, _mm512_maskz_loadu_ps(mask, v + i), gradient);
+        _mm512_mask_storeu_ps(v + i, mask, velocity);
+        const __m512 delta = _mm512_fmadd_ps(gradientRate, gradient, _mm512_mul_ps(velocityRate, velocity));
+        _mm512_mask_storeu_ps(w + i, mask, _mm512_sub_ps(wi, delta));
+    }
+}
+
+static void avx512AdamUpdate(const hhUpdateStep& step, float* w, const float* g, float* m, float* v, int n)
+{
+    const __m512 scale = _mm512_set1_ps(step.scale), decay = _mm512_set1_ps(step.decay);
+    const __m512 beta1 = _mm512_set1_ps(step.momentum), keep1 = _mm512_set1_ps(1.0f - step.momentum);
+    const __m512 beta2 = _mm512_set1_ps(step.beta2), keep2 = _mm512_set1_ps(1.0f - step.beta2);
+    const __m512 first = _mm512_set1_ps(step.rate * step.firstCorrection), second = _mm512_set1_ps(step.secondCorrection);
+    const __m512 epsilon = _mm512_set1_ps(step.epsilon), shrink = _mm512_set1_ps(step.rate * step.decoupledDecay);
+    for (int i = 0; i < n; i += 16)
+    {
+        const __mmask16 mask = n - i >= 16 ? __mmask16(0xffff) : tailMask(n - i);
+        const __m512 wi = _mm512_maskz_loadu_ps(mask, w + i);
+        const __m512 gradient = _mm512_fmadd_ps(scale, _mm512_maskz_loadu_ps(mask, g + i), _mm512_mul_ps(decay, wi));
+        const __m512 mean = _mm512_fmadd_ps(beta1, _mm512_maskz_loadu_ps(mask, m + i), _mm512_mul_ps(keep1, gradient));
+        const __m512 square = _mm512_fmadd_ps(beta2, _mm512_maskz_loadu_ps(mask, v + i), _mm512_mul_ps(keep2, _mm512_mul_ps(gradient, gradient)));
+        _mm512_mask_storeu_ps(m + i, mask, mean);
+        _mm512_mask_storeu_ps(v + i, mask, square);
+        const __m512 denominator = _mm512_add_ps(_mm512_sqrt_ps(_mm512_mul_ps(square, second)), epsilon);
+        const __m512 delta = _mm512_fmadd_ps(shrink, wi, _mm512_div_ps(_mm512_mul_ps(first, mean), denominator));
+        _mm512_mask_storeu_ps(w + i, mask, _mm512_sub_ps(wi, delta));
+    }
+}
+
+const hhKernels avx512Kernels =
+{
+    hhSimdLevel::AVX512,
+    "avx512",
+    avx512Dot,
+    avx512Gemv,
+    avx512Axpy,
+    avx512BiasAdd,
+    8,
+    32,
+    avx512GemmMicro,
+    avx512FastExp,
+    avx512FastSigmoid,
+    avx512FastSoftmax,
+    gemmInt8Avx2,   // byte multiplies need AVX-512BW, without VNNI int8 stays on the 256-bit maddubs kernel
+    avx512QuantizeInt8,
+    avx512FloatToHalf,
+    avx512HalfToFloat,
+    avx512FloatToBfloat16,
+    avx512Bfloat16ToFloat,
+    gemv16<widenHalf16>,
+    gemv16<widenBfloat16>,
+    avx512DenseBackward,
+    avx512MomentumUpdate,
+    avx512AdamUpdate,
+    avx512FloatToBytes,
+};
+
+#endif
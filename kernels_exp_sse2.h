@@ -0,0 +1,34 @@
+#pragma once
+
+// SSE2 exp and sigmoid shared by the SSE2 table and the static model's inline activations, included only from
+// code compiled with SSE2 enabled. error bounds are in kernels_exp.h.
+
+#include "kernels_exp.h"
+
+#include <emmintrin.h>
+
+static inline __m128 exp4(__m128 x)
+{
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(expLo)), _mm_set1_ps(expHi));
+    const __m128i ni = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(expLog2e)));
+    const __m128 n = _mm_cvtepi32_ps(ni);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(expLn2Hi)));
+    r = _mm_sub_ps(r, _mm_mul_ps(n, _mm_set1_ps(expLn2Lo)));
+
+    __m128 p = _mm_set1_ps(expP0);
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(expP1));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(expP2));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(expP3));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(expP4));
+    p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(expP5));
+    const __m128 y = _mm_add_ps(_mm_mul_ps(p, _mm_mul_ps(r, r)), _mm_add_ps(r, _mm_set1_ps(1.0f)));
+
+    const __m128i e = _mm_slli_epi32(_mm_add_epi32(ni, _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(y, _mm_castsi128_ps(e));
+}
+
+static inline __m128 sigmoid4(__m128 x)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    return _mm_div_ps(one, _mm_add_ps(one, exp4(_mm_sub_ps(_mm_setzero_ps(), x))));
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// int8 matrix products shared by the AVX2 and AVX-512 tables, included only from
+// translation units compiled with AVX2 enabled.
+
+#include <immintrin.h>
+#include <cstddef>
+#include <cstdint>
+
+static inline int32_t hsumInt8Acc(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+// acc += 32 products of w and x, summed into eight int32 lanes. maddubs takes one unsigned operand,
+// so |x| goes there and the sign of x moves onto w. with both in [-127, 127] the int16 pair sums cannot saturate.
+static inline __m256i dotInt8Step(__m256i acc, __m256i absX, __m256i vx, __m256i vw)
+{
+    const __m256i pairs = _mm256_maddubs_epi16(absX, _mm256_sign_epi8(vw, vx));
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, _mm256_set1_epi16(1)));
+}
+
+static inline int32_t dotInt8Avx2(const int8_t* w, const int8_t* x, int n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        const __m256i vx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+        const __m256i vw = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i));
+        acc = dotInt8Step(acc, _mm256_abs_epi8(vx), vx, vw);
+    }
+
+    int32_t sum = hsumInt8Acc(acc);
+    for (; i < n; i++)
+        sum += int32_t(w[i]) * x[i];
+    return sum;
+}
+
+static inline void gemvInt8Avx2(const int8_t* w, int stride, const int8_t* x, int32_t* y, int rows, int cols)
+{
+    // four rows at a time so each load of x feeds four rows
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const int8_t* w0 = w + size_t(r) * stride;
+        const int8_t* w1 = w0 + stride;
+        const int8_t* w2 = w1 + stride;
+        const int8_t* w3 = w2 + stride;
+
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        __m256i acc2 = _mm256_setzero_si256();
+        __m256i acc3 = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 32 <= cols; i += 32)
+        {
+            const __m256i vx = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+            const __m256i absX = _mm256_abs_epi8(vx);
+            acc0 = dotInt8Step(acc0, absX, vx, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w0 + i)));
+            acc1 = dotInt8Step(acc1, absX, vx, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w1 + i)));
+            acc2 = dotInt8Step(acc2, absX, vx, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w2 + i)));
+            acc3 = dotInt8Step(acc3, absX, vx, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w3 + i)));
+        }
+
+        int32_t s0 = hsumInt8Acc(acc0), s1 = hsumInt8Acc(acc1), s2 = hsumInt8Acc(acc2), s3 = hsumInt8Acc(acc3);
+        for (; i < cols; i++)
+        {
+            s0 += int32_t(w0[i]) * x[i];
+            s1 += int32_t(w1[i]) * x[i];
+            s2 += int32_t(w2[i]) * x[i];
+            s3 += int32_t(w3[i]) * x[i];
+        }
+        y[r + 0] = s0;
+        y[r + 1] = s1;
+        y[r + 2] = s2;
+        y[r + 3] = s3;
+    }
+    for (; r < rows; r++)
+        y[r] = dotInt8Avx2(w + size_t(r) * stride, x, cols);
+}
+
+static inline void gemmInt8Avx2(int batch, int rows, int cols, const int8_t* x, int ldx, const int8_t* w, int ldw, int32_t* y, int ldy)
+{
+    for (int b = 0; b < batch; b++)
+        gemvInt8Avx2(w, ldw, x + size_t(b) * ldx, y + size_t(b) * ldy, rows, cols);
+}
@@ -0,0 +1,671 @@
+#include "kernels.h"
+
+#if HH_X86
+
+#include "kernels_exp_sse2.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+static inline float hsum(__m128 v)
+{
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+static float sse2Dot(const float* a, const float* b, int n)
+{
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    for (; i + 4 <= n; i += 4)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+
+    float sum = hsum(_mm_add_ps(acc0, acc1));
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static void sse2Gemv(const float* w, int stride, const float* x, float* y, int rows, int cols)
+{
+    for (int r = 0; r < rows; r++)
+        y[r] = sse2Dot(w + size_t(r) * stride, x, cols);
+}
+
+static void sse2Axpy(float a, const float* x, float* y, int n)
+{
+    const __m128 va = _mm_set1_ps(a);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+    }
+    for (; i < n; i++)
+        y[i] += a * x[i];
+}
+
+static void sse2BiasAdd(float* y, const float* b, int n)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_loadu_ps(b + i)));
+    }
+    for (; i < n; i++)
+        y[i] += b[i];
+}
+
+// 4x8 tile, eight accumulators
+static void sse2GemmMicro(int kc, const float* a, const float* b, float* c, int ldc)
+{
+    __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+    __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+    __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+    __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+    for (int p = 0; p < kc; p++)
+    {
+        const __m128 b0 = _mm_loadu_ps(b);
+        const __m128 b1 = _mm_loadu_ps(b + 4);
+        __m128 ai = _mm_set1_ps(a[0]);
+        c00 = _mm_add_ps(c00, _mm_mul_ps(ai, b0));
+        c01 = _mm_add_ps(c01, _mm_mul_ps(ai, b1));
+        ai = _mm_set1_ps(a[1]);
+        c10 = _mm_add_ps(c10, _mm_mul_ps(ai, b0));
+        c11 = _mm_add_ps(c11, _mm_mul_ps(ai, b1));
+        ai = _mm_set1_ps(a[2]);
+        c20 = _mm_add_ps(c20, _mm_mul_ps(ai, b0));
+        c21 = _mm_add_ps(c21, _mm_mul_ps(ai, b1));
+        ai = _mm_set1_ps(a[3]);
+        c30 = _mm_add_ps(c30, _mm_mul_ps(ai, b0));
+        c31 = _mm_add_ps(c31, _mm_mul_ps(ai, b1));
+        a += 4;
+        b += 8;
+    }
+
+    float* c0 = c;
+    float* c1 = c0 + ldc;
+    float* c2 = c1 + ldc;
+    float* c3 = c2 + ldc;
+    _mm_storeu_ps(c0, _mm_add_ps(_mm_loadu_ps(c0), c00));
+    _mm_storeu_ps(c0 + 4, _mm_add_ps(_mm_loadu_ps(c0 + 4), c01));
+    _mm_storeu_ps(c1, _mm_add_ps(_mm_loadu_ps(c1), c10));
+    _mm_storeu_ps(c1 + 4, _mm_add_ps(_mm_loadu_ps(c1 + 4), c11));
+    _mm_storeu_ps(c2, _mm_add_ps(_mm_loadu_ps(c2), c20));
+    _mm_storeu_ps(c2 + 4, _mm_add_ps(_mm_loadu_ps(c2 + 4), c21));
+    _mm_storeu_ps(c3, _mm_add_ps(_mm_loadu_ps(c3), c30));
+    _mm_storeu_ps(c3 + 4, _mm_add_ps(_mm_loadu_ps(c3 + 4), c31));
+}
+
+// runs op over x four lanes at a time, the tail goes through a zero padded buffer
+template <typename Op>
+static void apply4(const float* x, float* y, int n, Op op)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(y + i, op(_mm_loadu_ps(x + i)));
+    if (i < n)
+    {
+        float buf[4] = {};
+        std::memcpy(buf, x + i, (n - i) * sizeof(float));
+        _mm_storeu_ps(buf, op(_mm_loadu_ps(buf)));
+        std::memcpy(y + i, buf, (n - i) * sizeof(float));
+    }
+}
+
+static void sse2FastExp(const float* x, float* y, int n)
+{
+    apply4(x, y, n, exp4);
+}
+
+static void sse2FastSigmoid(const float* x, float* y, int n)
+{
+    apply4(x, y, n, sigmoid4);
+}
+
+static void sse2FastSoftmax(const float* x, float* y, int n)
+{
+    if (n <= 0)
+        return;
+
+    float highest = x[0];
+    int i = 0;
+    if (n >= 4)
+    {
+        __m128 vmax = _mm_loadu_ps(x);
+        for (i = 4; i + 4 <= n; i += 4)
+            vmax = _mm_max_ps(vmax, _mm_loadu_ps(x + i));
+        vmax = _mm_max_ps(vmax, _mm_shuffle_ps(vmax, vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+        vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+        highest = _mm_cvtss_f32(vmax);
+    }
+    for (; i < n; i++)
+        highest = highest > x[i] ? highest : x[i];
+
+    const __m128 vh = _mm_set1_ps(highest);
+    __m128 vsum = _mm_setzero_ps();
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        const __m128 e = exp4(_mm_sub_ps(_mm_loadu_ps(x + i), vh));
+        _mm_storeu_ps(y + i, e);
+        vsum = _mm_add_ps(vsum, e);
+    }
+    float sum = hsum(vsum);
+    if (i < n)
+    {
+        float buf[4] = {};
+        std::memcpy(buf, x + i, (n - i) * sizeof(float));
+        _mm_storeu_ps(buf, exp4(_mm_sub_ps(_mm_loadu_ps(buf), vh)));
+        for (int j = 0; j < n - i; j++)
+        {
+            y[i + j] = buf[j];
+            sum += buf[j];
+        }
+    }
+
+    const __m128 scale = _mm_set1_ps(1.0f / sum);
+    for (i = 0; i + 4 <= n; i += 4)
+        _mm_storeu_ps(y + i, _mm_mul_ps(_mm_loadu_ps(y + i), scale));
+    for (; i < n; i++)
+        y[i] *= 1.0f / sum;
+}
+
+// sign extends 16 int8 values into two int16 halves
+static inline void widenInt8(__m128i v, __m128i& lo, __m128i& hi)
+{
+    const __m128i sign = _mm_cmpgt_epi8(_mm_setzero_si128(), v);
+    lo = _mm_unpacklo_epi8(v, sign);
+    hi = _mm_unpackhi_epi8(v, sign);
+}
+
+static void sse2GemvInt8(const int8_t* w, int stride, const int8_t* x, int32_t* y, int rows, int cols)
+{
+    for (int r = 0; r < rows; r++)
+    {
+        const int8_t* row = w + size_t(r) * stride;
+        __m128i acc = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 16 <= cols; i += 16)
+        {
+            __m128i xlo, xhi, wlo, whi;
+            widenInt8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)), xlo, xhi);
+            widenInt8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)), wlo, whi);
+            acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(wlo, xlo), _mm_madd_epi16(whi, xhi)));
+        }
+
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        int32_t sum = _mm_cvtsi128_si32(acc);
+        for (; i < cols; i++)
+            sum += int32_t(row[i]) * x[i];
+        y[r] = sum;
+    }
+}
+
+static void sse2GemmInt8(int batch, int rows, int cols, const int8_t* x, int ldx, const int8_t* w, int ldw, int32_t* y, int ldy)
+{
+    for (int b = 0; b < batch; b++)
+        sse2GemvInt8(w, ldw, x + size_t(b) * ldx, y + size_t(b) * ldy, rows, cols);
+}
+
+static void sse2QuantizeInt8(const float* x, int8_t* q, float inverseScale, int n)
+{
+    // clamping before the conversion keeps every value inside the saturating packs
+    const __m128 scale = _mm_set1_ps(inverseScale);
+    const __m128 hi = _mm_set1_ps(127.0f);
+    const __m128 lo = _mm_set1_ps(-127.0f);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v[4];
+        for (int j = 0; j < 4; j++)
+            v[j] = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(x + i + 4 * j), scale), lo), hi));
+        const __m128i packed = _mm_packs_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(q + i), packed);
+    }
+    for (; i < n; i++)
+        q[i] = int8_t(std::nearbyint(std::min(127.0f, std::max(-127.0f, x[i] * inverseScale))));
+}
+
+static void sse2FloatToBytes(const float* x, uint8_t* y, int n)
+{
+    // max takes its second operand for NaN, so NaN lands on zero. clamped values pass the packs unchanged.
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 zero = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v[4];
+        for (int j = 0; j < 4; j++)
+            v[j] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(x + i + 4 * j), scale), zero), scale));
+        const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), packed);
+    }
+    for (; i < n; i++)
+    {
+        const float v = x[i] * 255.0f;
+        y[i] = uint8_t(v > 0.0f ? (v < 255.0f ? v : 255.0f) : 0.0f);
+    }
+}
+
+// ---------------------------- 16-bit floats ----------------------------
+
+static inline __m128i select(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// packs the low 16 bits of every 32-bit lane of a and b into eight words
+static inline __m128i packLow16(__m128i a, __m128i b)
+{
+    // sign extending first keeps packs from saturating values with the top bit set
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    return _mm_packs_epi32(a, b);
+}
+
+// half bits in the low 16 bits of each lane, the same steps as the scalar conversion
+static inline __m128i half4(__m128 x)
+{
+    const __m128i bits = _mm_castps_si128(x);
+    const __m128i sign = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(0x8000));
+    const __m128i magnitude = _mm_and_si128(bits, _mm_set1_epi32(0x7fffffff));
+
+    const __m128i odd = _mm_and_si128(_mm_srli_epi32(magnitude, 13), _mm_set1_epi32(1));
+    const __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(magnitude, _mm_set1_epi32(int(0xc8000fff))), odd), 13);
+
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(magnitude), half)), _mm_castps_si128(half));
+
+    const __m128i nan = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7f800000));
+    const __m128i special = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(nan, _mm_set1_epi32(0x200)));
+
+    __m128i result = select(_mm_cmplt_epi32(magnitude, _mm_set1_epi32(0x38800000)), denormal, normal);
+    result = select(_mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x477fffff)), special, result);
+    return _mm_or_si128(result, sign);
+}
+
+// half bits in the low 16 bits of each lane to floats
+static inline __m128 floatFromHalf4(__m128i h)
+{
+    const __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+    __m128i bits = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7fff)), 13);
+    const __m128i exponent = _mm_and_si128(bits, _mm_set1_epi32(0x0f800000));
+    bits = _mm_add_epi32(bits, _mm_set1_epi32(0x38000000));
+
+    // infinity and NaN need the exponent all ones, zero and denormals are renormalized by a float subtract
+    const __m128i infinite = _mm_cmpeq_epi32(exponent, _mm_set1_epi32(0x0f800000));
+    bits = _mm_add_epi32(bits, _mm_and_si128(infinite, _mm_set1_epi32(0x38000000)));
+    const __m128 smallest = _mm_castsi128_ps(_mm_set1_epi32(0x38800000));
+    const __m128i renormalized = _mm_castps_si128(_mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(bits, _mm_set1_epi32(0x00800000))), smallest));
+    bits = select(_mm_cmpeq_epi32(exponent, _mm_setzero_si128()), renormalized, bits);
+
+    return _mm_castsi128_ps(_mm_or_si128(bits, sign));
+}
+
+static inline __m128i bfloat16x4(__m128 x)
+{
+    const __m128i bits = _mm_castps_si128(x);
+    const __m128i magnitude = _mm_and_si128(bits, _mm_set1_epi32(0x7fffffff));
+    const __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1));
+    __m128i result = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32(0x7fff)), odd), 16);
+
+    const __m128i nan = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7f800000));
+    result = select(nan, _mm_or_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(0x40)), result);
+    const __m128i denormal = _mm_cmplt_epi32(magnitude, _mm_set1_epi32(0x00800000));
+    return select(denormal, _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(0x8000)), result);
+}
+
+// narrows x eight lanes at a time, the tail goes through a zero padded buffer
+template <typename Op>
+static void narrow8(const float* x, uint16_t* y, int n, Op op)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), packLow16(op(_mm_loadu_ps(x + i)), op(_mm_loadu_ps(x + i + 4))));
+    if (i < n)
+    {
+        float buf[8] = {};
+        uint16_t out[8];
+        std::memcpy(buf, x + i, (n - i) * sizeof(float));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packLow16(op(_mm_loadu_ps(buf)), op(_mm_loadu_ps(buf + 4))));
+        std::memcpy(y + i, out, (n - i) * sizeof(uint16_t));
+    }
+}
+
+static void sse2FloatToHalf(const float* x, uint16_t* y, int n)
+{
+    narrow8(x, y, n, half4);
+}
+
+static void sse2FloatToBfloat16(const float* x, uint16_t* y, int n)
+{
+    narrow8(x, y, n, bfloat16x4);
+}
+
+static void sse2HalfToFloat(const uint16_t* x, float* y, int n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        _mm_storeu_ps(y + i, floatFromHalf4(_mm_unpacklo_epi16(h, zero)));
+        _mm_storeu_ps(y + i + 4, floatFromHalf4(_mm_unpackhi_epi16(h, zero)));
+    }
+    for (; i < n; i++)
+    {
+        const __m128 v = floatFromHalf4(_mm_cvtsi32_si128(x[i]));
+        y[i] = _mm_cvtss_f32(v);
+    }
+}
+
+static void sse2Bfloat16ToFloat(const uint16_t* x, float* y, int n)
+{
+    // the bfloat16 bits become the upper half of each float
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), _mm_unpacklo_epi16(zero, h));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i + 4), _mm_unpackhi_epi16(zero, h));
+    }
+    for (; i < n; i++)
+    {
+        const uint32_t bits = uint32_t(x[i]) << 16;
+        std::memcpy(&y[i], &bits, sizeof(bits));
+    }
+}
+
+static inline __m128 widenHalf4(__m128i words)
+{
+    return floatFromHalf4(words);
+}
+
+static inline __m128 widenBfloat4(__m128i words)
+{
+    return _mm_castsi128_ps(_mm_slli_epi32(words, 16));
+}
+
+// eight weights per step, each group of four words widened in the 32-bit lanes they are unpacked to
+template <__m128 (*widen4)(__m128i)>
+static void gemv16(const uint16_t* w, int stride, const float* x, float* y, int rows, int cols)
+{
+    const __m128i zero = _mm_setzero_si128();
+    for (int r = 0; r < rows; r++)
+    {
+        const uint16_t* row = w + size_t(r) * stride;
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        int i = 0;
+        for (; i + 8 <= cols; i += 8)
+        {
+            const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(widen4(_mm_unpacklo_epi16(h, zero)), _mm_loadu_ps(x + i)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(widen4(_mm_unpackhi_epi16(h, zero)), _mm_loadu_ps(x + i + 4)));
+        }
+
+        float sum = hsum(_mm_add_ps(acc0, acc1));
+        for (; i < cols; i++)
+            sum += _mm_cvtss_f32(widen4(_mm_cvtsi32_si128(row[i]))) * x[i];
+        y[r] = sum;
+    }
+}
+
+// the denseBackward tiles keep the gradients of a block in registers while every sample of the batch passes over
+// it, then write the block of w once. each runs the whole blocks of a row group and returns where it stopped.
+
+// single rows and the columns the tiles leave, 4 at a time then scalar. propagated may be null.
+static void backwardTile1(int cols, int batch, const float* errors, int lde, const float* inputs, int ldi,
+    float* propagated, int ldp, float* w, float rate)
+{
+    const __m128 vrate = _mm_set1_ps(rate);
+    int i = 0;
+    for (; i + 4 <= cols; i += 4)
+    {
+        const __m128 old = _mm_loadu_ps(w + i);
+        __m128 g = _mm_setzero_ps();
+        for (int b = 0; b < batch; b++)
+        {
+            const __m128 ve = _mm_set1_ps(errors[size_t(b) * lde]);
+            g = _mm_add_ps(g, _mm_mul_ps(ve, _mm_loadu_ps(inputs + size_t(b) * ldi + i)));
+            if (propagated != nullptr)
+            {
+                float* p = propagated + size_t(b) * ldp + i;
+                _mm_storeu_ps(p, _mm_add_ps(_mm_loadu_ps(p), _mm_mul_ps(ve, old)));
+            }
+        }
+        _mm_storeu_ps(w + i, _mm_sub_ps(old, _mm_mul_ps(vrate, g)));
+    }
+    for (; i < cols; i++)
+    {
+        const float old = w[i];
+        float gradient = 0.0f;
+        for (int b = 0; b < batch; b++)
+        {
+            const float e = errors[size_t(b) * lde];
+            gradient += e * inputs[size_t(b) * ldi + i];
+            if (propagated != nullptr)
+                propagated[size_t(b) * ldp + i] += e * old;
+        }
+        w[i] = old - rate * gradient;
+    }
+}
+
+// w[0, 8) -= rate * g
+static inline void updateRow(float* w, __m128 rate, __m128 g0, __m128 g1)
+{
+    _mm_storeu_ps(w, _mm_sub_ps(_mm_loadu_ps(w), _mm_mul_ps(rate, g0)));
+    _mm_storeu_ps(w + 4, _mm_sub_ps(_mm_loadu_ps(w + 4), _mm_mul_ps(rate, g1)));
+}
+
+// 4 x 8 update without propagation, the gemm tile shape
+static int updateTile4(int cols, int batch, const float* errors, int lde, const float* inputs, int ldi, float* w, int ldw, float rate)
+{
+    const __m128 vrate = _mm_set1_ps(rate);
+    int i = 0;
+    for (; i + 8 <= cols; i += 8)
+    {
+        __m128 g00 = _mm_setzero_ps(), g01 = _mm_setzero_ps();
+        __m128 g10 = _mm_setzero_ps(), g11 = _mm_setzero_ps();
+        __m128 g20 = _mm_setzero_ps(), g21 = _mm_setzero_ps();
+        __m128 g30 = _mm_setzero_ps(), g31 = _mm_setzero_ps();
+
+        for (int b = 0; b < batch; b++)
+        {
+            const float* e = errors + size_t(b) * lde;
+            const float* x = inputs + size_t(b) * ldi + i;
+            const __m128 x0 = _mm_loadu_ps(x);
+            const __m128 x1 = _mm_loadu_ps(x + 4);
+            __m128 ve;
+            ve = _mm_set1_ps(e[0]);
+            g00 = _mm_add_ps(g00, _mm_mul_ps(ve, x0));
+            g01 = _mm_add_ps(g01, _mm_mul_ps(ve, x1));
+            ve = _mm_set1_ps(e[1]);
+            g10 = _mm_add_ps(g10, _mm_mul_ps(ve, x0));
+            g11 = _mm_add_ps(g11, _mm_mul_ps(ve, x1));
+            ve = _mm_set1_ps(e[2]);
+            g20 = _mm_add_ps(g20, _mm_mul_ps(ve, x0));
+            g21 = _mm_add_ps(g21, _mm_mul_ps(ve, x1));
+            ve = _mm_set1_ps(e[3]);
+            g30 = _mm_add_ps(g30, _mm_mul_ps(ve, x0));
+            g31 = _mm_add_ps(g31, _mm_mul_ps(ve, x1));
+        }
+
+        float* out = w + i;
+        updateRow(out, vrate, g00, g01);
+        updateRow(out += ldw, vrate, g10, g11);
+        updateRow(out += ldw, vrate, g20, g21);
+        updateRow(out += ldw, vrate, g30, g31);
+    }
+    return i;
+}
+
+// 4 x 4 with propagation, the old weights stay in registers beside the gradients
+static int backwardTile4(int cols, int batch, const float* errors, int lde, const float* inputs, int ldi,
+    float* propagated, int ldp, float* w, int ldw, float rate)
+{
+    const __m128 vrate = _mm_set1_ps(rate);
+    float* w0 = w;
+    float* w1 = w0 + ldw;
+    float* w2 = w1 + ldw;
+    float* w3 = w2 + ldw;
+    int i = 0;
+    for (; i + 4 <= cols; i += 4)
+    {
+        const __m128 v0 = _mm_loadu_ps(w0 + i);
+        const __m128 v1 = _mm_loadu_ps(w1 + i);
+        const __m128 v2 = _mm_loadu_ps(w2 + i);
+        const __m128 v3 = _mm_loadu_ps(w3 + i);
+        __m128 g0 = _mm_setzero_ps();
+        __m128 g1 = _mm_setzero_ps();
+        __m128 g2 = _mm_setzero_ps();
+        __m128 g3 = _mm_setzero_ps();
+
+        for (int b = 0; b < batch; b++)
+        {
+            const float* e = errors + size_t(b) * lde;
+            const __m128 x = _mm_loadu_ps(inputs + size_t(b) * ldi + i);
+            float* p = propagated + size_t(b) * ldp + i;
+            __m128 acc = _mm_loadu_ps(p);
+            __m128 ve;
+            ve = _mm_set1_ps(e[0]);
+            g0 = _mm_add_ps(g0, _mm_mul_ps(ve, x));
+            acc = _mm_add_ps(acc, _mm_mul_ps(ve, v0));
+            ve = _mm_set1_ps(e[1]);
+            g1 = _mm_add_ps(g1, _mm_mul_ps(ve, x));
+            acc = _mm_add_ps(acc, _mm_mul_ps(ve, v1));
+            ve = _mm_set1_ps(e[2]);
+            g2 = _mm_add_ps(g2, _mm_mul_ps(ve, x));
+            acc = _mm_add_ps(acc, _mm_mul_ps(ve, v2));
+            ve = _mm_set1_ps(e[3]);
+            g3 = _mm_add_ps(g3, _mm_mul_ps(ve, x));
+            acc = _mm_add_ps(acc, _mm_mul_ps(ve, v3));
+            _mm_storeu_ps(p, acc);
+        }
+
+        _mm_storeu_ps(w0 + i, _mm_sub_ps(v0, _mm_mul_ps(vrate, g0)));
+        _mm_storeu_ps(w1 + i, _mm_sub_ps(v1, _mm_mul_ps(vrate, g1)));
+        _mm_storeu_ps(w2 + i, _mm_sub_ps(v2, _mm_mul_ps(vrate, g2)));
+        _mm_storeu_ps(w3 + i, _mm_sub_ps(v3, _mm_mul_ps(vrate, g3)));
+    }
+    return i;
+}
+
+static void sse2DenseBackward(int rows, int cols, int batch, const float* errors, int lde, const float* inputs, int ldi,
+    float* propagated, int ldp, float* w, int ldw, float rate)
+{
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const int done = propagated != nullptr
+            ? backwardTile4(cols, batch, errors + r, lde, inputs, ldi, propagated, ldp, w + size_t(r) * ldw, ldw, rate)
+            : updateTile4(cols, batch, errors + r, lde, inputs, ldi, w + size_t(r) * ldw, ldw, rate);
+
+        for (int t = r; t < r + 4 && done < cols; t++)
+            backwardTile1(cols - done, batch, errors + t, lde, inputs + done, ldi,
+                propagated != nullptr ? propagated + done : nullptr, ldp, w + size_t(t) * ldw + done, rate);
+    }
+    for (; r < rows; r++)
+        backwardTile1(cols, batch, errors + r, lde, inputs, ldi, propagated, ldp, w + size_t(r) * ldw, rate);
+}
+
+static void sse2MomentumUpdate(const hhUpdateStep& step, float* w, const float* g, float* v, int n)
+{
+    const bool nesterov = step.type == hhOptimizerType::Nesterov;
+    const float gradientPart = nesterov ? 1.0f : 0.0f;
+    const float velocityPart = nesterov ? step.momentum : 1.0f;
+    const __m128 scale = _mm_set1_ps(step.scale), decay = _mm_set1_ps(step.decay), momentum = _mm_set1_ps(step.momentum);
+    const __m128 gradientRate = _mm_set1_ps(step.rate * gradientPart), velocityRate = _mm_set1_ps(step.rate * velocityPart);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 wi = _mm_loadu_ps(w + i);
+        const __m128 gradient = _mm_add_ps(_mm_mul_ps(scale, _mm_loadu_ps(g + i)), _mm_mul_ps(decay, wi));
+        const __m128 velocity = _mm_add_ps(_mm_mul_ps(momentum, _mm_loadu_ps(v + i)), gradient);
+        _mm_storeu_ps(v + i, velocity);
+        const __m128 delta = _mm_add_ps(_mm_mul_ps(gradientRate, gradient), _mm_mul_ps(velocityRate, velocity));
+        _mm_storeu_ps(w + i, _mm_sub_ps(wi, delta));
+    }
+    for (; i < n; i++)
+    {
+        const float gradient = step.scale * g[i] + step.decay * w[i];
+        const float velocity = step.momentum * v[i] + gradient;
+        v[i] = velocity;
+        w[i] -= step.rate * (gradientPart * gradient + velocityPart * velocity);
+    }
+}
+
+static void sse2AdamUpdate(const hhUpdateStep& step, float* w, const float* g, float* m, float* v, int n)
+{
+    const __m128 scale = _mm_set1_ps(step.scale), decay = _mm_set1_ps(step.decay);
+    const __m128 beta1 = _mm_set1_ps(step.momentum), keep1 = _mm_set1_ps(1.0f - step.momentum);
+    const __m128 beta2 = _mm_set1_ps(step.beta2), keep2 = _mm_set1_ps(1.0f - step.beta2);
+    const __m128 first = _mm_set1_ps(step.rate * step.firstCorrection), second = _mm_set1_ps(step.secondCorrection);
+    const __m128 epsilon = _mm_set1_ps(step.epsilon), shrink = _mm_set1_ps(step.rate * step.decoupledDecay);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 wi = _mm_loadu_ps(w + i);
+        const __m128 gradient = _mm_add_ps(_mm_mul_ps(scale, _mm_loadu_ps(g + i)), _mm_mul_ps(decay, wi));
+        const __m128 mean = _mm_add_ps(_mm_mul_ps(beta1, _mm_loadu_ps(m + i)), _mm_mul_ps(keep1, gradient));
+        const __m128 square = _mm_add_ps(_mm_mul_ps(beta2, _mm_loadu_ps(v + i)), _mm_mul_ps(keep2, _mm_mul_ps(gradient, gradient)));
+        _mm_storeu_ps(m + i, mean);
+        _mm_storeu_ps(v + i, square);
+        const __m128 denominator = _mm_add_ps(_mm_sqrt_ps(_mm_mul_ps(square, second)), epsilon);
+        const __m128 delta = _mm_add_ps(_mm_div_ps(_mm_mul_ps(first, mean), denominator), _mm_mul_ps(shrink, wi));
+        _mm_storeu_ps(w + i, _mm_sub_ps(wi, delta));
+    }
+    for (; i < n; i++)
+    {
+        const float gradient = step.scale * g[i] + step.decay * w[i];
+        const float mean = step.momentum * m[i] + (1.0f - step.momentum) * gradient;
+        const float square = step.beta2 * v[i] + (1.0f - step.beta2) * gradient * gradient;
+        m[i] = mean;
+        v[i] = square;
+        const float adaptive = mean * step.firstCorrection / (std::sqrt(square * step.secondCorrection) + step.epsilon);
+        w[i] -= step.rate * (adaptive + step.decoupledDecay * w[i]);
+    }
+}
+
+const hhKernels sse2Kernels =
+{
+    hhSimdLevel::SSE2,
+    "sse2",
+    sse2Dot,
+    sse2Gemv,
+    sse2Axpy,
+    sse2BiasAdd,
+    4,
+    8,
+    sse2GemmMicro,
+    sse2FastExp,
+    sse2FastSigmoid,
+    sse2FastSoftmax,
+    sse2GemmInt8,
+    sse2QuantizeInt8,
+    sse2FloatToHalf,
+    sse2HalfToFloat,
+    sse2FloatToBfloat16,
+    sse2Bfloat16ToFloat,
+    gemv16<widenHalf4>,
+    gemv16<widenBfloat4>,
+    sse2DenseBackward,
+    sse2MomentumUpdate,
+    sse2AdamUpdate,
+    sse2FloatToBytes,
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include "kernels.h"
+
+#if HH_X86
+
+#include <immintrin.h>
+#include <cstddef>
+
+// lanes [0, n) set, for masked byte tails
+static inline __mmask64 byteMask(int n)
+{
+    return n >= 64 ? ~__mmask64(0) : (__mmask64(1) << n) - 1;
+}
+
+static int32_t sumInt8(const int8_t* x, int n)
+{
+    const __m512i ones = _mm512_set1_epi8(1);
+    __m512i acc = _mm512_setzero_si512();
+    for (int i = 0; i < n; i += 64)
+        acc = _mm512_dpbusd_epi32(acc, ones, _mm512_maskz_loadu_epi8(byteMask(n - i), x + i));
+    return _mm512_reduce_add_epi32(acc);
+}
+
+// samples x rows block of dot products held in registers. vpdpbusd multiplies unsigned by signed bytes,
+// so the weights are flipped to unsigned as w + 128 and the extra 128 * sum(x) is taken off at the end.
+// every product then costs one instruction and each weight load feeds all the samples.
+template <int samples, int rows>
+static inline void vnniTile(int cols, const int8_t* x, int ldx, const int8_t* w, int ldw, const int32_t* xSums, int32_t* y, int ldy)
+{
+    const __m512i flip = _mm512_set1_epi8(char(0x80));
+
+    __m512i acc[samples][rows];
+    for (int s = 0; s < samples; s++)
+        for (int r = 0; r < rows; r++)
+            acc[s][r] = _mm512_setzero_si512();
+
+    int i = 0;
+    for (; i + 64 <= cols; i += 64)
+    {
+        __m512i vw[rows];
+        for (int r = 0; r < rows; r++)
+            vw[r] = _mm512_xor_si512(_mm512_loadu_si512(w + size_t(r) * ldw + i), flip);
+
+        for (int s = 0; s < samples; s++)
+        {
+            const __m512i vx = _mm512_loadu_si512(x + size_t(s) * ldx + i);
+            for (int r = 0; r < rows; r++)
+                acc[s][r] = _mm512_dpbusd_epi32(acc[s][r], vw[r], vx);
+        }
+    }
+    if (i < cols)
+    {
+        // masked lanes load as zero, x being zero there cancels the flipped weight
+        const __mmask64 m = byteMask(cols - i);
+        __m512i vw[rows];
+        for (int r = 0; r < rows; r++)
+            vw[r] = _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, w + size_t(r) * ldw + i), flip);
+
+        for (int s = 0; s < samples; s++)
+        {
+            const __m512i vx = _mm512_maskz_loadu_epi8(m, x + size_t(s) * ldx + i);
+            for (int r = 0; r < rows; r++)
+                acc[s][r] = _mm512_dpbusd_epi32(acc[s][r], vw[r], vx);
+        }
+    }
+
+    for (int s = 0; s < samples; s++)
+        for (int r = 0; r < rows; r++)
+            y[size_t(s) * ldy + r] = _mm512_reduce_add_epi32(acc[s][r]) - 128 * xSums[s];
+}
+
+template <int samples>
+static void vnniRows(int rows, int cols, const int8_t* x, int ldx, const int8_t* w, int ldw, int32_t* y, int ldy)
+{
+    int32_t xSums[samples];
+    for (int s = 0; s < samples; s++)
+        xSums[s] = sumInt8(x + size_t(s) * ldx, cols);
+
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+        vnniTile<samples, 4>(cols, x, ldx, w + size_t(r) * ldw, ldw, xSums, y + r, ldy);
+    for (; r < rows; r++)
+        vnniTile<samples, 1>(cols, x, ldx, w + size_t(r) * ldw, ldw, xSums, y + r, ldy);
+}
+
+void avx512VnniGemmInt8(int batch, int rows, int cols, const int8_t* x, int ldx, const int8_t* w, int ldw, int32_t* y, int ldy)
+{
+    int b = 0;
+    for (; b + 4 <= batch; b += 4)
+        vnniRows<4>(rows, cols, x + size_t(b) * ldx, ldx, w, ldw, y + size_t(b) * ldy, ldy);
+    for (; b < batch; b++)
+        vnniRows<1>(rows, cols, x + size_t(b) * ldx, ldx, w, ldw, y + size_t(b) * ldy, ldy);
+}
+
+#endif
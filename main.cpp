@@ -1,70 +1,97 @@
 #include <iostream>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
 
 #include "model.h"
+#include "static_model.h"
 #include "render.h"
+#include "tasks.h"
 
-class ColorTask : public hhTask
+int main(int argc, char** argv)
 {
-public:
-
-    void Configure(hhModel& model) override
+    // --lockstep trains and draws in turn on one thread, as before the trainer had its own.
+    // --grid N samples the decision regions on an N x N grid, drawn into the same square.
+    bool lockstep = false;
+    int gridSize = 80;
+    for (int a = 1; a < argc; a++)
     {
-        learningRate = 0.2f;
-        epochs = 40;
-        batchSize = 0;
-        inputs = {
-            {.1f, .1f},
-            {.8f, .7f},
-            {.7f, .1f},
-            {.5f, .2f},
-            {.2f, .1f}};
-
-        targets = {
-            {.9f, .0f, .0f},         
-            {.9f, .0f, .9f},         
-            {.0f, .0f, .97f},                 
-            {.1f, .9f, .7f},                 
-            {.0f, .9f, .1f }};
-
-        AddLayer(hhLayerType::Input, 2, 0);
-        AddLayer(hhLayerType::Sigmoid, 9, 2);
-        AddLayer(hhLayerType::Sigmoid, 3, 9);
+        if (std::strcmp(argv[a], "--lockstep") == 0)
+            lockstep = true;
+        else if (std::strcmp(argv[a], "--grid") == 0 && a + 1 < argc)
+            gridSize = std::max(1, std::min(2048, std::atoi(argv[++a])));
     }
-};
 
-
-int main(int, char**)
-{
+    // the shape is fixed, so the compiled-in model runs it without dispatch or heap tensors
+    using ColorModel = hhStaticModel<hhInput<2>, hhSigmoid<9>, hhSigmoid<3>>;
     ColorTask task;
-    hhModel model;
-    model.Configure(task);
+    ColorModel model;
+    if (!model.Configure(task))
+        return 1;
+
+    // pick up where the last run stopped
+    if (model.Load("helper.hhm"))
+        printf("loaded helper.hhm\n");
 
     renderWindow rw;
 
-    const int gridSize = 80;
-    matrix outs(gridSize*gridSize);
-    for (auto&& o : outs)
-        o.resize(3, 0); // (r,g,b)
-    
-    bool running = 1;
-    while (running)
+    // one row per grid cell, (x,y) in and (r,g,b) out
+    tensor ins(gridSize*gridSize, 2);
+    tensor outs(gridSize*gridSize, 3);
+    for (int y=0; y < gridSize; y++)
     {
-        model.Train();
+        for (int x=0; x < gridSize; x++)
+        {
+            ins(y*gridSize + x, 0) = float(x)/gridSize;
+            ins(y*gridSize + x, 1) = float(y)/gridSize;
+        }
+    }
 
-        for (int y=0; y < gridSize; y++)
+    // the trainer publishes after every pass and never waits for a frame, the window predicts with the
+    // newest weights it finds and never waits for training
+    hhTripleBuffer<ColorModel::Snapshot> snapshots;
+    model.PublishSnapshot(snapshots);
+    ColorModel display;
+    display.activationMath = model.activationMath;
+
+    std::atomic<bool> training{true};
+    std::thread trainer;
+    if (!lockstep)
+    {
+        trainer = std::thread([&]()
         {
-            for (int x=0; x < gridSize; x++)
+            while (training.load(std::memory_order_relaxed))
             {
-                const column ins = {float(x)/gridSize, float(y)/gridSize};
-                outs[y*gridSize + x] = model.Predict(ins);
+                model.Train();
+                model.PublishSnapshot(snapshots);
             }
+        });
+    }
+
+    bool running = 1;
+    while (running)
+    {
+        if (lockstep)
+        {
+            model.Train();
+            model.PublishSnapshot(snapshots);
         }
 
+        if (display.TakeSnapshot(snapshots))
+            display.PredictBatch(ins, outs);
+
         rw.ProcessEvents(running);
 
         rw.BeginDisplay();
-        rw.DisplayTitle(model.numEpochs, model.lastTrainError, "Helper");
+        rw.DisplayTitle(display.numEpochs, display.lastTrainError, "Helper");
         rw.DisplayGrid(gridSize, outs);
         rw.EndDisplay();
     }
+
+    training.store(false, std::memory_order_relaxed);
+    if (trainer.joinable())
+        trainer.join();
+    model.Save("helper.hhm");
 }
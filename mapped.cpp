@@ -0,0 +1,107 @@
+#include "mapped.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// ---------------------------- mapped file ----------------------------
+
+hhMappedFile::~hhMappedFile()
+{
+    Close();
+}
+
+#if defined(_WIN32)
+
+bool hhMappedFile::Open(const char* filename, bool copyOnWrite)
+{
+    Close();
+
+    HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    file = handle;
+
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(handle, &length) || length.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    mapping = CreateFileMappingA(handle, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    data = static_cast<unsigned char*>(MapViewOfFile(mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+    if (data == nullptr)
+    {
+        Close();
+        return false;
+    }
+    size = size_t(length.QuadPart);
+    return true;
+}
+
+void hhMappedFile::Close()
+{
+    if (data != nullptr)
+        UnmapViewOfFile(data);
+    if (mapping != nullptr)
+        CloseHandle(mapping);
+    if (file != nullptr)
+        CloseHandle(file);
+    data = nullptr;
+    mapping = nullptr;
+    file = nullptr;
+    size = 0;
+}
+
+#else
+
+bool hhMappedFile::Open(const char* filename, bool copyOnWrite)
+{
+    Close();
+
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // the mapping keeps its own reference to the file
+    const int protection = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* ptr = mmap(nullptr, size_t(info.st_size), protection, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+
+    data = static_cast<unsigned char*>(ptr);
+    size = size_t(info.st_size);
+    return true;
+}
+
+void hhMappedFile::Close()
+{
+    if (data != nullptr)
+        munmap(data, size);
+    data = nullptr;
+    size = 0;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+
+// Memory mapping of a whole file. Pages are only brought in when touched,
+// so opening a large file costs nothing until its contents are read.
+class hhMappedFile
+{
+public:
+    hhMappedFile() = default;
+    ~hhMappedFile();
+
+    hhMappedFile(const hhMappedFile&) = delete;
+    hhMappedFile& operator=(const hhMappedFile&) = delete;
+
+    // returns false if the file cannot be opened or mapped. the mapping is read-only unless copyOnWrite
+    // is set, then writes land in private pages and never reach the file.
+    bool Open(const char* filename, bool copyOnWrite = false);
+    void Close();
+
+    unsigned char* Data() { return data; }
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    unsigned char* data = nullptr;
+    size_t size = 0;
+
+#if defined(_WIN32)
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
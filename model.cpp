@@ -1,9 +1,14 @@
 #include "model.h"
+#include "kernels.h"
+#include "gemm.h"
 
 #include <cassert>
 #include <numeric>
 #include <cmath>
 #include <random>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
 
 // ---------------------------- layers ----------------------------
 
@@ -12,41 +17,434 @@ hhLayer::hhLayer(int numNeurons, int numInputs)
     this->numNeurons = numNeurons;
     this->numInputs = numInputs;
 
-    activationValue.resize(numNeurons, 0.0f);
-    errors.resize(numNeurons, 0.0f);
+    activationValue.Resize(1, numNeurons, true);
+    errors.Resize(1, numNeurons, true);
 }
 
 // ---------------------------- Input ----------------------------
 
 hhInputLayer::hhInputLayer(int numNeurons, int numInputs) : hhLayer(numNeurons, numInputs)
 {
-    biases.resize(numNeurons, 1.0f);
+    biases.Resize(1, numNeurons, true);
+    biases.Fill(1.0f);
 }
     
-void hhInputLayer::Forward(const column& input)
+void hhInputLayer::Forward(const tensor& input)
 {
-    activationValue = input;
+    // the next layer reads the caller's rows in place, nothing downstream writes through this view
+    assert(input.cols == numNeurons);
+    activationValue = tensor::Wrap(const_cast<float*>(input.Data()), input.rows, input.cols, input.stride);
 }
 
 // ---------------------------- Dense ----------------------------
 
 
-hhDenseLayer::hhDenseLayer(int numNeurons, int numInputs) : hhLayer(numNeurons, numInputs)
+hhDenseLayer::hhDenseLayer(int numNeurons, int numInputs) : hhDenseLayer(numNeurons, numInputs, numNeurons, numInputs)
 {
-    weights.resize(numNeurons, column(numInputs));
-    biases.resize(numNeurons);
 }
 
-void hhDenseLayer::UpdateWeightsAndBiases(const hhLayer& previous, float learningRate)
+hhDenseLayer::hhDenseLayer(int numNeurons, int numInputs, int weightRows, int weightCols) : hhLayer(numNeurons, numInputs)
 {
+    weights.Resize(weightRows, weightCols, true);
+    biases.Resize(1, weightRows, true);
+    weightGradients.Resize(weightRows, weightCols, true);
+    biasGradients.Resize(1, weightRows, true);
+}
+
+// float32 to the 16-bit storage format
+static void narrowRow(const hhKernels& k, hhPrecision precision, const float* x, uint16_t* y, int n)
+{
+    if (precision == hhPrecision::BFloat16)
+        k.floatToBfloat16(x, y, n);
+    else
+        k.floatToHalf(x, y, n);
+}
+
+void hhDenseLayer::StoreWeights()
+{
+    if (precision == hhPrecision::Float32)
+    {
+        storedWeights.Resize(0, 0);
+        return;
+    }
+
+    storedWeights.Resize(weights.rows, weights.cols, true);
+    const hhKernels& k = activeKernels();
+    for (int n = 0; n < weights.rows; n++)
+    {
+        narrowRow(k, precision, weights[n], storedWeights[n], weights.cols);
+    }
+}
+
+void hhDenseLayer::ForwardLinear(const tensor& input, const hhGemmEpilogue& epilogue)
+{
+    if (quantized)
+    {
+        ForwardQuantized(input, epilogue);
+        return;
+    }
+
+    // [batch x numNeurons] = input [batch x numInputs] * weights^T
+    MultiplyWeights(input.rows, input.Data(), input.stride, activationValue.Data(), activationValue.stride, epilogue);
+}
+
+void hhDenseLayer::MultiplyWeights(int rows, const float* in, int ldi, float* out, int ldo, const hhGemmEpilogue& epilogue) const
+{
+    if (precision != hhPrecision::Float32)
+    {
+        gemm(false, true, rows, weights.rows, weights.cols,
+            1.0f, in, ldi,
+            storedWeights.Data(), storedWeights.stride, precision,
+            0.0f, out, ldo, epilogue);
+        return;
+    }
+
+    gemm(false, true, rows, weights.rows, weights.cols,
+        1.0f, in, ldi,
+        weights.Data(), weights.stride,
+        0.0f, out, ldo, epilogue);
+}
+
+void hhDenseLayer::PropagateErrors(hhLayer& previous) const
+{
+    // [batch x numInputs] = errors [batch x numNeurons] * weights [numNeurons x numInputs]
+    tensor& propagated = previous.errors;
+    propagated.Resize(errors.rows, numInputs, true);
+    if (precision != hhPrecision::Float32)
+    {
+        gemm(false, false, errors.rows, numInputs, numNeurons,
+            1.0f, errors.Data(), errors.stride,
+            storedWeights.Data(), storedWeights.stride, precision,
+            0.0f, propagated.Data(), propagated.stride);
+        return;
+    }
+
+    gemm(false, false, errors.rows, numInputs, numNeurons,
+        1.0f, errors.Data(), errors.stride,
+        weights.Data(), weights.stride,
+        0.0f, propagated.Data(), propagated.stride);
+}
+
+void hhDenseLayer::AccumulateGradients(const hhLayer& previous)
+{
+    assert(previous.activationValue.rows == errors.rows);
+
+    // [numNeurons x numInputs] = errors^T [numNeurons x batch] * previous [batch x numInputs]
+    gradientSamples = errors.rows;
+    const tensor& input = previous.activationValue;
+    gemm(true, false, numNeurons, numInputs, errors.rows,
+        1.0f, errors.Data(), errors.stride,
+        input.Data(), input.stride,
+        0.0f, weightGradients.Data(), weightGradients.stride);
+
+    const hhKernels& k = activeKernels();
+    biasGradients.Zero();
+    for (int b = 0; b < errors.rows; b++)
+    {
+        k.biasAdd(biasGradients[0], errors[b], numNeurons);
+    }
+}
+
+// copies the listed rows of from into the first rows of to, in order
+template <typename T>
+static void gatherRows(const hhTensor<T>& from, const std::vector<int>& rows, hhTensor<T>& to)
+{
+    assert(to.rows >= int(rows.size()) && to.cols == from.cols);
+    for (size_t j = 0; j < rows.size(); j++)
+        std::memcpy(to[int(j)], from[rows[j]], from.cols * sizeof(T));
+}
+
+// the most units, in percent of a layer, the gathered path takes on. above it the copies cost more than the
+// skipped rows save. a fused sweep over a single sample touches every weight just once, so there the copies
+// only pay off with fewer units live. measured with bench's backward-*-dead scenarios.
+const int maxLivePercent = 60;
+const int maxLivePercentSingle = 33;
+
+bool hhDenseLayer::GatherLiveUnits(int limitPercent)
+{
+    liveUnits.clear();
+    if (!sparseBackward || type != hhLayerType::Relu)
+        return false;
+
+    // the scratch is sized for the most units any call takes, so it is neither reallocated nor cleared as the
+    // count changes from batch to batch
+    const int capacity = numNeurons * maxLivePercent / 100;
+    const int maxLive = numNeurons * std::min(limitPercent, maxLivePercent) / 100;
+    liveUnits.reserve(capacity);
+    liveErrors.Resize(errors.rows, capacity, true);
+    liveRows.Resize(capacity, numInputs, true);
+    if (precision != hhPrecision::Float32)
+        liveStored.Resize(capacity, numInputs, true);
+
+    // a unit is dead for the batch when its relu was off for every sample
+    for (int n = 0; n < numNeurons; n++)
+    {
+        int b = 0;
+        while (b < errors.rows && errors[b][n] == 0.0f)
+            b++;
+        if (b == errors.rows)
+            continue;
+
+        // one live unit over the limit and the dense path takes the batch
+        if (int(liveUnits.size()) == maxLive)
+        {
+            liveUnits.clear();
+            return false;
+        }
+        liveUnits.push_back(n);
+    }
+
+    const int live = int(liveUnits.size());
+    for (int b = 0; b < errors.rows; b++)
+    {
+        const float* err = errors[b];
+        float* gathered = liveErrors[b];
+        for (int j = 0; j < live; j++)
+            gathered[j] = err[liveUnits[j]];
+    }
+    return true;
+}
+
+void hhDenseLayer::PropagateLiveErrors(hhLayer& previous)
+{
+    // [batch x numInputs] = liveErrors [batch x live] * weights [live x numInputs], the dead units' rows are never read
+    tensor& propagated = previous.errors;
+    propagated.Resize(errors.rows, numInputs, true);
+    const int live = int(liveUnits.size());
+    if (live == 0)
+    {
+        propagated.Zero();
+        return;
+    }
+
+    if (precision != hhPrecision::Float32)
+    {
+        gatherRows(storedWeights, liveUnits, liveStored);
+        gemm(false, false, errors.rows, numInputs, live,
+            1.0f, liveErrors.Data(), liveErrors.stride,
+            liveStored.Data(), liveStored.stride, precision,
+            0.0f, propagated.Data(), propagated.stride);
+        return;
+    }
+
+    gatherRows(weights, liveUnits, liveRows);
+    gemm(false, false, errors.rows, numInputs, live,
+        1.0f, liveErrors.Data(), liveErrors.stride,
+        liveRows.Data(), liveRows.stride,
+        0.0f, propagated.Data(), propagated.stride);
+}
+
+void hhDenseLayer::AccumulateLiveGradients(const hhLayer& previous)
+{
+    assert(previous.activationValue.rows == errors.rows);
+
+    // [live x numInputs] = liveErrors^T * previous, spread over the gradient rows afterwards. a dead unit's
+    // row is a sum of zeros, it is cleared instead.
+    gradientSamples = errors.rows;
+    const tensor& input = previous.activationValue;
+    const int live = int(liveUnits.size());
+    if (live > 0)
+    {
+        gemm(true, false, live, numInputs, errors.rows,
+            1.0f, liveErrors.Data(), liveErrors.stride,
+            input.Data(), input.stride,
+            0.0f, liveRows.Data(), liveRows.stride);
+    }
+
+    int j = 0;
     for (int n = 0; n < numNeurons; n++)
     {
-        for (int i = 0; i < numInputs; i++)
+        if (j < live && liveUnits[j] == n)
+            std::memcpy(weightGradients[n], liveRows[j++], numInputs * sizeof(float));
+        else
+            std::memset(weightGradients[n], 0, numInputs * sizeof(float));
+    }
+
+    // the dead units' entries of errors are zero
+    const hhKernels& k = activeKernels();
+    biasGradients.Zero();
+    for (int b = 0; b < errors.rows; b++)
+    {
+        k.biasAdd(biasGradients[0], errors[b], numNeurons);
+    }
+}
+
+float hhDenseLayer::Backward(hhLayer& previous, hhLayer* next, const tensor& targets)
+{
+    // hidden layers were handed their propagated errors by next's Backward
+    errors.Resize(activationValue.rows, numNeurons, true);
+    const float error = ComputeErrors(next, targets);
+
+    // nothing reads the input layer's errors
+    const bool propagates = previous.type != hhLayerType::Input;
+    if (GatherLiveUnits(maxLivePercent))
+    {
+        AccumulateLiveGradients(previous);
+        if (propagates)
+            PropagateLiveErrors(previous);
+        return error;
+    }
+
+    AccumulateGradients(previous);
+    if (propagates)
+        PropagateErrors(previous);
+    return error;
+}
+
+// weight block per denseBackward call, its inputs and propagated errors stay in L1 while the rows pass.
+// rows are a multiple of every kernel's tile height.
+const int backwardRows = 24;
+const int backwardCols = 128;
+
+float hhDenseLayer::BackwardUpdate(hhLayer& previous, hhLayer* next, const tensor& targets, float learningRate)
+{
+    // hidden layers were handed their propagated errors by next's sweep
+    errors.Resize(activationValue.rows, numNeurons, true);
+    const float error = ComputeErrors(next, targets);
+
+    // nothing reads the input layer's errors
+    float* propagated = nullptr;
+    if (previous.type != hhLayerType::Input)
+    {
+        previous.errors.Resize(errors.rows, previous.numNeurons, true);
+        previous.errors.Zero();
+        propagated = previous.errors.Data();
+    }
+
+    // with few units live their weight rows are swept as one gathered block and written back after, the dead
+    // ones neither change nor propagate anything
+    const bool sparse = GatherLiveUnits(errors.rows == 1 ? maxLivePercentSingle : maxLivePercent);
+    if (sparse)
+        gatherRows(weights, liveUnits, liveRows);
+    const tensor& sweptErrors = sparse ? liveErrors : errors;
+    tensor& swept = sparse ? liveRows : weights;
+    const int sweptRows = sparse ? int(liveUnits.size()) : numNeurons;
+
+    const tensor& input = previous.activationValue;
+    assert(input.rows == errors.rows);
+    const float rate = learningRate / std::max(1, errors.rows);
+    const hhKernels& k = activeKernels();
+    for (int c0 = 0; c0 < numInputs; c0 += backwardCols)
+    {
+        const int cols = std::min(backwardCols, numInputs - c0);
+        for (int r0 = 0; r0 < sweptRows; r0 += backwardRows)
         {
-            weights[n][i] -= learningRate * previous.activationValue[i] * errors[n];
+            const int rows = std::min(backwardRows, sweptRows - r0);
+            k.denseBackward(rows, cols, errors.rows,
+                sweptErrors.Data() + r0, sweptErrors.stride,
+                input.Data() + c0, input.stride,
+                propagated != nullptr ? propagated + c0 : nullptr, previous.errors.stride,
+                swept[r0] + c0, swept.stride, rate);
+
+            if (precision == hhPrecision::Float32)
+                continue;
+            for (int r = r0; r < r0 + rows; r++)
+                narrowRow(k, precision, swept[r] + c0, storedWeights[sparse ? liveUnits[r] : r] + c0, cols);
         }
-        biases[n] -= learningRate * errors[n];
     }
+
+    if (sparse)
+        for (size_t j = 0; j < liveUnits.size(); j++)
+            std::memcpy(weights[liveUnits[j]], liveRows[int(j)], numInputs * sizeof(float));
+
+    for (int b = 0; b < errors.rows; b++)
+    {
+        k.axpy(-rate, errors[b], biases[0], numNeurons);
+    }
+    return error;
+}
+
+// one rule over a row of parameters and the matching rows of its moments
+static void updateRow(const hhKernels& k, const hhUpdateStep& step, float* w, const float* g, float* velocity, float* squares, int n)
+{
+    switch (step.type)
+    {
+        case hhOptimizerType::Sgd:
+            if (step.decay != 0.0f)
+                k.axpy(-step.rate * step.decay, w, w, n);
+            k.axpy(-step.rate * step.scale, g, w, n);
+            break;
+        case hhOptimizerType::Momentum:
+        case hhOptimizerType::Nesterov:
+            k.momentumUpdate(step, w, g, velocity, n);
+            break;
+        case hhOptimizerType::Adam:
+        case hhOptimizerType::AdamW:
+            k.adamUpdate(step, w, g, velocity, squares, n);
+            break;
+    }
+}
+
+void hhDenseLayer::UpdateWeightsAndBiases(const hhUpdateStep& update)
+{
+    // gradients are summed over the batch, so scale down to the mean
+    hhUpdateStep step = update;
+    step.scale = 1.0f / std::max(1, gradientSamples);
+
+    // Resize keeps moments of the right shape, the first step that needs them starts from zeros
+    const bool velocities = step.type != hhOptimizerType::Sgd;
+    const bool squares = step.type == hhOptimizerType::Adam || step.type == hhOptimizerType::AdamW;
+    if (velocities)
+    {
+        weightVelocities.Resize(weights.rows, weights.cols, true);
+        biasVelocities.Resize(1, biases.cols, true);
+    }
+    if (squares)
+    {
+        weightSquares.Resize(weights.rows, weights.cols, true);
+        biasSquares.Resize(1, biases.cols, true);
+    }
+
+    // in a model's arena the biases follow the weights in every block, so one sweep covers both, row padding
+    // included. its gradients are zero, which keeps it at zero under every rule.
+    const hhKernels& k = activeKernels();
+    if (inArena && (!velocities || weightVelocities.IsView()) && (!squares || weightSquares.IsView()))
+    {
+        const int span = weights.rows * weights.stride + biases.stride;
+        updateRow(k, step, weights.Data(), weightGradients.Data(),
+            velocities ? weightVelocities.Data() : nullptr, squares ? weightSquares.Data() : nullptr, span);
+        if (precision != hhPrecision::Float32)
+            for (int n = 0; n < weights.rows; n++)
+                narrowRow(k, precision, weights[n], storedWeights[n], weights.cols);
+        return;
+    }
+
+    // the 16-bit copy is refreshed row by row while the updated master row is still in cache
+    for (int n = 0; n < weights.rows; n++)
+    {
+        updateRow(k, step, weights[n], weightGradients[n],
+            velocities ? weightVelocities[n] : nullptr, squares ? weightSquares[n] : nullptr, weights.cols);
+        if (precision != hhPrecision::Float32)
+            narrowRow(k, precision, weights[n], storedWeights[n], weights.cols);
+    }
+    updateRow(k, step, biases[0], biasGradients[0],
+        velocities ? biasVelocities[0] : nullptr, squares ? biasSquares[0] : nullptr, biases.cols);
+}
+
+void hhDenseLayer::ResetMoments()
+{
+    weightVelocities.Zero();
+    biasVelocities.Zero();
+    weightSquares.Zero();
+    biasSquares.Zero();
+}
+
+void hhDenseLayer::ReduceGradients(const hhLayer& other)
+{
+    const hhDenseLayer& replica = static_cast<const hhDenseLayer&>(other);
+    const hhKernels& k = activeKernels();
+    gradientSamples += replica.gradientSamples;
+    if (inArena && replica.inArena)
+    {
+        k.axpy(1.0f, replica.weightGradients.Data(), weightGradients.Data(), weights.rows * weights.stride + biases.stride);
+        return;
+    }
+
+    for (int n = 0; n < weights.rows; n++)
+    {
+        k.axpy(1.0f, replica.weightGradients[n], weightGradients[n], weights.cols);
+    }
+    k.axpy(1.0f, replica.biasGradients[0], biasGradients[0], biases.cols);
 }
 
 // ---------------------------- Sigmoid ----------------------------
@@ -64,44 +462,49 @@ hhSigmoidLayer::hhSigmoidLayer(int numNeurons, int numInputs) : hhDenseLayer(num
         {
             weights[i][j] = distribution(generator);
         }
-        biases[i] = distribution(generator);
+        biases[0][i] = distribution(generator);
     }
 }
 
-void hhSigmoidLayer::Forward(const column& input)
+void hhSigmoidLayer::Forward(const tensor& input)
 {
-    assert(input.size() == numInputs);
-    for (int n = 0; n < numNeurons; n++)
+    assert(input.cols == numInputs);
+    activationValue.Resize(input.rows, numNeurons, true);
+
+    // the fast sigmoid runs on each gemm tile as it completes, the precise one needs its own pass
+    const bool fast = activationMath == hhActivationMath::Fast;
+    ForwardLinear(input, { fast ? hhEpilogueOp::BiasSigmoid : hhEpilogueOp::Bias, biases[0] });
+    if (fast)
+        return;
+
+    for (int b = 0; b < input.rows; b++)
     {
-        float raw = std::inner_product(input.begin(), input.end(), weights[n].begin(), 0.0f) + biases[n];
-        activationValue[n] = 1.0f / (1.0f + exp(-raw));
+        float* out = activationValue[b];
+        for (int n = 0; n < numNeurons; n++)
+        {
+            out[n] = 1.0f / (1.0f + exp(-out[n]));
+        }
     }
 }
 
-float hhSigmoidLayer::Backward(const hhLayer& previous, hhLayer* next, float learningRate, const column& targets)
+float hhSigmoidLayer::ComputeErrors(const hhLayer* next, const tensor& targets)
 {
     float error = 0.0f;
-    for (int n = 0; n < numNeurons; n++)
+    for (int b = 0; b < errors.rows; b++)
     {
-        const float predicted = activationValue[n];
-        const float dp = predicted * (1.0f - predicted);
-        if (next == nullptr) // output layer
-        {
-            errors[n] = (predicted - targets[n]) * 2 * dp;
-        }
-        else
+        const float* predicted = activationValue[b];
+        float* err = errors[b];
+        for (int n = 0; n < numNeurons; n++)
         {
-            errors[n] = 0.0f;
-            for (int k = 0; k < next->numNeurons; k++)
+            const float dp = predicted[n] * (1.0f - predicted[n]);
+            if (next == nullptr) // output layer
             {
-                errors[n] += next->errors[k] * next->weights[k][n];
+                err[n] = (predicted[n] - targets[b][n]) * 2 * dp;
             }
+            err[n] *= dp;
+            error += err[n] * err[n];
         }
-        errors[n] *= dp;
-        error += errors[n] * errors[n];
     }
-
-    UpdateWeightsAndBiases(previous, learningRate);
     return error;
 }
 
@@ -121,41 +524,34 @@ hhReluLayer::hhReluLayer(int numNeurons, int numInputs) : hhDenseLayer(numNeuron
         {
             weights[n][j] = distribution(generator);
         }
-        biases[n] = distribution(generator);
+        biases[0][n] = distribution(generator);
     }
 }
 
-void hhReluLayer::Forward(const column& input)
+void hhReluLayer::Forward(const tensor& input)
 {
-    assert(input.size() == numInputs);
-    for (int n = 0; n < numNeurons; n++)
-    {
-        float raw = std::inner_product(input.begin(), input.end(), weights[n].begin(), 0.0f) + biases[n];
-        activationValue[n] = std::max(0.0f, raw);
-    }
+    assert(input.cols == numInputs);
+    activationValue.Resize(input.rows, numNeurons, true);
+
+    ForwardLinear(input, { hhEpilogueOp::BiasRelu, biases[0] });
 }
 
-float hhReluLayer::Backward(const hhLayer& previous, hhLayer* next, float learningRate, const column& targets)
+float hhReluLayer::ComputeErrors(const hhLayer* next, const tensor& targets)
 {
     float error = 0.0f;
-    for (int i = 0; i < numNeurons; i++)
+    for (int b = 0; b < errors.rows; b++)
     {
-        const float predicted = activationValue[i];
-        if (next == nullptr) // output layer
+        const float* predicted = activationValue[b];
+        float* err = errors[b];
+        for (int i = 0; i < numNeurons; i++)
         {
-            errors[i] = (targets[i] - predicted) * (predicted > 0.0f ? 1.0f : 0.0f);
-        }
-        else
-        {
-            errors[i] = 0.0f;
-            for (int j = 0; j < next->numNeurons; j++)
+            if (next == nullptr) // output layer
             {
-                errors[i] += next->errors[j] * next->weights[j][i];
+                err[i] = (predicted[i] - targets[b][i]);
             }
-            errors[i] *= (predicted > 0.0f ? 1.0f : 0.0f);
+            err[i] *= (predicted[i] > 0.0f ? 1.0f : 0.0f);
         }
     }
-    UpdateWeightsAndBiases(previous, learningRate);
     return error;
 }
 
@@ -166,104 +562,556 @@ hhSoftmaxLayer::hhSoftmaxLayer(int numNeurons, int numInputs) : hhDenseLayer(num
 {
 }
 
-void hhSoftmaxLayer::Forward(const column& input)
+void hhSoftmaxLayer::Forward(const tensor& input)
 {
-    float sum = 0.0f;
-    for (int i = 0; i < numNeurons; i++)
+    assert(input.cols == numInputs);
+    activationValue.Resize(input.rows, numNeurons, true);
+
+    // the bias goes on per tile, softmax needs the whole row
+    ForwardLinear(input, { hhEpilogueOp::Bias, biases[0] });
+
+    const hhKernels& k = activeKernels();
+    for (int b = 0; b < input.rows; b++)
     {
-        float raw = std::inner_product(input.begin(), input.end(), weights[i].begin(), 0.0f) + biases[i];
-        activationValue[i] = exp(raw);
-        sum += activationValue[i];
+        float* out = activationValue[b];
+        if (activationMath == hhActivationMath::Fast)
+        {
+            k.fastSoftmax(out, out, numNeurons);
+            continue;
+        }
+
+        // subtract the max so large logits cannot overflow exp
+        const float highest = *std::max_element(out, out + numNeurons);
+        float sum = 0.0f;
+        for (int i = 0; i < numNeurons; i++)
+        {
+            out[i] = exp(out[i] - highest);
+            sum += out[i];
+        }
+
+        for (int i = 0; i < numNeurons; i++)
+        {
+            out[i] /= sum;
+        }
     }
+}
 
-    for (int i = 0; i < numNeurons; i++)
+float hhSoftmaxLayer::ComputeErrors(const hhLayer* next, const tensor& targets)
+{
+    float error = 0.0f;
+    if (next == nullptr) // output layer, cross-entropy gradient
     {
-        activationValue[i] /= sum;
+        for (int b = 0; b < errors.rows; b++)
+        {
+            const float* predicted = activationValue[b];
+            float* err = errors[b];
+            for (int i = 0; i < numNeurons; i++)
+            {
+                err[i] = (predicted[i] - targets[b][i]);
+            }
+        }
     }
+    return error;
 }
 
-float hhSoftmaxLayer::Backward(const hhLayer& previous, hhLayer* next, float learningRate, const column& targets)
+// ---------------------------- Conv2D ----------------------------
+
+hhConv2DLayer::hhConv2DLayer(const hhConvShape& shape)
+    : hhDenseLayer(shape.OutputSize(), shape.InputSize(), shape.filters, shape.PatchSize())
 {
-     float error = 0.0f;
-    for (int i = 0; i < numNeurons; i++)
+    this->shape = shape;
+    pointwise = shape.kernel == 1 && shape.stride == 1 && shape.padding == 0;
+
+    // scaled by the window size so deep stacks of relu filters neither shrink nor blow up their activations.
+    // biases start at zero.
+    std::default_random_engine generator;
+    const float range = std::sqrt(6.0f / shape.PatchSize());
+    std::uniform_real_distribution<float> distribution(-range, range);
+    for (int f = 0; f < weights.rows; f++)
     {
-        const float predicted = activationValue[i];
-        if (next == nullptr) // output layer
+        for (int j = 0; j < weights.cols; j++)
         {
-            errors[i] = (targets[i] - predicted);
+            weights[f][j] = distribution(generator);
         }
-        else
+    }
+}
+
+double hhConv2DLayer::MultiplyAdds() const
+{
+    return double(weights.Size()) * shape.OutputHeight() * shape.OutputWidth();
+}
+
+// the outputs along one axis whose window element at offset lands inside the image, [first, last)
+static void insideRange(const hhConvShape& shape, int offset, int size, int outSize, int& first, int& last)
+{
+    const int lead = shape.padding - offset;
+    const int trail = size - 1 + shape.padding - offset;
+    first = lead > 0 ? (lead + shape.stride - 1) / shape.stride : 0;
+    last = trail >= 0 ? std::min(outSize, trail / shape.stride + 1) : 0;
+    last = std::max(first, last);
+}
+
+// a stride 1 convolution that keeps the width reads every window element as the whole plane shifted by one
+// offset, so a row of columns is one copy with the columns that wrapped around the edges cleared
+static bool shiftsPlane(const hhConvShape& shape)
+{
+    return shape.stride == 1 && shape.OutputWidth() == shape.width;
+}
+
+const float* hhConv2DLayer::GatherWindows(const float* image, int& ld)
+{
+    const int outHeight = shape.OutputHeight();
+    const int outWidth = shape.OutputWidth();
+    if (pointwise)
+    {
+        ld = outHeight * outWidth;
+        return image;
+    }
+
+    columns.Resize(shape.PatchSize(), outHeight * outWidth, true);
+    ld = columns.stride;
+
+    // row (c, ky, kx) holds that window element for every output pixel, each output row of it is a
+    // strided run of one input row
+    for (int c = 0; c < shape.channels; c++)
+    {
+        const float* plane = image + size_t(c) * shape.height * shape.width;
+        for (int ky = 0; ky < shape.kernel; ky++)
         {
-            errors[i] = 0.0f;
-            for (int j = 0; j < next->numNeurons; j++)
+            for (int kx = 0; kx < shape.kernel; kx++)
             {
-                errors[i] += next->errors[j] * next->weights[j][i];
+                float* row = columns[(c * shape.kernel + ky) * shape.kernel + kx];
+                int first, last, top, bottom;
+                insideRange(shape, kx, shape.width, outWidth, first, last);
+                insideRange(shape, ky, shape.height, outHeight, top, bottom);
+                std::memset(row, 0, top * outWidth * sizeof(float));
+                std::memset(row + bottom * outWidth, 0, (outHeight - bottom) * outWidth * sizeof(float));
+                if (top == bottom)
+                    continue;
+
+                if (shiftsPlane(shape))
+                {
+                    const int begin = top * outWidth + first;
+                    const int end = (bottom - 1) * outWidth + last;
+                    const int shift = (ky - shape.padding) * shape.width + kx - shape.padding;
+                    std::memcpy(row + begin, plane + begin + shift, (end - begin) * sizeof(float));
+                    for (int oy = top; oy < bottom; oy++)
+                    {
+                        std::fill(row + oy * outWidth, row + oy * outWidth + first, 0.0f);
+                        std::fill(row + oy * outWidth + last, row + (oy + 1) * outWidth, 0.0f);
+                    }
+                    continue;
+                }
+
+                for (int oy = top; oy < bottom; oy++)
+                {
+                    float* out = row + oy * outWidth;
+                    const float* in = plane + size_t(oy * shape.stride - shape.padding + ky) * shape.width - shape.padding + kx;
+                    std::memset(out, 0, first * sizeof(float));
+                    if (shape.stride == 1)
+                        std::memcpy(out + first, in + first, (last - first) * sizeof(float));
+                    else
+                        for (int ox = first; ox < last; ox++)
+                            out[ox] = in[ox * shape.stride];
+                    std::memset(out + last, 0, (outWidth - last) * sizeof(float));
+                }
             }
         }
     }
-    
-    UpdateWeightsAndBiases(previous, learningRate);
-    return error;
+    return columns.Data();
 }
 
-// ---------------------------- model ----------------------------
+void hhConv2DLayer::ScatterWindows(float* image)
+{
+    const int outHeight = shape.OutputHeight();
+    const int outWidth = shape.OutputWidth();
+    const hhKernels& k = activeKernels();
+    for (int c = 0; c < shape.channels; c++)
+    {
+        float* plane = image + size_t(c) * shape.height * shape.width;
+        for (int ky = 0; ky < shape.kernel; ky++)
+        {
+            for (int kx = 0; kx < shape.kernel; kx++)
+            {
+                float* row = columnErrors[(c * shape.kernel + ky) * shape.kernel + kx];
+                int first, last, top, bottom;
+                insideRange(shape, kx, shape.width, outWidth, first, last);
+                insideRange(shape, ky, shape.height, outHeight, top, bottom);
+                if (top == bottom)
+                    continue;
 
-hhLayer* hhModel::AddLayer(hhLayerType type, int numNeurons, int numInputs)
+                // errors of the wrapped columns belong to the padding, clearing them lets one add cover the plane
+                if (shiftsPlane(shape))
+                {
+                    for (int oy = top; oy < bottom; oy++)
+                    {
+                        std::fill(row + oy * outWidth, row + oy * outWidth + first, 0.0f);
+                        std::fill(row + oy * outWidth + last, row + (oy + 1) * outWidth, 0.0f);
+                    }
+                    const int begin = top * outWidth + first;
+                    const int end = (bottom - 1) * outWidth + last;
+                    const int shift = (ky - shape.padding) * shape.width + kx - shape.padding;
+                    k.axpy(1.0f, row + begin, plane + begin + shift, end - begin);
+                    continue;
+                }
+
+                for (int oy = top; oy < bottom; oy++)
+                {
+                    const float* from = row + oy * outWidth;
+                    float* out = plane + size_t(oy * shape.stride - shape.padding + ky) * shape.width - shape.padding + kx;
+                    if (shape.stride == 1)
+                        k.axpy(1.0f, from + first, out + first, last - first);
+                    else
+                        for (int ox = first; ox < last; ox++)
+                            out[ox * shape.stride] += from[ox];
+                }
+            }
+        }
+    }
+}
+
+void hhConv2DLayer::Forward(const tensor& input)
 {
-    if (numNeurons < 1 || numInputs < 0)
-        return nullptr;
+    assert(input.cols == numInputs);
+    activationValue.Resize(input.rows, numNeurons, true);
 
-    hhLayer* layer = nullptr;
-    switch (type)
+    // a sample's output is [filters x pixels], one plane per filter. the bias is per row of that product,
+    // which the gemm epilogue has no form for, so it goes on with the relu while the plane is still in cache.
+    const int pixels = shape.OutputHeight() * shape.OutputWidth();
+    for (int b = 0; b < input.rows; b++)
     {
-        case hhLayerType::Input:
+        int ld = 0;
+        const float* windows = GatherWindows(input[b], ld);
+        float* out = activationValue[b];
+        gemm(false, false, shape.filters, pixels, shape.PatchSize(),
+            1.0f, weights.Data(), weights.stride,
+            windows, ld,
+            0.0f, out, pixels);
+
+        for (int f = 0; f < shape.filters; f++, out += pixels)
         {
-            if (layers.size() > 0)
-                return nullptr;
-            layer = new hhInputLayer(numNeurons, numInputs);
-            break;
+            const float bias = biases[0][f];
+            for (int p = 0; p < pixels; p++)
+                out[p] = std::max(0.0f, out[p] + bias);
         }
+    }
+}
 
-        case hhLayerType::Sigmoid:
+float hhConv2DLayer::ComputeErrors(const hhLayer* next, const tensor& targets)
+{
+    for (int b = 0; b < errors.rows; b++)
+    {
+        const float* predicted = activationValue[b];
+        float* err = errors[b];
+        for (int i = 0; i < numNeurons; i++)
         {
-            if (layers.size() == 0)
-                return nullptr;
-            if (layers.back()->numNeurons != numInputs)
-                return nullptr;
+            if (next == nullptr) // output layer
+            {
+                err[i] = (predicted[i] - targets[b][i]);
+            }
+            err[i] *= (predicted[i] > 0.0f ? 1.0f : 0.0f);
+        }
+    }
+    return 0.0f;
+}
 
-            layer = new hhSigmoidLayer(numNeurons, numInputs);
-            break;
+float hhConv2DLayer::Backward(hhLayer& previous, hhLayer* next, const tensor& targets)
+{
+    errors.Resize(activationValue.rows, numNeurons, true);
+    const float error = ComputeErrors(next, targets);
+
+    // nothing reads the input layer's errors
+    const bool propagates = previous.type != hhLayerType::Input;
+    if (propagates)
+    {
+        previous.errors.Resize(errors.rows, numInputs, true);
+        previous.errors.Zero();
+    }
+
+    const tensor& input = previous.activationValue;
+    assert(input.rows == errors.rows);
+    const int pixels = shape.OutputHeight() * shape.OutputWidth();
+    const int patch = shape.PatchSize();
+    const int filters = shape.filters;
+    weightGradients.Zero();
+    biasGradients.Zero();
+    gradientSamples = errors.rows;
+
+    // the windows are gathered again rather than kept from Forward, one sample's worth stays in cache
+    for (int b = 0; b < errors.rows; b++)
+    {
+        const float* err = errors[b];
+        int ld = 0;
+        const float* windows = GatherWindows(input[b], ld);
+
+        // [filters x patch] += err [filters x pixels] * windows^T [pixels x patch]
+        gemm(false, true, filters, patch, pixels,
+            1.0f, err, pixels,
+            windows, ld,
+            1.0f, weightGradients.Data(), weightGradients.stride);
+        for (int f = 0; f < filters; f++)
+        {
+            const float* plane = err + size_t(f) * pixels;
+            float sum = 0.0f;
+            for (int p = 0; p < pixels; p++)
+                sum += plane[p];
+            biasGradients[0][f] += sum;
         }
 
-        case hhLayerType::Relu:
+        if (!propagates)
+            continue;
+
+        // [patch x pixels] = weights^T [patch x filters] * err [filters x pixels], then back onto the pixels.
+        // a pointwise layer's windows are its input planes, so they are written in place.
+        if (pointwise)
         {
-            if (layers.size() == 0)
-                return nullptr;
-            if (layers.back()->numNeurons != numInputs)
-                return nullptr;
+            gemm(true, false, patch, pixels, filters,
+                1.0f, weights.Data(), weights.stride,
+                err, pixels,
+                0.0f, previous.errors[b], pixels);
+            continue;
+        }
+        columnErrors.Resize(patch, pixels, true);
+        gemm(true, false, patch, pixels, filters,
+            1.0f, weights.Data(), weights.stride,
+            err, pixels,
+            0.0f, columnErrors.Data(), columnErrors.stride);
+        ScatterWindows(previous.errors[b]);
+    }
+    return error;
+}
 
-            layer = new hhReluLayer(numNeurons, numInputs);
-            break;
+float hhConv2DLayer::BackwardUpdate(hhLayer& previous, hhLayer* next, const tensor& targets, float learningRate)
+{
+    // every filter weight is shared by all pixels of the batch, so the gradient is summed before the update
+    const float error = Backward(previous, next, targets);
+    hhUpdateStep sgd;
+    sgd.rate = learningRate;
+    UpdateWeightsAndBiases(sgd);
+    return error;
+}
+
+// ---------------------------- MaxPool ----------------------------
+
+hhMaxPoolLayer::hhMaxPoolLayer(const hhConvShape& shape) : hhLayer(shape.OutputSize(), shape.InputSize())
+{
+    this->shape = shape;
+}
+
+void hhMaxPoolLayer::Forward(const tensor& input)
+{
+    assert(input.cols == numInputs);
+    activationValue.Resize(input.rows, numNeurons, true);
+    winners.Resize(input.rows, numNeurons, true);
+
+    const int outHeight = shape.OutputHeight();
+    const int outWidth = shape.OutputWidth();
+    const int planeSize = shape.height * shape.width;
+    for (int b = 0; b < input.rows; b++)
+    {
+        const float* image = input[b];
+        float* out = activationValue[b];
+        int32_t* won = winners[b];
+        for (int c = 0; c < shape.channels; c++)
+        {
+            const int plane = c * planeSize;
+            for (int oy = 0; oy < outHeight; oy++)
+            {
+                for (int ox = 0; ox < outWidth; ox++, out++, won++)
+                {
+                    // windows never overhang, the corner seeds the max
+                    const int corner = plane + oy * shape.stride * shape.width + ox * shape.stride;
+                    float highest = image[corner];
+                    int at = corner;
+                    for (int ky = 0; ky < shape.kernel; ky++)
+                    {
+                        const int row = corner + ky * shape.width;
+                        for (int kx = 0; kx < shape.kernel; kx++)
+                        {
+                            if (image[row + kx] > highest)
+                            {
+                                highest = image[row + kx];
+                                at = row + kx;
+                            }
+                        }
+                    }
+                    *out = highest;
+                    *won = at;
+                }
+            }
         }
+    }
+}
 
-        case hhLayerType::Softmax:
+float hhMaxPoolLayer::Backward(hhLayer& previous, hhLayer* next, const tensor& targets)
+{
+    errors.Resize(activationValue.rows, numNeurons, true);
+    if (next == nullptr) // output layer
+    {
+        for (int b = 0; b < errors.rows; b++)
         {
-            if (layers.size() == 0)
-                return nullptr;
-            if (layers.back()->numNeurons != numInputs)
-                return nullptr;
+            for (int i = 0; i < numNeurons; i++)
+                errors[b][i] = activationValue[b][i] - targets[b][i];
+        }
+    }
+    if (previous.type == hhLayerType::Input)
+        return 0.0f;
 
-            layer = new hhSoftmaxLayer(numNeurons, numInputs);
-            break;
+    // the max passes its error to the input it came from, the rest of the window gets none
+    previous.errors.Resize(errors.rows, numInputs, true);
+    previous.errors.Zero();
+    for (int b = 0; b < errors.rows; b++)
+    {
+        const float* err = errors[b];
+        const int32_t* won = winners[b];
+        float* propagated = previous.errors[b];
+        for (int i = 0; i < numNeurons; i++)
+        {
+            propagated[won[i]] += err[i];
         }
-        default:
-            break;
     }
+    return 0.0f;
+}
+
+float hhMaxPoolLayer::BackwardUpdate(hhLayer& previous, hhLayer* next, const tensor& targets, float learningRate)
+{
+    return Backward(previous, next, targets);
+}
+
+// ---------------------------- model ----------------------------
+
+// arena blocks, the parameters are always block 0 and the main stack's gradients follow
+const int gradientBlock = 1;
 
-    layers.push_back(layer);
+static std::unique_ptr<hhLayer> createLayer(hhLayerType type, int numNeurons, int numInputs, const hhConvShape& shape)
+{
+    std::unique_ptr<hhLayer> layer;
+    switch (type)
+    {
+        case hhLayerType::Input: layer.reset(new hhInputLayer(numNeurons, numInputs)); break;
+        case hhLayerType::Sigmoid: layer.reset(new hhSigmoidLayer(numNeurons, numInputs)); break;
+        case hhLayerType::Relu: layer.reset(new hhReluLayer(numNeurons, numInputs)); break;
+        case hhLayerType::Softmax: layer.reset(new hhSoftmaxLayer(numNeurons, numInputs)); break;
+        case hhLayerType::Conv2D: layer.reset(new hhConv2DLayer(shape)); break;
+        case hhLayerType::MaxPool: layer.reset(new hhMaxPoolLayer(shape)); break;
+        default: return nullptr;
+    }
+    layer->type = type;
     return layer;
 }
 
+hhLayer* hhModel::AddLayer(hhLayerType type, int numNeurons, int numInputs)
+{
+    if (isWindowed(type))
+        return nullptr;
+    return AppendLayer(type, numNeurons, numInputs, hhConvShape());
+}
+
+hhLayer* hhModel::AddLayer(hhLayerType type, const hhConvShape& shape)
+{
+    if (!isWindowed(type) || !shape.IsValid())
+        return nullptr;
+    if (type == hhLayerType::MaxPool && (shape.padding != 0 || shape.filters != shape.channels))
+        return nullptr;
+    return AppendLayer(type, shape.OutputSize(), shape.InputSize(), shape);
+}
+
+hhLayer* hhModel::AppendLayer(hhLayerType type, int numNeurons, int numInputs, const hhConvShape& shape)
+{
+    if (numNeurons < 1 || numInputs < 0)
+        return nullptr;
+
+    if (type == hhLayerType::Input)
+    {
+        if (layers.size() > 0)
+            return nullptr;
+    }
+    else
+    {
+        if (layers.size() == 0)
+            return nullptr;
+        if (layers.back()->numNeurons != numInputs)
+            return nullptr;
+    }
+
+    std::unique_ptr<hhLayer> layer = createLayer(type, numNeurons, numInputs, shape);
+    if (layer == nullptr)
+        return nullptr;
+
+    if (task != nullptr)
+    {
+        layer->activationMath = task->activationMath;
+        if (type != hhLayerType::Conv2D)
+            layer->precision = task->precision;
+        layer->sparseBackward = task->sparseBackward;
+        arena.useHugePages = task->hugePages;
+    }
+
+    // weights then biases, in the order a checkpoint stores them. the constructor's values are copied
+    // into the arena as it grows.
+    layer->arenaOffset = arena.Place(layer->weights.rows, layer->weights.cols);
+    arena.Place(1, layer->biases.cols);
+    layer->inArena = true;
+    layers.push_back(std::move(layer));
+    arena.Grow(std::max(arena.Blocks(), gradientBlock + 1));
+    BindArena();
+
+    hhLayer* added = layers.back().get();
+    if (hasWeights(type))
+        static_cast<hhDenseLayer*>(added)->StoreWeights();
+    stats.layers.emplace_back();
+    return added;
+}
+
+// points t at its place in block, copying its values over while it still owns them
+static void bindTensor(hhParameterArena& arena, tensor& t, int block, size_t offset, int rows, int cols)
+{
+    tensor view = arena.View(block, offset, rows, cols);
+    if (!t.IsView() && t.rows == rows && t.cols == cols)
+    {
+        for (int r = 0; r < rows; r++)
+            std::memcpy(view[r], t[r], cols * sizeof(float));
+    }
+    t = std::move(view);
+}
+
+// parameters in block 0 for every stack, gradients in the stack's own block, moments for the main one only
+static void bindLayer(hhParameterArena& arena, hhLayer& layer, int gradients, int velocities, int squares)
+{
+    const int rows = layer.weights.rows, cols = layer.weights.cols, count = layer.biases.cols;
+    const size_t weightsAt = layer.arenaOffset;
+    const size_t biasesAt = weightsAt + size_t(rows) * layer.weights.stride;
+    bindTensor(arena, layer.weights, 0, weightsAt, rows, cols);
+    bindTensor(arena, layer.biases, 0, biasesAt, 1, count);
+    if (!hasWeights(layer.type))
+        return;
+
+    hhDenseLayer& dense = static_cast<hhDenseLayer&>(layer);
+    bindTensor(arena, dense.weightGradients, gradients, weightsAt, rows, cols);
+    bindTensor(arena, dense.biasGradients, gradients, biasesAt, 1, count);
+    if (velocities >= 0)
+    {
+        bindTensor(arena, dense.weightVelocities, velocities, weightsAt, rows, cols);
+        bindTensor(arena, dense.biasVelocities, velocities, biasesAt, 1, count);
+    }
+    if (squares >= 0)
+    {
+        bindTensor(arena, dense.weightSquares, squares, weightsAt, rows, cols);
+        bindTensor(arena, dense.biasSquares, squares, biasesAt, 1, count);
+    }
+}
+
+void hhModel::BindArena()
+{
+    for (const std::unique_ptr<hhLayer>& layer : layers)
+        bindLayer(arena, *layer, gradientBlock, velocityBlock, squareBlock);
+    for (size_t r = 0; r < replicas.size(); r++)
+    {
+        for (const std::unique_ptr<hhLayer>& layer : replicas[r])
+            bindLayer(arena, *layer, replicaBlocks[r], -1, -1);
+    }
+}
+
 void hhModel::Configure(hhTask& task)
 {
     this->task = &task;
@@ -271,77 +1119,533 @@ void hhModel::Configure(hhTask& task)
 
     for (auto& layer : task.layers)
     {
-        AddLayer(layer.type, layer.numNeurons, layer.numInputs);
+        if (isWindowed(layer.type))
+            AddLayer(layer.type, layer.shape);
+        else
+            AddLayer(layer.type, layer.numNeurons, layer.numInputs);
     }
 
-    indicies.resize(task.inputs.size());
+    indicies.resize(task.NumSamples());
     std::iota(indicies.begin(), indicies.end(), 0);
+
+    shuffler.seed(task.seed != 0 ? task.seed : std::random_device()());
+}
+
+// ---------------------------- stats ----------------------------
+
+// the entry of layer i, nullptr when stats are compiled out, switched off or the stack is not timed.
+// every counter below is skipped on nullptr, so with HH_STATS=0 they fold away.
+static hhLayerStats* layerStats(hhModelStats* stats, size_t i)
+{
+    return HH_STATS && stats != nullptr && stats->layerTiming ? &stats->layers[i] : nullptr;
+}
+
+// bytes per weight as Forward reads them
+static double storedWeightBytes(const hhLayer& layer)
+{
+    if (hasWeights(layer.type) && static_cast<const hhDenseLayer&>(layer).quantized)
+        return 1.0;
+    return layer.precision == hhPrecision::Float32 ? 4.0 : 2.0;
+}
+
+static void countForward(hhLayerStats* s, const hhLayer& layer, int batch)
+{
+    if (s == nullptr)
+        return;
+
+    const double in = layer.numInputs, out = layer.numNeurons, weights = double(layer.weights.Size());
+    s->forwardSamples += batch;
+    if (layer.type == hhLayerType::Input)
+    {
+        s->forwardBytes += 2.0 * batch * out * sizeof(float);
+        return;
+    }
+    s->forwardFlops += 2.0 * batch * layer.MultiplyAdds();
+    s->forwardBytes += weights * storedWeightBytes(layer) + (batch * (in + out) + layer.biases.cols) * sizeof(float);
+}
+
+// the fused sweep: gradient and update of every weight, propagation unless previous is the input layer
+static void countBackwardUpdate(hhLayerStats* s, const hhLayer& layer, bool propagates, int batch)
+{
+    if (s == nullptr)
+        return;
+
+    const double in = layer.numInputs, out = layer.numNeurons, weights = double(layer.weights.Size());
+    s->backwardSamples += batch;
+    s->backwardFlops += 2.0 * batch * layer.MultiplyAdds() * (propagates ? 2.0 : 1.0) + 2.0 * weights;
+    s->backwardBytes += 2.0 * weights * sizeof(float) + (batch * (in + out) + (propagates ? 2.0 * batch * in : 0.0)) * sizeof(float);
+    if (layer.precision != hhPrecision::Float32)
+        s->backwardBytes += 2.0 * weights;
+}
+
+// Backward: the gradient of every weight, and propagation into previous's errors unless it is the input layer
+static void countBackward(hhLayerStats* s, const hhLayer& layer, bool propagates, int batch)
+{
+    if (s == nullptr)
+        return;
+
+    const double in = layer.numInputs, out = layer.numNeurons, weights = double(layer.weights.Size());
+    s->backwardSamples += batch;
+    s->backwardFlops += 2.0 * batch * layer.MultiplyAdds() * (propagates ? 2.0 : 1.0);
+    s->backwardBytes += (weights + batch * (in + out)) * sizeof(float);
+    if (propagates)
+        s->backwardBytes += weights * storedWeightBytes(layer) + batch * in * sizeof(float);
+}
+
+// ReduceGradients adds one gradient into another
+static void countReduce(hhLayerStats* s, const hhLayer& layer)
+{
+    if (s == nullptr)
+        return;
+
+    const double weights = double(layer.weights.Size());
+    s->backwardFlops += weights;
+    s->backwardBytes += 3.0 * weights * sizeof(float);
+}
+
+// UpdateWeightsAndBiases applies it. every moment is read and written once more, Adam's step is counted as
+// ten flops with the square root and the division as one each.
+static void countUpdate(hhLayerStats* s, const hhLayer& layer, const hhUpdateStep& step)
+{
+    if (s == nullptr)
+        return;
+
+    const double weights = double(layer.weights.Size());
+    const bool adam = step.type == hhOptimizerType::Adam || step.type == hhOptimizerType::AdamW;
+    const int moments = adam ? 2 : step.type == hhOptimizerType::Sgd ? 0 : 1;
+    const double flops = adam ? 10.0 : step.type == hhOptimizerType::Nesterov ? 6.0 : step.type == hhOptimizerType::Momentum ? 4.0 : 2.0;
+    s->backwardFlops += (flops + (step.decay != 0.0f ? 2.0 : 0.0)) * weights;
+    s->backwardBytes += (3.0 + 2.0 * moments) * weights * sizeof(float);
+    if (layer.precision != hhPrecision::Float32)
+        s->backwardBytes += 2.0 * weights;
+}
+
+static const char* layerTypeName(hhLayerType type)
+{
+    switch (type)
+    {
+        case hhLayerType::Input: return "input";
+        case hhLayerType::Sigmoid: return "sigmoid";
+        case hhLayerType::Relu: return "relu";
+        case hhLayerType::Softmax: return "softmax";
+        case hhLayerType::Conv2D: return "conv2d";
+        case hhLayerType::MaxPool: return "maxpool";
+        default: return "none";
+    }
+}
+
+void hhModel::PrintStats() const
+{
+    fprintf(log, "layer %-8s %8s %10s %10s %10s %10s %10s %9s %9s\n",
+        "type", "neurons", "fwd ms", "bwd ms", "upd ms", "fwd GF/s", "bwd GF/s", "fwd F/B", "bwd F/B");
+    for (size_t i = 0; i < layers.size() && i < stats.layers.size(); i++)
+    {
+        const hhLayerStats& s = stats.layers[i];
+        fprintf(log, "%5zu %-8s %8d %10.2f %10.2f %10.2f %10.2f %10.2f %9.2f %9.2f\n",
+            i, layerTypeName(layers[i]->type), layers[i]->numNeurons,
+            s.forwardSeconds * 1000.0, s.backwardSeconds * 1000.0, (s.reduceSeconds + s.updateSeconds) * 1000.0,
+            s.ForwardGflops(), s.BackwardGflops(), s.ForwardIntensity(), s.BackwardIntensity());
+    }
+    fprintf(log, "%.0f samples/s over %.2f s of training, last epoch %.1f ms\n",
+        stats.SamplesPerSecond(), stats.trainSeconds, stats.lastEpochSeconds * 1000.0);
+    fprintf(log, "parameter arena %.2f MB in %d blocks%s\n", arena.Floats() * arena.Blocks() * sizeof(float) / 1048576.0,
+        arena.Blocks(), arena.HugePages() ? ", huge pages" : "");
 }
 
-void hhModel::Forward(const column& input)
+// ---------------------------- passes ----------------------------
+
+static void forwardLayers(hhLayerStack& stack, const tensor& input, hhModelStats* stats)
 {
-    layers[0]->Forward(input);
-    for (int i = 1; i < layers.size(); i++)
+    for (size_t i = 0; i < stack.size(); i++)
     {
-        const column& previous = layers[i - 1]->activationValue;
-        layers[i]->Forward(previous);
+        const tensor& in = i == 0 ? input : stack[i - 1]->activationValue;
+        hhLayerStats* s = layerStats(stats, i);
+        {
+            hhScopeTimer timer(s != nullptr ? &s->forwardSeconds : nullptr);
+            stack[i]->Forward(in);
+        }
+        countForward(s, *stack[i], in.rows);
+    }
+}
+
+static float backwardLayers(hhLayerStack& stack, const tensor& targets, hhModelStats* stats)
+{
+    float error = 0.0f;
+    hhLayer* next = nullptr;
+    for (size_t i = stack.size() - 1; i > 0; i--)
+    {
+        hhLayer& previous = *stack[i - 1];
+        const tensor& useTarget = (next == nullptr) ? targets : next->activationValue;
+        hhLayerStats* s = layerStats(stats, i);
+        {
+            hhScopeTimer timer(s != nullptr ? &s->backwardSeconds : nullptr);
+            error += stack[i]->Backward(previous, next, useTarget);
+        }
+        countBackward(s, *stack[i], previous.type != hhLayerType::Input, previous.activationValue.rows);
+        next = stack[i].get();
     }
+    return error;
+}
+
+void hhModel::Forward(const tensor& input)
+{
+    forwardLayers(layers, input, &stats);
 }
 
-float hhModel::Backward(const column& targets)
+float hhModel::Backward(const tensor& targets)
 {
+    // rules with moments or decay need the whole gradient before they can step
+    const hhUpdateStep step = NextUpdateStep();
+    if (step.type != hhOptimizerType::Sgd || step.decay != 0.0f)
+    {
+        const float error = backwardLayers(layers, targets, &stats);
+        UpdateLayers(step);
+        return error;
+    }
+
+    // each layer propagates its errors through the weights used in Forward and updates them in the same sweep,
+    // so no gradients are stored and every weight is read and written once
     float error = 0.0f;
     hhLayer* next = nullptr;
     for (size_t i = layers.size() - 1; i > 0; i--)
     {
-        const hhLayer& previous = *layers[i - 1];
-        const column& useTarget = (next == nullptr) ? targets : next->activationValue;
-        error += layers[i]->Backward(previous, next, task->learningRate, useTarget);
-        next = layers[i];
+        const tensor& useTarget = (next == nullptr) ? targets : next->activationValue;
+        hhLayerStats* s = layerStats(&stats, i);
+        {
+            hhScopeTimer timer(s != nullptr ? &s->backwardSeconds : nullptr);
+            error += layers[i]->BackwardUpdate(*layers[i - 1], next, useTarget, step.rate);
+        }
+        countBackwardUpdate(s, *layers[i], layers[i - 1]->type != hhLayerType::Input, layers[i - 1]->activationValue.rows);
+        next = layers[i].get();
+    }
+    return error;
+}
+
+hhUpdateStep hhModel::NextUpdateStep()
+{
+    optimizerSteps++;
+    return task->optimizer.Step(task->learningRate * learningRateScale, optimizerSteps);
+}
+
+void hhModel::UpdateLayers(const hhUpdateStep& step)
+{
+    // the moments get their blocks from the first step whose rule needs them, zeroed
+    const bool velocities = step.type != hhOptimizerType::Sgd;
+    const bool squares = step.type == hhOptimizerType::Adam || step.type == hhOptimizerType::AdamW;
+    if ((velocities && velocityBlock < 0) || (squares && squareBlock < 0))
+    {
+        int blocks = arena.Blocks();
+        if (velocities && velocityBlock < 0)
+            velocityBlock = blocks++;
+        if (squares && squareBlock < 0)
+            squareBlock = blocks++;
+        arena.Grow(blocks);
+        BindArena();
+    }
+
+    for (size_t i = 1; i < layers.size(); i++)
+    {
+        hhLayerStats* s = layerStats(&stats, i);
+        {
+            hhScopeTimer timer(s != nullptr ? &s->updateSeconds : nullptr);
+            layers[i]->UpdateWeightsAndBiases(step);
+        }
+        countUpdate(s, *layers[i], step);
+    }
+}
+
+void hhModel::ResetOptimizer()
+{
+    optimizerSteps = 0;
+    for (int block : { velocityBlock, squareBlock })
+    {
+        if (block >= 0)
+            std::memset(arena.Block(block), 0, arena.Floats() * sizeof(float));
+    }
+}
+
+void hhModel::BuildReplicas(int numWorkers)
+{
+    if (pool == nullptr || pool->Size() < numWorkers)
+        pool.reset(new hhThreadPool(numWorkers));
+
+    // each replica's gradients get a block, its weights and biases are the main stack's
+    int blocks = arena.Blocks();
+    while (int(replicas.size()) < numWorkers - 1)
+    {
+        hhLayerStack stack;
+        for (const std::unique_ptr<hhLayer>& layer : layers)
+        {
+            std::unique_ptr<hhLayer> replica = createLayer(layer->type, layer->numNeurons, layer->numInputs, layer->shape);
+            replica->activationMath = layer->activationMath;
+            replica->precision = layer->precision;
+            replica->sparseBackward = layer->sparseBackward;
+            replica->arenaOffset = layer->arenaOffset;
+            replica->inArena = true;
+            replica->weights = tensor::Wrap(layer->weights.Data(), layer->weights.rows, layer->weights.cols, layer->weights.stride);
+            replica->biases = tensor::Wrap(layer->biases.Data(), layer->biases.rows, layer->biases.cols, layer->biases.stride);
+            if (hasWeights(layer->type))
+            {
+                hhTensor<uint16_t>& stored = static_cast<hhDenseLayer&>(*layer).storedWeights;
+                static_cast<hhDenseLayer&>(*replica).storedWeights = hhTensor<uint16_t>::Wrap(stored.Data(), stored.rows, stored.cols, stored.stride);
+            }
+            stack.push_back(std::move(replica));
+        }
+        replicas.push_back(std::move(stack));
+        replicaBlocks.push_back(blocks++);
+    }
+    if (blocks > arena.Blocks())
+    {
+        arena.Grow(blocks);
+        BindArena();
+    }
+    workerErrors.resize(numWorkers);
+}
+
+float hhModel::TrainBatch(const tensor& inputs, const tensor& targets)
+{
+    // the int8 copy would go stale as soon as the weights move
+    if (hasQuantized)
+        DropQuantized();
+
+    const int numWorkers = std::max(1, std::min(task->numThreads, inputs.rows));
+    if (numWorkers == 1)
+    {
+        Forward(inputs);
+        return Backward(targets);
     }
+
+    BuildReplicas(numWorkers);
+
+    // every worker runs its own contiguous shard against the shared weights
+    pool->Run(numWorkers, [&](int t)
+    {
+        const int first = inputs.rows * t / numWorkers;
+        const int count = inputs.rows * (t + 1) / numWorkers - first;
+        hhLayerStack& stack = t == 0 ? layers : replicas[t - 1];
+        hhModelStats* timed = t == 0 ? &stats : nullptr;
+        forwardLayers(stack, inputs.View(first, count), timed);
+        workerErrors[t] = backwardLayers(stack, targets.View(first, count), timed);
+    });
+
+    // pairwise tree reduction into worker 0, fixed pairing keeps the sums deterministic
+    for (int step = 1; step < numWorkers; step *= 2)
+    {
+        pool->Run(numWorkers, [&](int t)
+        {
+            if (t % (2 * step) != 0 || t + step >= numWorkers)
+                return;
+            hhLayerStack& into = t == 0 ? layers : replicas[t - 1];
+            const hhLayerStack& from = replicas[t + step - 1];
+            for (size_t i = 1; i < into.size(); i++)
+            {
+                hhLayerStats* s = layerStats(t == 0 ? &stats : nullptr, i);
+                {
+                    hhScopeTimer timer(s != nullptr ? &s->reduceSeconds : nullptr);
+                    into[i]->ReduceGradients(*from[i]);
+                }
+                countReduce(s, *into[i]);
+            }
+        });
+    }
+    UpdateLayers(NextUpdateStep());
+
+    float error = 0.0f;
+    for (int t = 0; t < numWorkers; t++)
+        error += workerErrors[t];
     return error;
 }
 
-void hhModel::Train()
+bool hhModel::Train()
 {
-    for (int epoch = 0; epoch < task->epochs; epoch++)
+    using clock = std::chrono::steady_clock;
+    const int numItems = task->NumSamples();
+    if (numItems == 0 || stopped || interrupt.load(std::memory_order_relaxed))
+        return !stopped;
+    const int batchSize = task->batchSize > 0 ? std::min(task->batchSize, numItems) : 1;
+    const int batchesPerEpoch = (numItems + batchSize - 1) / batchSize;
+    const bool validating = task->validationInputs.rows > 0 && task->earlyStopping.interval > 0;
+
+    const clock::time_point trainStart = clock::now();
+    clock::time_point epochStart = trainStart;
+    auto endEpoch = [&]()
+    {
+        const clock::time_point now = clock::now();
+        if (HH_STATS)
+        {
+            stats.epochs++;
+            stats.lastEpochSeconds = std::chrono::duration<double>(now - epochStart).count();
+        }
+        epochStart = now;
+
+        // skipped rather than waited for while the last evaluation is still running
+        trainedEpochs++;
+        if (validating && trainedEpochs % task->earlyStopping.interval == 0)
+            validator.Start(*this, task->validationInputs, task->validationTargets, trainedEpochs);
+    };
+
+    float error = 0.0f;
+    bool started = false;
+    int batchInEpoch = 0;
+    auto step = [&](const tensor& inputs, const tensor& targets, int epoch, bool firstInEpoch)
     {
-        bool first = true;
-        float error = 0.0f;
+        if (firstInEpoch)
+        {
+            error = 0.0f;
+            batchInEpoch = 0;
+            if (started)
+                endEpoch();
+        }
+        started = true;
+
+        // asked from another thread to return
+        if (interrupt.load(std::memory_order_relaxed))
+            return false;
 
-        std::random_device rd;
-        std::mt19937 g(rd());
-        std::shuffle(indicies.begin(), indicies.end(), g);
+        // a finished evaluation may lower the rate or end training before this batch
+        hhValidationResult result;
+        if (validating && validator.Poll(result) && !ApplyValidation(result))
+            return false;
 
-        const int numItems = task->batchSize > 0 ? task->batchSize : int(task->inputs.size());
-        for (int i=0; i < numItems; i++)
+        // the schedule is read where this batch ends, so the first step of a warm-up is not wasted
+        batchInEpoch++;
+        const double progress = trainedEpochs + double(batchInEpoch) / batchesPerEpoch;
+        learningRateScale = float(task->schedule.Factor(progress) * plateauFactor);
+
+        error += TrainBatch(inputs, targets);
+        if (HH_STATS)
+            stats.trainSamples += inputs.rows;
+
+        if (firstInEpoch && epoch == task->epochs - 1)
         {
-            Forward(task->inputs[indicies[i]]);
-            error += Backward(task->targets[indicies[i]]);
+            lastTrainError = error;
+            if (numEpochs % 1000 == 0)
+                fprintf(log, "epoch %d, error %f\n", numEpochs, error);
+        }
+        numEpochs++;
+        return true;
+    };
 
-            if (first && epoch == task->epochs - 1)
+    bool completed = true;
+    if (task->prefetchDepth > 0)
+    {
+        // shuffling and gathering run on the loader thread while the current batch trains
+        prefetcher.Start(*task, indicies, shuffler, batchSize, task->epochs, task->prefetchDepth);
+        while (const hhPrefetchBatch* batch = prefetcher.Next())
+        {
+            completed = step(batch->inputs, batch->targets, batch->epoch, batch->firstInEpoch);
+            if (!completed)
+                break;
+        }
+        if (completed)
+            prefetcher.Finish();
+        else
+            prefetcher.Stop();
+    }
+    else
+    {
+        for (int epoch = 0; epoch < task->epochs && completed; epoch++)
+        {
+            std::shuffle(indicies.begin(), indicies.end(), shuffler);
+
+            for (int start = 0; start < numItems && completed; start += batchSize)
             {
-                first = false;
-                lastTrainError = error;
-                if (numEpochs % 1000 == 0)
-                    printf("epoch %d, error %f\n", numEpochs, error);
+                // gather the shuffled samples into one [batch x features] block
+                const int count = std::min(batchSize, numItems - start);
+                task->GatherBatch(&indicies[start], count, batchInputs, batchTargets);
+
+                completed = step(batchInputs, batchTargets, epoch, start == 0);
             }
-            numEpochs++;
         }
     }
+
+    // an epoch cut short by early stopping or an interrupt does not count
+    if (started && completed)
+        endEpoch();
+    const double seconds = std::chrono::duration<double>(clock::now() - trainStart).count();
+    lastTrainTime = float(seconds);
+    if (HH_STATS)
+        stats.trainSeconds += seconds;
+    return !stopped;
 }
 
-const column& hhModel::Predict(const column& input)
+void hhModel::PublishSnapshot(hhTripleBuffer<hhModelSnapshot>& snapshots) const
+{
+    // the slot's block is only allocated the first time round
+    hhModelSnapshot& snapshot = snapshots.Back();
+    snapshot.parameters.Resize(1, int(arena.Floats()));
+    std::memcpy(snapshot.parameters.Data(), arena.Block(0), arena.Floats() * sizeof(float));
+    snapshot.version = optimizerSteps;
+    snapshot.numEpochs = numEpochs;
+    snapshot.trainedEpochs = trainedEpochs;
+    snapshot.lastTrainError = lastTrainError;
+    snapshot.lastValidation = lastValidation;
+    snapshots.Publish();
+}
+
+bool hhModel::TakeSnapshot(hhTripleBuffer<hhModelSnapshot>& snapshots)
+{
+    if (!snapshots.Acquire())
+        return false;
+
+    // the int8 copy belongs to the weights being replaced
+    if (hasQuantized)
+        DropQuantized();
+
+    const hhModelSnapshot& snapshot = snapshots.Front();
+    assert(size_t(snapshot.parameters.cols) == arena.Floats());
+    std::memcpy(arena.Block(0), snapshot.parameters.Data(), arena.Floats() * sizeof(float));
+    for (const std::unique_ptr<hhLayer>& layer : layers)
+    {
+        if (hasWeights(layer->type))
+            static_cast<hhDenseLayer&>(*layer).StoreWeights();
+    }
+    optimizerSteps = snapshot.version;
+    numEpochs = snapshot.numEpochs;
+    trainedEpochs = snapshot.trainedEpochs;
+    lastTrainError = snapshot.lastTrainError;
+    lastValidation = snapshot.lastValidation;
+    return true;
+}
+
+const tensor& hhModel::Predict(const tensor& input)
 {
     Forward(input);
     return layers.back()->activationValue;
 }
 
+void hhModel::PredictBatch(const tensor& inputs, tensor& outputs)
+{
+    // rows per pass, large enough for the GEMM to pay off while keeping activations cache friendly
+    const int chunkRows = 512;
+
+    const int numOutputs = layers.back()->numNeurons;
+    if (outputs.rows != inputs.rows || outputs.cols != numOutputs)
+        outputs.Resize(inputs.rows, numOutputs, true);
+
+    for (int first = 0; first < inputs.rows; first += chunkRows)
+    {
+        const int count = std::min(chunkRows, inputs.rows - first);
+        Forward(inputs.View(first, count));
+
+        const tensor& result = layers.back()->activationValue;
+        for (int r = 0; r < count; r++)
+        {
+            std::memcpy(outputs[first + r], result[r], numOutputs * sizeof(float));
+        }
+    }
+}
+
 int argmax(const column& values)
+{
+    return argmax(values.data(), int(values.size()));
+}
+
+int argmax(const float* values, int count)
 {
     int index = 0;
     double highest = -1000;
-    for(int i=0; i < values.size(); i++)
+    for(int i=0; i < count; i++)
     {
         if (values[i] > highest)
         {
@@ -2,6 +2,20 @@
 #pragma once
 
 #include "task.h"
+#include "threads.h"
+#include "prefetch.h"
+#include "mapped.h"
+#include "quantize.h"
+#include "gemm.h"
+#include "stats.h"
+#include "validation.h"
+#include "arena.h"
+#include "snapshot.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <random>
 
 class hhLayer
 {
@@ -10,24 +24,58 @@ public:
 
     hhLayer(const int numNeurons, const int numInputs);
 
-    virtual void Forward(const column& input) = 0;
-    virtual float Backward(const hhLayer& previous, hhLayer* next, float learningRate, const column& targets) { return 0.0f;}
+    // input is a [batch x numInputs] block, one sample per row
+    virtual void Forward(const tensor& input) = 0;
+
+    // computes errors for the batch and accumulates this layer's gradients, weights are left untouched.
+    // previous.errors receives the errors propagated back through this layer, unless previous is the input layer.
+    virtual float Backward(hhLayer& previous, hhLayer* next, const tensor& targets) { return 0.0f;}
+
+    // applies the gradients accumulated by Backward, averaged over the samples they cover, with step's rule
+    virtual void UpdateWeightsAndBiases(const hhUpdateStep& step) {}
+
+    // Backward and a plain SGD update in one sweep over the weights, no gradients are kept. previous.errors
+    // receives the errors propagated through the weights as they were before the update.
+    virtual float BackwardUpdate(hhLayer& previous, hhLayer* next, const tensor& targets, float learningRate) { return 0.0f; }
+
+    // adds another replica's gradients into this layer's
+    virtual void ReduceGradients(const hhLayer& other) {}
 
+    // multiply-adds per sample in Forward, for the stats
+    virtual double MultiplyAdds() const { return double(weights.Size()); }
+
+    hhLayerType type = hhLayerType::None;
+    hhActivationMath activationMath = hhActivationMath::Fast;
+    hhPrecision precision = hhPrecision::Float32;
+    bool sparseBackward = true;     // see hhTask::sparseBackward
     int numNeurons;
     int numInputs;
+    hhConvShape shape;      // Conv2D and MaxPool only
+
+    // set by the model that owns the layer: weights, then biases right behind them, start at arenaOffset in
+    // every block of its arena. a layer on its own owns its tensors.
+    size_t arenaOffset = 0;
+    bool inArena = false;
 
-    column activationValue;
-    column errors;
-    column biases;
-    matrix weights;    
+    tensor activationValue; // [batch x numNeurons]
+    tensor errors;          // [batch x numNeurons]
+    tensor biases;          // [1 x numNeurons]
+    tensor weights;         // [numNeurons x numInputs], rows padded for SIMD
 };
 
+// the layer types built on hhDenseLayer, everything with weights and biases
+inline bool hasWeights(hhLayerType type)
+{
+    return type != hhLayerType::None && type != hhLayerType::Input && type != hhLayerType::MaxPool;
+}
+
 class hhInputLayer : public hhLayer
 {
 public:
     hhInputLayer(int numNeurons, int numInputs);
 
-    void Forward(const column& input) override;
+    // activationValue becomes a view of input, no copy is made
+    void Forward(const tensor& input) override;
 };
 
 class hhDenseLayer : public hhLayer
@@ -35,33 +83,149 @@ class hhDenseLayer : public hhLayer
 public:
     hhDenseLayer(int numNeurons, int numInputs);
 
-    void UpdateWeightsAndBiases(const hhLayer& previous, float learningRate);
+    // weights of another shape than [numNeurons x numInputs], for layers that share them across the sample
+    hhDenseLayer(int numNeurons, int numInputs, int weightRows, int weightCols);
+
+    float Backward(hhLayer& previous, hhLayer* next, const tensor& targets) override;
+    float BackwardUpdate(hhLayer& previous, hhLayer* next, const tensor& targets, float learningRate) override;
+    void UpdateWeightsAndBiases(const hhUpdateStep& step) override;
+    void ReduceGradients(const hhLayer& other) override;
+
+    // zeroes the optimizer moments, the next step starts from rest
+    void ResetMoments();
+
+    // applies the activation derivative to errors, which hold the errors propagated from next on entry.
+    // the output layer, next == nullptr, computes them from targets instead. returns the error for reporting.
+    virtual float ComputeErrors(const hhLayer* next, const tensor& targets) { return 0.0f; }
+
+    // previous.errors[b][i] = sum over n of errors[b][n] * weights[n][i]
+    void PropagateErrors(hhLayer& previous) const;
+
+    // sums errors^T * previous activations over the batch
+    void AccumulateGradients(const hhLayer& previous);
+
+    // collects the units whose errors are nonzero for some sample of the batch into liveUnits, and those
+    // errors into liveErrors. false, collecting nothing, unless sparseBackward is set on a relu layer and at
+    // most limitPercent of its units are live.
+    bool GatherLiveUnits(int limitPercent);
+
+    // PropagateErrors and AccumulateGradients over the live units only, after GatherLiveUnits. the gradient
+    // rows of the other units are zeroed.
+    void PropagateLiveErrors(hhLayer& previous);
+    void AccumulateLiveGradients(const hhLayer& previous);
+
+    // activationValue = epilogue(input * weights^T), through the int8 copy while quantized is set
+    void ForwardLinear(const tensor& input, const hhGemmEpilogue& epilogue);
+
+    // out [rows x weights.rows] = epilogue(in [rows x weights.cols] * weights^T), through the 16-bit copy
+    // when precision is not Float32
+    void MultiplyWeights(int rows, const float* in, int ldi, float* out, int ldo, const hhGemmEpilogue& epilogue) const;
+
+    // rebuilds storedWeights from the float32 weights, needed after anything but UpdateWeightsAndBiases changes them.
+    // does nothing at Float32.
+    void StoreWeights();
+
+    // builds the int8 copy of the weights. inputs will be quantized as input ~= int8 * inputScale.
+    void Quantize(float inputScale);
+    void ForwardQuantized(const tensor& input, const hhGemmEpilogue& epilogue);
+
+    tensor weightGradients; // shaped like weights
+    tensor biasGradients;   // shaped like biases
+    int gradientSamples = 0;
+
+    // backward scratch of the batch's live units, relu layers only
+    std::vector<int> liveUnits;
+    tensor liveErrors;                  // [batch x live units]
+    tensor liveRows;                    // [live units x numInputs], their weights or gradients
+    hhTensor<uint16_t> liveStored;      // their 16-bit weights when precision is not Float32
+
+    // optimizer state, sized by the first step whose rule needs it. velocities are the momentum of Momentum and
+    // Nesterov and Adam's first moment, squares Adam's second. shaped like weights and biases, row padding stays zero.
+    // in a model all of them are views of the arena, with the biases following the weights in every block.
+    tensor weightVelocities;
+    tensor biasVelocities;
+    tensor weightSquares;
+    tensor biasSquares;
+
+    // 16-bit copy of weights that Forward and back propagation read when precision is not Float32.
+    // weights stays the float32 master the updates are applied to.
+    hhTensor<uint16_t> storedWeights;   // shaped like weights, rows padded
+
+    // int8 inference copy with one scale per row, weights[n] ~= quantizedWeights[n] * weightScales[n]
+    hhTensor<int8_t> quantizedWeights;  // [numNeurons x numInputs], rows padded
+    tensor weightScales;                // [1 x numNeurons]
+    float inputScale = 0.0f;
+    bool quantized = false;
+
+    hhTensor<int8_t> quantizedInput;    // [batch x numInputs] scratch
+    hhTensor<int32_t> accumulators;     // [batch x numNeurons] scratch
 };
 
 class hhSigmoidLayer : public hhDenseLayer
 {
 public:
     hhSigmoidLayer(int numNeurons, int numInputs);
-    void Forward(const column& input) override;
-    float Backward(const hhLayer& previous, hhLayer* next, float learningRate, const column& targets) override;
+    void Forward(const tensor& input) override;
+    float ComputeErrors(const hhLayer* next, const tensor& targets) override;
 };
 
 class hhReluLayer : public hhDenseLayer
 {
 public:
     hhReluLayer(int numNeurons, int numInputs);
-    void Forward(const column& input) override;
-    float Backward(const hhLayer& previous, hhLayer* next, float learningRate, const column& targets) override;
+    void Forward(const tensor& input) override;
+    float ComputeErrors(const hhLayer* next, const tensor& targets) override;
 };
 
 class hhSoftmaxLayer : public hhDenseLayer
 {
 public:
     hhSoftmaxLayer(int numNeurons, int numInputs);
-    void Forward(const column& input) override;
-    float Backward(const hhLayer& previous, hhLayer* next, float learningRate, const column& targets) override;
+    void Forward(const tensor& input) override;
+    float ComputeErrors(const hhLayer* next, const tensor& targets) override;
+};
+
+// Convolution followed by relu. Every output pixel is a dense relu neuron over the window under it, so im2col
+// lays the windows of a sample out as columns and one gemm against the filters produces all of its planes.
+// weights are [filters x channels*kernel*kernel] and stay float32, at this size the 16-bit copy buys nothing.
+class hhConv2DLayer : public hhDenseLayer
+{
+public:
+    explicit hhConv2DLayer(const hhConvShape& shape);
+    void Forward(const tensor& input) override;
+    float ComputeErrors(const hhLayer* next, const tensor& targets) override;
+    float Backward(hhLayer& previous, hhLayer* next, const tensor& targets) override;
+    float BackwardUpdate(hhLayer& previous, hhLayer* next, const tensor& targets, float learningRate) override;
+    double MultiplyAdds() const override;
+
+    // the windows of one sample as [channels*kernel*kernel x output pixels], one column per window and zeros
+    // where it overhangs the image. returns the sample itself when the kernel is 1x1 and the windows are its pixels.
+    const float* GatherWindows(const float* image, int& ld);
+
+    // adds every element of columnErrors back onto the pixel it was gathered from, the ones gathered
+    // from the padding are dropped and may be cleared
+    void ScatterWindows(float* image);
+
+    bool pointwise = false; // 1x1 kernel, stride 1, no padding, the windows are the pixels
+
+    tensor columns;         // [channels*kernel*kernel x output pixels] scratch
+    tensor columnErrors;    // same shape, errors propagated to the windows
 };
 
+// Max over each window of each plane. no weights, backward hands each error to the input that won.
+class hhMaxPoolLayer : public hhLayer
+{
+public:
+    explicit hhMaxPoolLayer(const hhConvShape& shape);
+    void Forward(const tensor& input) override;
+    float Backward(hhLayer& previous, hhLayer* next, const tensor& targets) override;
+    float BackwardUpdate(hhLayer& previous, hhLayer* next, const tensor& targets, float learningRate) override;
+
+    hhTensor<int32_t> winners;  // [batch x numNeurons], the input index each output was taken from
+};
+
+using hhLayerStack = std::vector<std::unique_ptr<hhLayer>>;
+
 class hhModel
 {
 public:
@@ -69,20 +233,134 @@ public:
     void Configure(hhTask& task);
     hhLayer* AddLayer(hhLayerType type, int numNeurons, int numInputs);
 
-    void Forward(const column& input);
-    float Backward(const column& targets);
-    void Train();
+    // Conv2D and MaxPool layers, sized by their shape. returns nullptr when the shape is invalid
+    // or its input size does not match the previous layer.
+    hhLayer* AddLayer(hhLayerType type, const hhConvShape& shape);
+
+    // inputs and targets hold one sample per row; Backward also applies the update, fused per layer for plain SGD.
+    // the input layer views input rather than copying it, so input has to outlive the Backward that follows.
+    void Forward(const tensor& input);
+    float Backward(const tensor& targets);
+
+    // task->epochs passes over the shuffled samples. returns false, training nothing, once early stopping has
+    // ended training; clear stopped to go on.
+    bool Train();
+
+    // set from any thread, makes Train return after the batch in progress and at once for as long as it stays
+    // set. the epoch that was cut short does not count.
+    std::atomic<bool> interrupt{false};
+
+    // copies the parameter block and training progress into snapshots for a reader on another thread.
+    // only the training thread publishes.
+    void PublishSnapshot(hhTripleBuffer<hhModelSnapshot>& snapshots) const;
+
+    // takes the newest published snapshot into this model, built with the same layers as the publisher.
+    // never waits, false when nothing new was published.
+    bool TakeSnapshot(hhTripleBuffer<hhModelSnapshot>& snapshots);
+
+    // one optimisation step on a batch, sharded across task->numThreads workers
+    float TrainBatch(const tensor& inputs, const tensor& targets);
+
+    const tensor& Predict(const tensor& input);
+
+    // zeroes every layer's optimizer moments and the step count, as if training had not started
+    void ResetOptimizer();
+
+    // evaluates every row of inputs in large batches, writing one output row per input into outputs.
+    // outputs is only reallocated when its shape is wrong.
+    void PredictBatch(const tensor& inputs, tensor& outputs);
+
+    // writes layer shapes, then the arena's weights and biases in one piece, to a versioned binary checkpoint
+    bool Save(const char* filename) const;
+
+    // maps a checkpoint and, when its blobs are laid out like the arena as every file Save writes is, makes the
+    // mapping the arena's parameter block without copying. other layouts are copied in. an empty model builds
+    // its layers from the file, otherwise the shapes must match. pages are copy on write, so training after a
+    // load never modifies the file. returns false and leaves the model as it was on failure.
+    bool Load(const char* filename);
 
-    const column& Predict(const column& input);
+    // post-training int8 quantization of the dense layers for inference. input scales are calibrated by running
+    // up to calibrationRows evenly spaced task samples through the float model. training drops the int8 copy.
+    void Quantize(int calibrationRows = 512);
+
+    // switches Forward between the int8 copy and the float weights, for layers that have one
+    void UseQuantized(bool enabled);
+
+    // runs inputs through both paths of a quantized model and compares outputs, accuracy, size and speed.
+    // the int8 path is left enabled.
+    hhQuantizationReport CompareQuantized(const tensor& inputs, const tensor& targets);
 
     hhTask* task = nullptr;
 
     int numEpochs = 0;
+    long long optimizerSteps = 0;   // updates applied, Adam corrects its moments by this count
+    int trainedEpochs = 0;          // whole passes over the task's samples, across Train calls
+    float learningRateScale = 1.0f; // schedule and plateau decays on task->learningRate, as of the last step
     float lastTrainError = 0;
-    float lastTrainTime = 0;
+    float lastTrainTime = 0;    // seconds spent in the last Train call
+
+    // per-layer timings and flop and byte counts, accumulated until stats.Reset(). all zero with HH_STATS=0.
+    hhModelStats stats;
+
+    // one line per layer with times, GFLOP/s and flops per byte, then the training throughput
+    void PrintStats() const;
+
+    // where Train's progress lines and PrintStats go
+    FILE* log = stdout;
 
-    std::vector<hhLayer*> layers;
+    hhLayerStack layers;
     std::vector<int> indicies;
+
+    // weights, biases, gradients and optimizer moments of every layer, replicas' gradients included
+    hhParameterArena arena;
+
+    // mini-batch staging, gathered from the shuffled task data when prefetching is off
+    tensor batchInputs;
+    tensor batchTargets;
+
+    // background batch loader, its stats cover the last Train call
+    hhBatchPrefetcher prefetcher;
+
+    // early stopping on task->validationInputs. results arrive as the evaluations finish, a few batches
+    // after the epoch whose weights they judge.
+    hhValidator validator;
+    hhValidationResult lastValidation;
+    hhValidationResult bestValidation;
+    int plateauEvaluations = 0;     // evaluations since the best one
+    int rateDecays = 0;
+    float plateauFactor = 1.0f;     // product of the decays so far
+    bool stopped = false;
+
+private:
+    hhLayer* AppendLayer(hhLayerType type, int numNeurons, int numInputs, const hhConvShape& shape);
+    void BuildReplicas(int numWorkers);
+
+    // points the layers' parameter, gradient and moment tensors at their blocks, again after the arena grew.
+    // tensors a new layer still owns are copied in first.
+    void BindArena();
+    hhUpdateStep NextUpdateStep();
+
+    // updates the early stopping state with a finished evaluation, false when it ends training
+    bool ApplyValidation(const hhValidationResult& result);
+    void UpdateLayers(const hhUpdateStep& step);
+    void DropQuantized();
+
+    std::mt19937 shuffler;
+
+    // data-parallel workers. replica layers view the weights in layers and own their activations and gradients.
+    std::unique_ptr<hhThreadPool> pool;
+    std::vector<hhLayerStack> replicas;
+    std::vector<float> workerErrors;
+
+    // arena blocks of the moments, -1 until a rule needs them, and of each replica's gradients
+    int velocityBlock = -1;
+    int squareBlock = -1;
+    std::vector<int> replicaBlocks;
+
+    // mapping behind the layer weights after Load
+    std::unique_ptr<hhMappedFile> checkpoint;
+
+    bool hasQuantized = false;
 };
 
 
@@ -0,0 +1,200 @@
+#include "prefetch.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+using prefetchClock = std::chrono::steady_clock;
+
+static double secondsSince(prefetchClock::time_point start)
+{
+    return std::chrono::duration<double>(prefetchClock::now() - start).count();
+}
+
+hhBatchPrefetcher::~hhBatchPrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        exiting = true;
+    }
+    toLoader.notify_one();
+    if (loader.joinable())
+        loader.join();
+}
+
+void hhBatchPrefetcher::Notify(std::condition_variable& signal, const std::atomic<bool>& sleeping)
+{
+    // pairs with the fence in Sleep, either the sleeper's last check sees the push or this sees the flag
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!sleeping.load(std::memory_order_relaxed))
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    signal.notify_one();
+}
+
+template <typename Ready>
+void hhBatchPrefetcher::Sleep(std::condition_variable& signal, std::atomic<bool>& sleeping, Ready ready)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    signal.wait(lock, ready);
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+void hhBatchPrefetcher::Start(const hhTask& task, std::vector<int>& order, std::mt19937& shuffler, int batchSize, int epochs, int depth)
+{
+    assert(!loading);
+    assert(batchSize > 0 && depth > 0);
+
+    // staging buffers persist across calls, so their tensors keep their allocations
+    if (int(slots.size()) != depth)
+    {
+        slots.resize(depth);
+        ready.reset(new hhSpscQueue<int>(depth));
+        empty.reset(new hhSpscQueue<int>(depth));
+        for (int s = 0; s < depth; s++)
+            empty->TryPush(s);
+    }
+
+    const int numItems = int(order.size());
+    remaining = epochs * ((numItems + batchSize - 1) / batchSize);
+    current = -1;
+    stats = hhPrefetchStats();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = false;
+        jobTask = &task;
+        jobOrder = &order;
+        jobShuffler = &shuffler;
+        jobBatchSize = batchSize;
+        jobEpochs = epochs;
+        jobPending = true;
+        loading = true;
+    }
+
+    if (!loader.joinable())
+        loader = std::thread(&hhBatchPrefetcher::Run, this);
+    toLoader.notify_one();
+}
+
+const hhPrefetchBatch* hhBatchPrefetcher::Next()
+{
+    // hand the previous batch back, there is always room for it
+    if (current >= 0)
+    {
+        empty->TryPush(current);
+        current = -1;
+        Notify(toLoader, loaderSleeping);
+    }
+    if (remaining == 0)
+        return nullptr;
+
+    // the loader only ends a job early when Stop asks it to, so every batch counted in remaining arrives
+    if (!ready->TryPop(current))
+    {
+        const prefetchClock::time_point start = prefetchClock::now();
+        Sleep(toCompute, computeSleeping, [&]() { return ready->TryPop(current); });
+        stats.stalls++;
+        stats.stallSeconds += secondsSince(start);
+    }
+
+    remaining--;
+    stats.batches++;
+    return &slots[current];
+}
+
+void hhBatchPrefetcher::Finish()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        toCompute.wait(lock, [&]() { return !loading; });
+    }
+
+    // a batch still held goes back to the free ring for the next Start
+    if (current >= 0)
+    {
+        empty->TryPush(current);
+        current = -1;
+    }
+}
+
+void hhBatchPrefetcher::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    toLoader.notify_one();
+    Finish();
+
+    // batches loaded but never taken go back to the free ring too
+    int slot;
+    while (ready != nullptr && ready->TryPop(slot))
+        empty->TryPush(slot);
+    remaining = 0;
+}
+
+void hhBatchPrefetcher::Run()
+{
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            toLoader.wait(lock, [&]() { return exiting || jobPending; });
+            if (exiting)
+                return;
+            jobPending = false;
+        }
+
+        Load(*jobTask, *jobOrder, *jobShuffler, jobBatchSize, jobEpochs);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            loading = false;
+        }
+        toCompute.notify_one();
+    }
+}
+
+void hhBatchPrefetcher::Load(const hhTask& task, std::vector<int>& order, std::mt19937& shuffler, int batchSize, int epochs)
+{
+    const int numItems = int(order.size());
+    double waited = 0.0;
+
+    for (int epoch = 0; epoch < epochs; epoch++)
+    {
+        std::shuffle(order.begin(), order.end(), shuffler);
+
+        for (int start = 0; start < numItems; start += batchSize)
+        {
+            if (stopping)
+                return;
+
+            int slot;
+            if (!empty->TryPop(slot))
+            {
+                const prefetchClock::time_point begin = prefetchClock::now();
+                Sleep(toLoader, loaderSleeping, [&]() { return stopping || empty->TryPop(slot); });
+                if (stopping)
+                    return;
+                waited += secondsSince(begin);
+            }
+
+            hhPrefetchBatch& batch = slots[slot];
+            const int count = std::min(batchSize, numItems - start);
+            task.GatherBatch(&order[start], count, batch.inputs, batch.targets);
+            batch.epoch = epoch;
+            batch.firstInEpoch = start == 0;
+
+            ready->TryPush(slot);
+            Notify(toCompute, computeSleeping);
+        }
+    }
+
+    // Finish hands it to the compute loop
+    stats.loaderWaitSeconds = waited;
+}
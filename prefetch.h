@@ -0,0 +1,134 @@
+#pragma once
+
+#include "task.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Bounded single producer, single consumer ring. Push and pop never block or lock,
+// they fail when the ring is full or empty and the caller decides how to wait.
+template <typename T>
+class hhSpscQueue
+{
+public:
+    explicit hhSpscQueue(int capacity) : items(size_t(capacity) + 1) {}
+
+    bool TryPush(const T& value)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        const size_t next = (t + 1) % items.size();
+        if (next == head.load(std::memory_order_acquire))
+            return false;
+        items[t] = value;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T& value)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        value = items[h];
+        head.store((h + 1) % items.size(), std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> items;
+
+    // on separate lines so the two threads do not share a cache line
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+struct hhPrefetchStats
+{
+    int batches = 0;                  // batches handed to the compute loop
+    int stalls = 0;                   // times the compute loop found no batch ready
+    double stallSeconds = 0.0;        // time the compute loop spent waiting for data
+    double loaderWaitSeconds = 0.0;   // time the loader spent waiting for a free buffer, high means data is ahead
+};
+
+struct hhPrefetchBatch
+{
+    tensor inputs;
+    tensor targets;
+    int epoch = 0;
+    bool firstInEpoch = false;
+};
+
+// Assembles upcoming shuffled batches on a background thread into a ring of staging buffers,
+// so gathering and decoding overlap with training on the current batch. the thread is started by the first
+// Start and kept for the next ones. batches change hands through the lock-free rings, either side sleeps on a
+// condition variable only when its ring is empty, so a loader that is ahead costs no core and a hand-off
+// nobody waits for takes no lock.
+class hhBatchPrefetcher
+{
+public:
+    hhBatchPrefetcher() = default;
+    ~hhBatchPrefetcher();
+
+    hhBatchPrefetcher(const hhBatchPrefetcher&) = delete;
+    hhBatchPrefetcher& operator=(const hhBatchPrefetcher&) = delete;
+
+    // starts loading depth batches ahead. every epoch reshuffles order with shuffler and cuts it into
+    // batches of batchSize, exactly as the inline loop does. order and shuffler belong to the loader until Finish.
+    void Start(const hhTask& task, std::vector<int>& order, std::mt19937& shuffler, int batchSize, int epochs, int depth);
+
+    // the next batch in order, waiting if the loader is behind, or nullptr once every batch was handed out.
+    // the batch stays valid until the following call.
+    const hhPrefetchBatch* Next();
+
+    // waits for the loader to finish the batches of the current Start
+    void Finish();
+
+    // abandons the batches not handed out yet and waits for the loader, which stops at its next batch
+    void Stop();
+
+    // counters for the current, or last, Start
+    hhPrefetchStats stats;
+
+private:
+    // the loader thread, one Load per Start until the prefetcher goes
+    void Run();
+    void Load(const hhTask& task, std::vector<int>& order, std::mt19937& shuffler, int batchSize, int epochs);
+
+    // waits on signal until ready holds, with sleeping set so the other side knows to wake it
+    template <typename Ready>
+    void Sleep(std::condition_variable& signal, std::atomic<bool>& sleeping, Ready ready);
+
+    // wakes the other side after a push, only when it sleeps. the lock orders the wake after its last check,
+    // an uncontended hand-off never takes it.
+    void Notify(std::condition_variable& signal, const std::atomic<bool>& sleeping);
+
+    std::vector<hhPrefetchBatch> slots;
+    std::unique_ptr<hhSpscQueue<int>> ready;    // loader to compute loop
+    std::unique_ptr<hhSpscQueue<int>> empty;    // compute loop back to loader
+    std::thread loader;
+    std::atomic<bool> stopping{false};
+
+    // the work Start hands to the loader
+    const hhTask* jobTask = nullptr;
+    std::vector<int>* jobOrder = nullptr;
+    std::mt19937* jobShuffler = nullptr;
+    int jobBatchSize = 0;
+    int jobEpochs = 0;
+
+    std::mutex mutex;
+    std::condition_variable toLoader;   // a job, a free slot, stopping or exiting
+    std::condition_variable toCompute;  // a loaded batch or the end of the job
+    bool jobPending = false;
+    bool loading = false;               // from Start until the loader is done with the job
+    bool exiting = false;
+    std::atomic<bool> loaderSleeping{false};    // waiting for a free slot
+    std::atomic<bool> computeSleeping{false};   // waiting for a loaded batch
+
+    int current = -1;
+    int remaining = 0;
+};
@@ -0,0 +1,187 @@
+#include "model.h"
+#include "kernels.h"
+#include "gemm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static int8_t quantizeValue(float value, float inverseScale)
+{
+    const float q = std::nearbyint(value * inverseScale);
+    return int8_t(std::min(127.0f, std::max(-127.0f, q)));
+}
+
+// ---------------------------- layers ----------------------------
+
+void hhDenseLayer::Quantize(float scale)
+{
+    // symmetric, per row: the largest weight of each row maps to 127
+    quantizedWeights.Resize(numNeurons, numInputs, true);
+    weightScales.Resize(1, numNeurons, true);
+    for (int n = 0; n < numNeurons; n++)
+    {
+        const float* row = weights[n];
+        float largest = 0.0f;
+        for (int i = 0; i < numInputs; i++)
+            largest = std::max(largest, std::fabs(row[i]));
+
+        const float inverse = largest > 0.0f ? 127.0f / largest : 0.0f;
+        int8_t* q = quantizedWeights[n];
+        for (int i = 0; i < numInputs; i++)
+            q[i] = quantizeValue(row[i], inverse);
+        weightScales[0][n] = largest / 127.0f;
+    }
+
+    // an all zero calibration still needs a usable scale
+    inputScale = scale > 0.0f ? scale : 1.0f / 127.0f;
+    quantized = true;
+}
+
+void hhDenseLayer::ForwardQuantized(const tensor& input, const hhGemmEpilogue& epilogue)
+{
+    const hhKernels& k = activeKernels();
+    quantizedInput.Resize(input.rows, numInputs, true);
+    accumulators.Resize(input.rows, numNeurons, true);
+
+    // inputs outside the calibrated range saturate at +-127
+    const float inverseInput = 1.0f / inputScale;
+    for (int b = 0; b < input.rows; b++)
+        k.quantizeInt8(input[b], quantizedInput[b], inverseInput, numInputs);
+
+    k.gemmInt8(input.rows, numNeurons, numInputs,
+        quantizedInput.Data(), quantizedInput.stride,
+        quantizedWeights.Data(), quantizedWeights.stride,
+        accumulators.Data(), accumulators.stride);
+
+    const float* rowScales = weightScales[0];
+    for (int b = 0; b < input.rows; b++)
+    {
+        const int32_t* sums = accumulators[b];
+        float* out = activationValue[b];
+        for (int n = 0; n < numNeurons; n++)
+            out[n] = float(sums[n]) * (rowScales[n] * inputScale);
+        applyEpilogue(k, epilogue, out, 0, numNeurons);
+    }
+}
+
+// ---------------------------- model ----------------------------
+
+void hhModel::Quantize(int calibrationRows)
+{
+    const int numItems = task != nullptr ? task->NumSamples() : 0;
+    const int count = std::min(calibrationRows, numItems);
+    if (count <= 0)
+        return;
+
+    // evenly spaced so the sample covers the whole dataset whatever order it is stored in
+    std::vector<int> sample(count);
+    for (int i = 0; i < count; i++)
+        sample[i] = int(int64_t(i) * numItems / count);
+
+    tensor inputs, targets;
+    task->GatherBatch(sample.data(), count, inputs, targets);
+
+    UseQuantized(false);
+    Forward(inputs);
+
+    // each layer's input range comes from the float activations feeding it. convolutions stay float,
+    // their weights are few and reused by every pixel so they are not what bounds inference.
+    for (size_t l = 1; l < layers.size(); l++)
+    {
+        const hhLayerType type = layers[l]->type;
+        if (!hasWeights(type) || type == hhLayerType::Conv2D)
+            continue;
+
+        const tensor& in = layers[l - 1]->activationValue;
+        float largest = 0.0f;
+        for (int b = 0; b < in.rows; b++)
+            for (int i = 0; i < in.cols; i++)
+                largest = std::max(largest, std::fabs(in[b][i]));
+
+        static_cast<hhDenseLayer*>(layers[l].get())->Quantize(largest / 127.0f);
+    }
+    hasQuantized = true;
+}
+
+void hhModel::UseQuantized(bool enabled)
+{
+    for (size_t l = 1; l < layers.size(); l++)
+    {
+        if (!hasWeights(layers[l]->type))
+            continue;
+        hhDenseLayer* layer = static_cast<hhDenseLayer*>(layers[l].get());
+        layer->quantized = enabled && layer->quantizedWeights.rows > 0;
+    }
+}
+
+void hhModel::DropQuantized()
+{
+    for (size_t l = 1; l < layers.size(); l++)
+    {
+        if (!hasWeights(layers[l]->type))
+            continue;
+        hhDenseLayer* layer = static_cast<hhDenseLayer*>(layers[l].get());
+        layer->quantized = false;
+        layer->quantizedWeights.Resize(0, 0);
+    }
+    hasQuantized = false;
+}
+
+hhQuantizationReport hhModel::CompareQuantized(const tensor& inputs, const tensor& targets)
+{
+    using clock = std::chrono::steady_clock;
+    hhQuantizationReport report;
+    report.samples = inputs.rows;
+    if (!hasQuantized || inputs.rows == 0)
+        return report;
+
+    tensor floatOutputs, int8Outputs;
+
+    UseQuantized(false);
+    clock::time_point start = clock::now();
+    PredictBatch(inputs, floatOutputs);
+    report.floatSeconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    UseQuantized(true);
+    start = clock::now();
+    PredictBatch(inputs, int8Outputs);
+    report.int8Seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    const int numOutputs = floatOutputs.cols;
+    int floatCorrect = 0, int8Correct = 0, agree = 0;
+    double deltaSum = 0.0;
+    for (int r = 0; r < inputs.rows; r++)
+    {
+        const int expected = argmax(targets[r], targets.cols);
+        const int fromFloat = argmax(floatOutputs[r], numOutputs);
+        const int fromInt8 = argmax(int8Outputs[r], numOutputs);
+        floatCorrect += fromFloat == expected;
+        int8Correct += fromInt8 == expected;
+        agree += fromFloat == fromInt8;
+
+        for (int c = 0; c < numOutputs; c++)
+        {
+            const float delta = std::fabs(floatOutputs[r][c] - int8Outputs[r][c]);
+            report.maxOutputDelta = std::max(report.maxOutputDelta, delta);
+            deltaSum += delta;
+        }
+    }
+    report.floatAccuracy = float(floatCorrect) / inputs.rows;
+    report.int8Accuracy = float(int8Correct) / inputs.rows;
+    report.agreement = float(agree) / inputs.rows;
+    report.meanOutputDelta = float(deltaSum / (double(inputs.rows) * numOutputs));
+
+    for (size_t l = 1; l < layers.size(); l++)
+    {
+        if (!hasWeights(layers[l]->type))
+            continue;
+        const hhDenseLayer* layer = static_cast<const hhDenseLayer*>(layers[l].get());
+        report.floatWeightBytes += layer->weights.Size() * sizeof(float);
+        if (layer->quantizedWeights.rows > 0)
+            report.int8WeightBytes += layer->quantizedWeights.Size() + layer->weightScales.Size() * sizeof(float);
+        else
+            report.int8WeightBytes += layer->weights.Size() * sizeof(float);
+    }
+    return report;
+}
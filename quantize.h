@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+// float against int8 inference on the same inputs, from hhModel::CompareQuantized
+struct hhQuantizationReport
+{
+    int samples = 0;
+    float floatAccuracy = 0.0f;     // argmax of the output matching argmax of the target
+    float int8Accuracy = 0.0f;
+    float agreement = 0.0f;         // rows where both paths pick the same class
+    float maxOutputDelta = 0.0f;    // largest absolute difference of any output
+    float meanOutputDelta = 0.0f;
+
+    size_t floatWeightBytes = 0;
+    size_t int8WeightBytes = 0;     // int8 weights plus their row scales
+    double floatSeconds = 0.0;
+    double int8Seconds = 0.0;
+};
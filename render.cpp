@@ -1,4 +1,5 @@
 #include "render.h"
+#include "kernels.h"
 
 renderWindow::renderWindow() 
     : window(sf::VideoMode(1100, 1100), "again", sf::Style::Close)
@@ -13,9 +14,6 @@ renderWindow::renderWindow()
 
     gradientStr.setFont(font);
 
-    rect.setSize(sf::Vector2f(8.0f, 8.0f));
-    rect.setFillColor(sf::Color::White);
-
     imageTexture.create(32,32);
     imageSprite.setPosition(40,160);
     pixels = new sf::Uint8[32 * 32 * 4];
@@ -60,28 +58,39 @@ void renderWindow::DisplayImage(
 
 void renderWindow::DisplayGrid(
     const int gridSize,
-    matrix& values)
+    const tensor& values)
 {
-    float tpos = 840.0f;
-    float tdiff = 50.f;
-
-    for (int y=0; y < gridSize; y++)
+    // one texel per cell, stretched over the grid area in a single draw
+    const int cells = gridSize * gridSize;
+    if (gridTexture.getSize().x != unsigned(gridSize))
     {
-        for (int x=0; x < gridSize; x++)
-        {
-            const int i = y * gridSize + x;
-            const column& rgb = values[i];
-
-            sf::Uint8 r = sf::Uint8(rgb[0] * 255);
-            sf::Uint8 g = sf::Uint8(rgb[1] * 255);
-            sf::Uint8 b = sf::Uint8(rgb[2] * 255);
-
-            rect.setPosition(sf::Vector2f(20 + x*10*1.0f, 100 + y*10*1.0f));
-            rect.setFillColor(sf::Color(r, g, b,  255));
+        gridTexture.create(gridSize, gridSize);
+        gridTexture.setSmooth(false);
+        gridSprite.setTexture(gridTexture, true);
+        gridSprite.setPosition(20.0f, 100.0f);
+        gridSprite.setScale(gridArea / gridSize, gridArea / gridSize);
+        gridPixels.assign(size_t(cells) * 4, 255);
+    }
 
-            window.draw(rect);
-        }
+    // rows of a [cells x 3] tensor are back to back, so the colours convert in one run
+    const hhKernels& k = activeKernels();
+    gridBytes.resize(size_t(cells) * 3);
+    if (values.stride == 3)
+        k.floatToBytes(values.Data(), gridBytes.data(), cells * 3);
+    else
+        for (int i = 0; i < cells; i++)
+            k.floatToBytes(values[i], &gridBytes[size_t(i) * 3], 3);
+
+    // alpha stays at 255 from the fill
+    for (int i = 0; i < cells; i++)
+    {
+        gridPixels[i * 4 + 0] = gridBytes[i * 3 + 0];
+        gridPixels[i * 4 + 1] = gridBytes[i * 3 + 1];
+        gridPixels[i * 4 + 2] = gridBytes[i * 3 + 2];
     }
+
+    gridTexture.update(gridPixels.data());
+    window.draw(gridSprite);
 }
 
 void renderWindow::EndDisplay()
@@ -2,7 +2,10 @@
 
 #include <SFML/Graphics.hpp>
 
+#include <vector>
+
 #include "utils.h"
+#include "tensor.h"
 
 class renderWindow
 {
@@ -24,9 +27,11 @@ class renderWindow
       int x, 
       int y);
 
+    // values holds one (r,g,b) row in [0, 1] per cell, row by row. the grid fills the same square
+    // whatever its size, as one texture in one draw.
     void DisplayGrid(
       const int gridSize,
-      matrix& values);
+      const tensor& values);
 
     void EndDisplay();
     
@@ -42,5 +47,11 @@ class renderWindow
     sf::Sprite imageSprite;
      sf::Uint8* pixels;
 
-    sf::RectangleShape rect;
+    // side of the square DisplayGrid fills, in pixels
+    static constexpr float gridArea = 800.0f;
+
+    sf::Texture gridTexture;
+    sf::Sprite gridSprite;
+    std::vector<sf::Uint8> gridPixels;  // rgba, one texel per cell
+    std::vector<uint8_t> gridBytes;     // rgb scratch
 };
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "tensor.h"
+#include "validation.h"
+
+#include <atomic>
+
+// Triple buffer between one writer and one reader. each side owns a slot and the third is traded through an
+// atomic, so publishing and taking never wait on each other and the reader never sees a half-written value.
+// values the reader does not get to are overwritten by newer ones.
+template <typename T>
+class hhTripleBuffer
+{
+public:
+    // the writer's slot, filled in place before Publish. it keeps whatever it held two publishes ago, so
+    // buffers inside it are reused.
+    T& Back() { return slots[back]; }
+
+    // hands the back slot to the reader and takes the traded one in its place
+    void Publish()
+    {
+        back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & indexMask;
+    }
+
+    // moves the newest published value to the front, false when nothing was published since the last call
+    bool Acquire()
+    {
+        if ((middle.load(std::memory_order_relaxed) & freshBit) == 0)
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+
+    // the reader's slot, stays put until the next Acquire
+    const T& Front() const { return slots[front]; }
+
+private:
+    static const int indexMask = 3;
+    static const int freshBit = 4;
+
+    T slots[3] = {};
+    int back = 0;
+    int front = 1;
+    std::atomic<int> middle{2};
+};
+
+// what a display or evaluation thread takes from a model training on another thread
+struct hhModelSnapshot
+{
+    tensor parameters;              // [1 x arena floats], the arena's parameter block
+    long long version = -1;         // the model's optimizerSteps when it was taken
+    int numEpochs = 0;
+    int trainedEpochs = 0;
+    float lastTrainError = 0.0f;
+    hhValidationResult lastValidation;
+};
@@ -0,0 +1,614 @@
+#pragma once
+
+#include "model.h"
+#include "kernels.h"
+#if HH_SSE2_BASELINE
+#include "kernels_exp_sse2.h"
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <tuple>
+#include <utility>
+
+// Fixed-topology network whose shape is a template argument, for nets so small that virtual dispatch,
+// heap tensors and the blocked gemm cost more than the arithmetic:
+//
+//   hhStaticModel<hhInput<2>, hhSigmoid<9>, hhSigmoid<3>> model;
+//
+// Weights live in std::array members and every loop has a compile time trip count, layers of up to
+// staticUnrollLimit weights are unrolled completely. Initial weights, activations and the update rule are
+// those of the hhModel layers of the same types, so both train alike from the same hhTask and share checkpoints.
+// Weights are always float32, task precision does not apply.
+//
+// Fast sigmoid layers gather the dot products into a register four neurons at a time and apply the SSE2 sigmoid
+// of the kernel table there, a call through the table would read them back from activationValue right after they
+// are stored. Predict on the helper's 2-9-3 net takes 60-80 ns on an AVX-512 machine with gcc -O3, against
+// 80-95 ns with Precise math and about 200 ns for hhModel. Nearly all of it is the exp chains of the two
+// sigmoids, the dot products take under 5 ns.
+
+// ---------------------------- layer specs ----------------------------
+
+template <int N>
+struct hhInput
+{
+    static constexpr hhLayerType type = hhLayerType::Input;
+    static constexpr int neurons = N;
+};
+
+template <int N>
+struct hhSigmoid
+{
+    static constexpr hhLayerType type = hhLayerType::Sigmoid;
+    static constexpr int neurons = N;
+};
+
+template <int N>
+struct hhRelu
+{
+    static constexpr hhLayerType type = hhLayerType::Relu;
+    static constexpr int neurons = N;
+};
+
+template <int N>
+struct hhSoftmax
+{
+    static constexpr hhLayerType type = hhLayerType::Softmax;
+    static constexpr int neurons = N;
+};
+
+// ---------------------------- loops ----------------------------
+
+// weights per layer up to which the loops over them are unrolled completely
+const int staticUnrollLimit = 256;
+
+template <typename F, int... I>
+inline void staticForUnrolled(F& f, std::integer_sequence<int, I...>)
+{
+    (f(I), ...);
+}
+
+// calls f(i) for every i in [0, N)
+template <int N, bool Unroll, typename F>
+inline void staticFor(F&& f)
+{
+    if constexpr (Unroll)
+    {
+        staticForUnrolled(f, std::make_integer_sequence<int, N>());
+    }
+    else
+    {
+        for (int i = 0; i < N; i++)
+            f(i);
+    }
+}
+
+// ---------------------------- layer ----------------------------
+
+template <typename Spec, int Inputs>
+class hhStaticLayer
+{
+public:
+    static constexpr hhLayerType type = Spec::type;
+    static constexpr int numNeurons = Spec::neurons;
+    static constexpr int numInputs = Inputs;
+    static constexpr bool unrolled = numNeurons * numInputs <= staticUnrollLimit;
+
+    static_assert(type != hhLayerType::Input, "only the first layer is an input");
+    static_assert(numNeurons > 0 && numInputs > 0, "layers need neurons and inputs");
+
+    hhStaticLayer()
+    {
+        weights.fill(0.0f);
+        biases.fill(0.0f);
+        weightGradients.fill(0.0f);
+        biasGradients.fill(0.0f);
+        activationValue.fill(0.0f);
+        errors.fill(0.0f);
+
+        // the same sequence as the hhModel layers draw, softmax starts at zero
+        if (type == hhLayerType::Softmax)
+            return;
+        const float range = type == hhLayerType::Relu ? 0.1f : 1.0f;
+        std::default_random_engine generator;
+        std::uniform_real_distribution<float> distribution(-range, range);
+        for (int n = 0; n < numNeurons; n++)
+        {
+            for (int i = 0; i < numInputs; i++)
+                weights[n * numInputs + i] = distribution(generator);
+            biases[n] = distribution(generator);
+        }
+    }
+
+    void Forward(const float* input, hhActivationMath math)
+    {
+#if HH_SSE2_BASELINE
+        if constexpr (type == hhLayerType::Sigmoid)
+        {
+            if (math == hhActivationMath::Fast)
+            {
+                forwardFastSigmoid(input);
+                return;
+            }
+        }
+#endif
+        staticFor<numNeurons, unrolled>([&](int n) { activationValue[n] = Net(n, input); });
+
+        // the fast activations run as one vector call per layer, the exp chains would dominate done one by one
+        float* out = activationValue.data();
+        if constexpr (type == hhLayerType::Relu)
+        {
+            for (float& value : activationValue)
+                value = std::max(value, 0.0f);
+        }
+        else if (math == hhActivationMath::Fast)
+        {
+            if constexpr (type == hhLayerType::Sigmoid)
+                activeKernels().fastSigmoid(out, out, numNeurons);
+            else
+                activeKernels().fastSoftmax(out, out, numNeurons);
+        }
+        else if constexpr (type == hhLayerType::Sigmoid)
+        {
+            for (float& value : activationValue)
+                value = 1.0f / (1.0f + std::exp(-value));
+        }
+        else
+        {
+            // subtract the max so large logits cannot overflow exp
+            const float highest = *std::max_element(activationValue.begin(), activationValue.end());
+            float sum = 0.0f;
+            for (float& value : activationValue)
+            {
+                value = std::exp(value - highest);
+                sum += value;
+            }
+            for (float& value : activationValue)
+                value /= sum;
+        }
+    }
+
+    // weighted sum of input and bias of neuron n
+    float Net(int n, const float* input) const
+    {
+        const float* w = &weights[n * numInputs];
+        float sum = 0.0f;
+        staticFor<numInputs, unrolled>([&](int i) { sum += w[i] * input[i]; });
+        return sum + biases[n];
+    }
+
+    // applies the activation derivative to errors, which hold the errors propagated from the next layer on entry.
+    // the output layer passes its targets and computes them from those instead. returns the error for reporting.
+    float ComputeErrors(const float* target)
+    {
+        float error = 0.0f;
+        for (int n = 0; n < numNeurons; n++)
+        {
+            const float predicted = activationValue[n];
+            if constexpr (type == hhLayerType::Sigmoid)
+            {
+                const float dp = predicted * (1.0f - predicted);
+                if (target != nullptr)
+                    errors[n] = (predicted - target[n]) * 2 * dp;
+                errors[n] *= dp;
+                error += errors[n] * errors[n];
+            }
+            else if constexpr (type == hhLayerType::Relu)
+            {
+                if (target != nullptr)
+                    errors[n] = predicted - target[n];
+                errors[n] *= predicted > 0.0f ? 1.0f : 0.0f;
+            }
+            else
+            {
+                // cross-entropy gradient at the output, hidden softmax layers pass their errors on as they are
+                if (target != nullptr)
+                    errors[n] = predicted - target[n];
+            }
+        }
+        return error;
+    }
+
+    // one sample's gradient step in a single sweep over the weights. when Propagate is set, propagated receives
+    // the errors sent back through the weights as they were before the update and has to start at zero.
+    template <bool Propagate>
+    void BackwardUpdate(const float* input, float* propagated, float rate)
+    {
+        staticFor<numNeurons, unrolled>([&](int n)
+        {
+            float* w = &weights[n * numInputs];
+            const float scaled = rate * errors[n];
+            staticFor<numInputs, unrolled>([&](int i)
+            {
+                if constexpr (Propagate)
+                    propagated[i] += w[i] * errors[n];
+                w[i] -= scaled * input[i];
+            });
+            biases[n] -= scaled;
+        });
+    }
+
+    // adds one sample's gradients, for mini-batches. the weights stay as they are until ApplyGradients.
+    template <bool Propagate>
+    void AccumulateGradients(const float* input, float* propagated)
+    {
+        staticFor<numNeurons, unrolled>([&](int n)
+        {
+            const float* w = &weights[n * numInputs];
+            float* g = &weightGradients[n * numInputs];
+            staticFor<numInputs, unrolled>([&](int i)
+            {
+                if constexpr (Propagate)
+                    propagated[i] += w[i] * errors[n];
+                g[i] += errors[n] * input[i];
+            });
+            biasGradients[n] += errors[n];
+        });
+    }
+
+    void ApplyGradients(float rate)
+    {
+        for (int k = 0; k < numNeurons * numInputs; k++)
+            weights[k] -= rate * weightGradients[k];
+        for (int n = 0; n < numNeurons; n++)
+            biases[n] -= rate * biasGradients[n];
+        weightGradients.fill(0.0f);
+        biasGradients.fill(0.0f);
+    }
+
+    std::array<float, numNeurons * numInputs> weights;  // [numNeurons x numInputs], unpadded
+    std::array<float, numNeurons> biases;
+    std::array<float, numNeurons * numInputs> weightGradients;
+    std::array<float, numNeurons> biasGradients;
+    std::array<float, numNeurons> activationValue;
+    std::array<float, numNeurons> errors;
+
+#if HH_SSE2_BASELINE
+private:
+    static constexpr int numGroups = (numNeurons + 3) / 4;
+
+    // the padding lanes of the last group hold zeros and are not stored
+    void forwardFastSigmoid(const float* input)
+    {
+        staticFor<numGroups, unrolled>([&](int g)
+        {
+            const int first = g * 4;
+            const auto net = [&](int n) { return n < numNeurons ? Net(n, input) : 0.0f; };
+            const __m128 y = sigmoid4(_mm_setr_ps(net(first), net(first + 1), net(first + 2), net(first + 3)));
+            if (first + 4 <= numNeurons)
+            {
+                _mm_storeu_ps(&activationValue[first], y);
+            }
+            else
+            {
+                alignas(16) float lanes[4];
+                _mm_store_ps(lanes, y);
+                for (int n = first; n < numNeurons; n++)
+                    activationValue[n] = lanes[n - first];
+            }
+        });
+    }
+#endif
+};
+
+// tuple of the layers after the input, each sized by the one before
+template <int Inputs, typename... Specs>
+struct hhStaticStack
+{
+    using type = std::tuple<>;
+};
+
+template <int Inputs, typename First, typename... Rest>
+struct hhStaticStack<Inputs, First, Rest...>
+{
+    using type = decltype(std::tuple_cat(
+        std::declval<std::tuple<hhStaticLayer<First, Inputs>>>(),
+        std::declval<typename hhStaticStack<First::neurons, Rest...>::type>()));
+};
+
+// ---------------------------- model ----------------------------
+
+template <typename InputSpec, typename... Specs>
+class hhStaticModel
+{
+public:
+    static_assert(InputSpec::type == hhLayerType::Input, "the first layer is the input");
+    static_assert(sizeof...(Specs) > 0, "a model needs a layer after the input");
+
+    using Layers = typename hhStaticStack<InputSpec::neurons, Specs...>::type;
+    static constexpr int numDense = int(sizeof...(Specs));
+    static constexpr int numLayers = numDense + 1;     // counting the input, as hhModel::layers does
+    static constexpr int numInputs = InputSpec::neurons;
+    static constexpr int numOutputs = std::tuple_element<numDense - 1, Layers>::type::numNeurons;
+
+    // takes the data, learning rate and activation math from task. false when task's layers differ from the template.
+    bool Configure(hhTask& task)
+    {
+        // tasks only describe their layers to the model they configure
+        hhModel description;
+        task.Configure(description);
+        if (!Matches(task.layers))
+            return false;
+
+        this->task = &task;
+        activationMath = task.activationMath;
+        indices.resize(task.NumSamples());
+        std::iota(indices.begin(), indices.end(), 0);
+        shuffler.seed(task.seed != 0 ? task.seed : std::random_device()());
+        return true;
+    }
+
+    // numInputs values in, numOutputs values out. the result stays valid until the next call.
+    const float* Predict(const float* input)
+    {
+        forwardFrom<0>(input);
+        return Output();
+    }
+
+    // one output row per input row, outputs is only reallocated when its shape is wrong
+    void PredictBatch(const tensor& inputs, tensor& outputs)
+    {
+        assert(inputs.cols == numInputs);
+        if (outputs.rows != inputs.rows || outputs.cols != numOutputs)
+            outputs.Resize(inputs.rows, numOutputs, true);
+        for (int b = 0; b < inputs.rows; b++)
+            std::memcpy(outputs[b], Predict(inputs[b]), numOutputs * sizeof(float));
+    }
+
+    // a gradient step on a single sample, returns its error
+    float TrainSample(const float* input, const float* target, float learningRate)
+    {
+        forwardFrom<0>(input);
+        return backwardFrom<numDense - 1>(input, target, learningRate);
+    }
+
+    // one optimisation step on the mean gradient of a batch, the same update hhModel::TrainBatch makes
+    float TrainBatch(const tensor& inputs, const tensor& targets, float learningRate)
+    {
+        assert(inputs.cols == numInputs && targets.cols == numOutputs && inputs.rows == targets.rows);
+        if (inputs.rows == 1)
+            return TrainSample(inputs[0], targets[0], learningRate);
+
+        float error = 0.0f;
+        for (int b = 0; b < inputs.rows; b++)
+        {
+            forwardFrom<0>(inputs[b]);
+            error += accumulateFrom<numDense - 1>(inputs[b], targets[b]);
+        }
+        applyAll(learningRate / std::max(1, inputs.rows), std::make_index_sequence<numDense>());
+        return error;
+    }
+
+    // task->epochs passes over the shuffled task samples in batches of task->batchSize
+    void Train()
+    {
+        const int numItems = task->NumSamples();
+        if (numItems == 0)
+            return;
+        const int batchSize = task->batchSize > 0 ? std::min(task->batchSize, numItems) : 1;
+
+        for (int epoch = 0; epoch < task->epochs; epoch++)
+        {
+            std::shuffle(indices.begin(), indices.end(), shuffler);
+
+            float error = 0.0f;
+            for (int start = 0; start < numItems; start += batchSize)
+            {
+                const int count = std::min(batchSize, numItems - start);
+                task->GatherBatch(&indices[start], count, batchInputs, batchTargets);
+                error += TrainBatch(batchInputs, batchTargets, task->learningRate);
+                numEpochs++;
+            }
+            lastTrainError = error;
+        }
+    }
+
+    // true when layers describe this topology, input first
+    static bool Matches(const std::vector<hhTaskLayer>& layers)
+    {
+        const hhTaskLayer expected[numLayers] = {
+            hhTaskLayer{ InputSpec::type, InputSpec::neurons, 0 },
+            hhTaskLayer{ Specs::type, Specs::neurons, 0 }... };
+        if (int(layers.size()) != numLayers)
+            return false;
+        for (int i = 0; i < numLayers; i++)
+        {
+            const int inputs = i == 0 ? 0 : expected[i - 1].numNeurons;
+            if (layers[i].type != expected[i].type || layers[i].numNeurons != expected[i].numNeurons || layers[i].numInputs != inputs)
+                return false;
+        }
+        return true;
+    }
+
+    // copies the weights into a dynamic model of the same topology, building its layers when it has none
+    bool CopyTo(hhModel& model) const
+    {
+        if (model.layers.empty())
+        {
+            model.AddLayer(InputSpec::type, InputSpec::neurons, 0);
+            addLayers(model, std::make_index_sequence<numDense>());
+        }
+        if (!Matches(describe(model)))
+            return false;
+        copyToAll(model, std::make_index_sequence<numDense>());
+        return true;
+    }
+
+    // takes the weights of a dynamic model with the same topology
+    bool CopyFrom(const hhModel& model)
+    {
+        if (!Matches(describe(model)))
+            return false;
+        copyFromAll(model, std::make_index_sequence<numDense>());
+        return true;
+    }
+
+    // the checkpoint format of hhModel, either side can read what the other writes
+    bool Save(const char* filename) const
+    {
+        hhModel model;
+        return CopyTo(model) && model.Save(filename);
+    }
+
+    bool Load(const char* filename)
+    {
+        hhModel model;
+        return model.Load(filename) && CopyFrom(model);
+    }
+
+    // what a display thread takes from a model training on another thread, whole layers since they are plain arrays
+    struct Snapshot
+    {
+        Layers layers;
+        int numEpochs = 0;
+        float lastTrainError = 0.0f;
+    };
+
+    // copies the layers and progress into snapshots for a reader on another thread, only the training thread publishes
+    void PublishSnapshot(hhTripleBuffer<Snapshot>& snapshots) const
+    {
+        Snapshot& snapshot = snapshots.Back();
+        snapshot.layers = layers;
+        snapshot.numEpochs = numEpochs;
+        snapshot.lastTrainError = lastTrainError;
+        snapshots.Publish();
+    }
+
+    // takes the newest published snapshot, never waits. false when nothing new was published.
+    bool TakeSnapshot(hhTripleBuffer<Snapshot>& snapshots)
+    {
+        if (!snapshots.Acquire())
+            return false;
+        const Snapshot& snapshot = snapshots.Front();
+        layers = snapshot.layers;
+        numEpochs = snapshot.numEpochs;
+        lastTrainError = snapshot.lastTrainError;
+        return true;
+    }
+
+    const float* Output() const { return std::get<numDense - 1>(layers).activationValue.data(); }
+
+    Layers layers;  // every layer after the input, which holds no state
+    hhActivationMath activationMath = hhActivationMath::Fast;
+
+    hhTask* task = nullptr;
+    int numEpochs = 0;
+    float lastTrainError = 0;
+
+private:
+    template <size_t I>
+    void forwardFrom(const float* input)
+    {
+        auto& layer = std::get<I>(layers);
+        layer.Forward(input, activationMath);
+        if constexpr (I + 1 < numDense)
+            forwardFrom<I + 1>(layer.activationValue.data());
+    }
+
+    // the layer before I holds its input, the sample for the first layer
+    template <size_t I>
+    const float* inputOf(const float* sample) const
+    {
+        if constexpr (I == 0)
+            return sample;
+        else
+            return std::get<I - 1>(layers).activationValue.data();
+    }
+
+    template <size_t I>
+    float backwardFrom(const float* input, const float* target, float rate)
+    {
+        auto& layer = std::get<I>(layers);
+        const float error = layer.ComputeErrors(I == numDense - 1 ? target : nullptr);
+        if constexpr (I == 0)
+        {
+            layer.template BackwardUpdate<false>(input, nullptr, rate);
+            return error;
+        }
+        else
+        {
+            auto& previous = std::get<I - 1>(layers);
+            previous.errors.fill(0.0f);
+            layer.template BackwardUpdate<true>(previous.activationValue.data(), previous.errors.data(), rate);
+            return error + backwardFrom<I - 1>(input, target, rate);
+        }
+    }
+
+    template <size_t I>
+    float accumulateFrom(const float* input, const float* target)
+    {
+        auto& layer = std::get<I>(layers);
+        const float error = layer.ComputeErrors(I == numDense - 1 ? target : nullptr);
+        if constexpr (I == 0)
+        {
+            layer.template AccumulateGradients<false>(input, nullptr);
+            return error;
+        }
+        else
+        {
+            auto& previous = std::get<I - 1>(layers);
+            previous.errors.fill(0.0f);
+            layer.template AccumulateGradients<true>(previous.activationValue.data(), previous.errors.data());
+            return error + accumulateFrom<I - 1>(input, target);
+        }
+    }
+
+    template <size_t... I>
+    void applyAll(float rate, std::index_sequence<I...>)
+    {
+        (std::get<I>(layers).ApplyGradients(rate), ...);
+    }
+
+    static std::vector<hhTaskLayer> describe(const hhModel& model)
+    {
+        std::vector<hhTaskLayer> description;
+        for (const std::unique_ptr<hhLayer>& layer : model.layers)
+            description.push_back({ layer->type, layer->numNeurons, layer->numInputs });
+        return description;
+    }
+
+    template <size_t... I>
+    static void addLayers(hhModel& model, std::index_sequence<I...>)
+    {
+        using std::tuple_element;
+        (model.AddLayer(tuple_element<I, Layers>::type::type, tuple_element<I, Layers>::type::numNeurons,
+            tuple_element<I, Layers>::type::numInputs), ...);
+    }
+
+    template <size_t... I>
+    void copyToAll(hhModel& model, std::index_sequence<I...>) const
+    {
+        (copyTo(std::get<I>(layers), static_cast<hhDenseLayer&>(*model.layers[I + 1])), ...);
+    }
+
+    template <size_t... I>
+    void copyFromAll(const hhModel& model, std::index_sequence<I...>)
+    {
+        (copyFrom(std::get<I>(layers), static_cast<const hhDenseLayer&>(*model.layers[I + 1])), ...);
+    }
+
+    template <typename Layer>
+    static void copyTo(const Layer& from, hhDenseLayer& to)
+    {
+        for (int n = 0; n < Layer::numNeurons; n++)
+            std::memcpy(to.weights[n], &from.weights[n * Layer::numInputs], Layer::numInputs * sizeof(float));
+        std::memcpy(to.biases[0], from.biases.data(), Layer::numNeurons * sizeof(float));
+        to.StoreWeights();
+    }
+
+    template <typename Layer>
+    static void copyFrom(Layer& to, const hhDenseLayer& from)
+    {
+        for (int n = 0; n < Layer::numNeurons; n++)
+            std::memcpy(&to.weights[n * Layer::numInputs], from.weights[n], Layer::numInputs * sizeof(float));
+        std::memcpy(to.biases.data(), from.biases[0], Layer::numNeurons * sizeof(float));
+    }
+
+    std::vector<int> indices;
+    std::mt19937 shuffler;
+    tensor batchInputs;
+    tensor batchTargets;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// per-layer timings and work counters kept by hhModel. building with HH_STATS=0 compiles every timer and
+// counter out, the structs stay so code reading them still builds and sees zeros.
+#ifndef HH_STATS
+#define HH_STATS 1
+#endif
+
+struct hhLayerStats
+{
+    // wall time summed over calls. in data-parallel training forward and backward are timed on worker 0's shard.
+    double forwardSeconds = 0.0;
+    double backwardSeconds = 0.0;   // errors and gradients, or the fused backward and update sweep
+    double reduceSeconds = 0.0;     // adding replica gradients, data-parallel training only
+    double updateSeconds = 0.0;     // applying the summed gradients, data-parallel training only
+
+    int64_t forwardSamples = 0;
+    int64_t backwardSamples = 0;
+
+    // analytic work of the timed calls. a multiply-add is two flops, bytes count every tensor the call
+    // reads or writes once, the least traffic it can get away with. backward covers reduce and update too.
+    double forwardFlops = 0.0;
+    double forwardBytes = 0.0;
+    double backwardFlops = 0.0;
+    double backwardBytes = 0.0;
+
+    double BackwardTotalSeconds() const { return backwardSeconds + reduceSeconds + updateSeconds; }
+
+    double ForwardGflops() const { return forwardSeconds > 0.0 ? forwardFlops / forwardSeconds * 1e-9 : 0.0; }
+    double BackwardGflops() const { return BackwardTotalSeconds() > 0.0 ? backwardFlops / BackwardTotalSeconds() * 1e-9 : 0.0; }
+
+    // flops per byte, where the layer sits on a roofline
+    double ForwardIntensity() const { return forwardBytes > 0.0 ? forwardFlops / forwardBytes : 0.0; }
+    double BackwardIntensity() const { return backwardBytes > 0.0 ? backwardFlops / backwardBytes : 0.0; }
+};
+
+struct hhModelStats
+{
+    std::vector<hhLayerStats> layers;   // one per model layer, in the same order
+
+    // per-layer timing costs two clock reads per layer and pass, which small batches on small layers feel.
+    // clearing it skips the layer timers and counters, the Train totals below are still kept.
+    bool layerTiming = true;
+
+    double trainSeconds = 0.0;          // inside Train, summed over calls
+    int64_t trainSamples = 0;
+    int epochs = 0;                     // epochs completed by Train
+    double lastEpochSeconds = 0.0;
+
+    double SamplesPerSecond() const { return trainSeconds > 0.0 ? trainSamples / trainSeconds : 0.0; }
+
+    // zeroes every counter, keeping one entry per layer
+    void Reset()
+    {
+        const size_t count = layers.size();
+        const bool timing = layerTiming;
+        *this = hhModelStats();
+        layers.resize(count);
+        layerTiming = timing;
+    }
+};
+
+// adds the wall time of its scope to *total, when total is set
+class hhScopeTimer
+{
+public:
+#if HH_STATS
+    explicit hhScopeTimer(double* total) : total(total)
+    {
+        if (total != nullptr)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~hhScopeTimer()
+    {
+        if (total != nullptr)
+            *total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    double* total;
+    std::chrono::steady_clock::time_point start;
+#else
+    explicit hhScopeTimer(double*) {}
+#endif
+
+    hhScopeTimer(const hhScopeTimer&) = delete;
+    hhScopeTimer& operator=(const hhScopeTimer&) = delete;
+};
@@ -1,4 +1,11 @@
+#pragma once
+
 #include "utils.h"
+#include "tensor.h"
+#include "kernels.h"
+
+#include <cmath>
+#include <cstring>
 
 class hhModel;
 
@@ -9,6 +16,140 @@ enum class hhLayerType
     Sigmoid,
     Relu,
     Softmax,
+    Conv2D,     // convolution followed by relu
+    MaxPool,
+};
+
+// layers sized by an hhConvShape rather than neuron counts
+inline bool isWindowed(hhLayerType type)
+{
+    return type == hhLayerType::Conv2D || type == hhLayerType::MaxPool;
+}
+
+// Window geometry of a Conv2D or MaxPool layer. Samples are images stored as channels row-major
+// height x width planes, one after the other, the way hhCifarDataset decodes them. a dense layer can
+// follow directly, it sees the planes as one flat row.
+struct hhConvShape
+{
+    int channels = 0;   // of the input
+    int height = 0;
+    int width = 0;
+    int filters = 0;    // output channels, a MaxPool keeps its input's
+    int kernel = 0;     // square window
+    int stride = 1;
+    int padding = 0;    // zeros around every side of the input, Conv2D only
+
+    static hhConvShape Conv(int channels, int height, int width, int filters, int kernel, int stride = 1, int padding = 0)
+    {
+        return { channels, height, width, filters, kernel, stride, padding };
+    }
+
+    static hhConvShape Pool(int channels, int height, int width, int window, int stride)
+    {
+        return { channels, height, width, channels, window, stride, 0 };
+    }
+
+    int OutputHeight() const { return (height + 2 * padding - kernel) / stride + 1; }
+    int OutputWidth() const { return (width + 2 * padding - kernel) / stride + 1; }
+    int InputSize() const { return channels * height * width; }
+    int OutputSize() const { return filters * OutputHeight() * OutputWidth(); }
+
+    // weights per filter, a kernel x kernel window on every input channel
+    int PatchSize() const { return channels * kernel * kernel; }
+
+    bool IsValid() const
+    {
+        return channels > 0 && height > 0 && width > 0 && filters > 0 && kernel > 0 && stride > 0
+            && padding >= 0 && padding < kernel && kernel <= height + 2 * padding && kernel <= width + 2 * padding;
+    }
+};
+
+// how sigmoid and softmax evaluate exp. Fast uses the polynomial kernels, Precise calls libm.
+enum class hhActivationMath
+{
+    Fast,
+    Precise,
+};
+
+// Update rule applied after every batch, with its hyper-parameters. Momentum and Adam keep one or two
+// float32 moments per weight, allocated on the first step.
+struct hhOptimizer
+{
+    hhOptimizerType type = hhOptimizerType::Sgd;
+    float momentum = 0.9f;      // velocity decay, Adam's beta1
+    float beta2 = 0.999f;       // Adam's decay of the squared gradients
+    float epsilon = 1e-8f;
+    float weightDecay = 0.0f;   // L2 on the gradient, AdamW subtracts it from the weights directly
+
+    // the constants of update number step, counted from 1
+    hhUpdateStep Step(float learningRate, long long step) const
+    {
+        const bool adam = type == hhOptimizerType::Adam || type == hhOptimizerType::AdamW;
+        hhUpdateStep s;
+        s.type = type;
+        s.rate = learningRate;
+        s.decay = type == hhOptimizerType::AdamW ? 0.0f : weightDecay;
+        s.decoupledDecay = type == hhOptimizerType::AdamW ? weightDecay : 0.0f;
+        s.momentum = type == hhOptimizerType::Sgd ? 0.0f : momentum;
+        s.beta2 = adam ? beta2 : 0.0f;
+        s.epsilon = adam ? epsilon : 0.0f;
+        if (adam)
+        {
+            s.firstCorrection = float(1.0 / (1.0 - std::pow(double(momentum), double(step))));
+            s.secondCorrection = float(1.0 / (1.0 - std::pow(double(beta2), double(step))));
+        }
+        return s;
+    }
+};
+
+enum class hhScheduleType
+{
+    Constant,
+    Step,       // multiplied by stepFactor every stepEpochs
+    Cosine,     // half a cosine from 1 down to minFactor over cosineEpochs, then flat
+};
+
+// Learning rate over the course of training, as a factor on hhTask::learningRate. epochs count whole
+// passes over the samples across Train calls, fractions included, so the rate moves every batch.
+struct hhSchedule
+{
+    hhScheduleType type = hhScheduleType::Constant;
+    float warmupEpochs = 0.0f;  // linear ramp up to the schedule, which starts counting after it
+    float stepEpochs = 10.0f;
+    float stepFactor = 0.1f;
+    float cosineEpochs = 100.0f;
+    float minFactor = 0.0f;
+
+    double Factor(double epoch) const
+    {
+        if (epoch < warmupEpochs)
+            return epoch / warmupEpochs;
+
+        const double t = epoch - warmupEpochs;
+        switch (type)
+        {
+            case hhScheduleType::Step:
+                return std::pow(double(stepFactor), std::floor(t / stepEpochs));
+            case hhScheduleType::Cosine:
+                if (t >= cosineEpochs)
+                    return minFactor;
+                return minFactor + (1.0 - minFactor) * 0.5 * (1.0 + std::cos(3.14159265358979323846 * t / cosineEpochs));
+            default:
+                return 1.0;
+        }
+    }
+};
+
+// Acts on the validation loss when hhTask::validationInputs is set. after patience evaluations without an
+// improvement of at least minDelta the rate is multiplied by decayFactor, up to maxDecays times, and the
+// plateau after that stops training.
+struct hhEarlyStopping
+{
+    int interval = 1;           // epochs between evaluations
+    int patience = 3;
+    float minDelta = 0.0f;
+    int maxDecays = 2;
+    float decayFactor = 0.1f;
 };
 
 struct hhTaskLayer
@@ -16,6 +157,7 @@ struct hhTaskLayer
     hhLayerType type;
     int numNeurons;
     int numInputs;
+    hhConvShape shape;  // Conv2D and MaxPool only
 };
 
 class hhTask
@@ -26,17 +168,70 @@ public:
 
     void AddLayer(hhLayerType type, int numNeurons, int numInputs)
     {
-        layers.push_back({type, numNeurons, numInputs});
+        layers.push_back({type, numNeurons, numInputs, hhConvShape()});
     }
 
-    matrix inputs;
-    matrix targets;
+    // Conv2D and MaxPool layers, sized by their shape
+    void AddLayer(hhLayerType type, const hhConvShape& shape)
+    {
+        layers.push_back({type, shape.OutputSize(), shape.InputSize(), shape});
+    }
+
+    tensor inputs;
+    tensor targets;
     
     float learningRate;
+    hhOptimizer optimizer;
+    hhSchedule schedule;
     int epochs;
     int batchSize;
+
+    // worker threads for data-parallel training, each takes a shard of every batch
+    int numThreads = 1;
+
+    // shuffle seed, 0 picks a random one. a fixed seed and thread count give identical runs.
+    unsigned int seed = 0;
+
+    hhActivationMath activationMath = hhActivationMath::Fast;
+
+    // storage of the weights read by Forward and back propagation. 16-bit formats halve the weight traffic,
+    // the optimizer still updates a float32 master copy.
+    hhPrecision precision = hhPrecision::Float32;
+
+    // relu layers skip the units that are inactive for a whole batch in back propagation, their gradient rows
+    // are zero and they propagate nothing. off runs the dense path everywhere, for comparison.
+    bool sparseBackward = true;
+
+    // back the parameter arena with transparent huge pages once it spans one, where the OS offers them
+    bool hugePages = true;
+
+    // batches assembled ahead of training on a background thread, 0 gathers them inline. worth it for tasks
+    // that decode their samples, in-memory rows are copied faster than the hand-off costs.
+    int prefetchDepth = 0;
+
     std::vector<hhTaskLayer> layers;
 
+    // held-out samples, evaluated on a background thread against a copy of the weights every
+    // earlyStopping.interval epochs, so the task has to outlive the model. left empty, nothing is
+    // evaluated and training never stops early.
+    tensor validationInputs;
+    tensor validationTargets;
+    hhEarlyStopping earlyStopping;
+
+    // sample access for training. the defaults read inputs and targets; a task that
+    // streams its data from elsewhere overrides both and can leave them empty.
+    virtual int NumSamples() const { return inputs.rows; }
+    virtual void GatherBatch(const int* indices, int count, tensor& batchInputs, tensor& batchTargets) const
+    {
+        batchInputs.Resize(count, inputs.cols, true);
+        batchTargets.Resize(count, targets.cols, true);
+        for (int b = 0; b < count; b++)
+        {
+            std::memcpy(batchInputs[b], inputs[indices[b]], inputs.cols * sizeof(float));
+            std::memcpy(batchTargets[b], targets[indices[b]], targets.cols * sizeof(float));
+        }
+    }
+
     virtual void Configure(hhModel& model) = 0;
     virtual void Render(hhModel& model) {};    
 };
@@ -0,0 +1,88 @@
+#include "tasks.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cstdio>
+
+// ---------------------------- colors ----------------------------
+
+void ColorTask::Configure(hhModel& model)
+{
+    learningRate = 0.2f;
+    epochs = 40;
+    batchSize = 0;
+    inputs = {
+        {.1f, .1f},
+        {.8f, .7f},
+        {.7f, .1f},
+        {.5f, .2f},
+        {.2f, .1f}};
+
+    targets = {
+        {.9f, .0f, .0f},
+        {.9f, .0f, .9f},
+        {.0f, .0f, .97f},
+        {.1f, .9f, .7f},
+        {.0f, .9f, .1f }};
+
+    AddLayer(hhLayerType::Input, 2, 0);
+    AddLayer(hhLayerType::Sigmoid, 9, 2);
+    AddLayer(hhLayerType::Sigmoid, 3, 9);
+}
+
+// ---------------------------- images ----------------------------
+
+void ImageTask::Configure(hhModel& model)
+{
+    // Adam's per-weight step sizes move the conv filters and the dense layers alike, plain SGD needed
+    // a rate tuned to the largest of them and many more epochs
+    optimizer.type = hhOptimizerType::Adam;
+    learningRate = 0.001f;
+    epochs = 1;
+    batchSize = 24;
+
+    // every batch is decoded from the mapping, on the loader thread while the previous one trains
+    prefetchDepth = 2;
+
+    // one epoch of warm-up, then a cosine down to a twentieth. plateaus on the held-out images cut the
+    // rate twice before they end training.
+    schedule.type = hhScheduleType::Cosine;
+    schedule.warmupEpochs = 1.0f;
+    schedule.cosineEpochs = 40.0f;
+    schedule.minFactor = 0.05f;
+    earlyStopping.patience = 3;
+
+    // two 3x3 convolution and pooling stages shrink the image to 8x8x16 before the dense layers. about 580k
+    // multiply-adds per image against 650k for the 200-150 fully connected net on raw pixels, with a tenth of the weights.
+    const int side = hhCifarDataset::imageSide;
+    const hhConvShape first = hhConvShape::Conv(3, side, side, 8, 3, 1, 1);
+    const hhConvShape firstPool = hhConvShape::Pool(8, side, side, 2, 2);
+    const hhConvShape second = hhConvShape::Conv(8, side / 2, side / 2, 16, 3, 1, 1);
+    const hhConvShape secondPool = hhConvShape::Pool(16, side / 2, side / 2, 2, 2);
+
+    AddLayer(hhLayerType::Input, hhCifarDataset::imageSize, 0);
+    AddLayer(hhLayerType::Conv2D, first);
+    AddLayer(hhLayerType::MaxPool, firstPool);
+    AddLayer(hhLayerType::Conv2D, second);
+    AddLayer(hhLayerType::MaxPool, secondPool);
+    AddLayer(hhLayerType::Relu, 64, secondPool.OutputSize());
+    AddLayer(hhLayerType::Softmax, hhCifarDataset::numCategories, 64);
+
+    // four training batches, mapped rather than read so startup stays flat
+    const bool opened = images.Open({
+        "Resources/Data/data_batch_1.bin",
+        "Resources/Data/data_batch_2.bin",
+        "Resources/Data/data_batch_3.bin",
+        "Resources/Data/data_batch_4.bin" });
+    if (!opened)
+        printf("could not map the CIFAR-10 training batches\n");
+
+    // the fifth is held out, part of it decoded once for early stopping
+    hhCifarDataset heldOut;
+    if (heldOut.Open({ "Resources/Data/data_batch_5.bin" }))
+    {
+        std::vector<int> ids(std::min(numValidation, heldOut.Count()));
+        std::iota(ids.begin(), ids.end(), 0);
+        heldOut.Decode(ids.data(), int(ids.size()), validationInputs, validationTargets);
+    }
+}
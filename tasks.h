@@ -0,0 +1,31 @@
+#pragma once
+
+#include "task.h"
+#include "dataset.h"
+
+// The tasks the executables train, shared by the windowed front ends and the headless trainer.
+
+// five coloured points in the unit square, the decision regions are what helper draws
+class ColorTask : public hhTask
+{
+public:
+    void Configure(hhModel& model) override;
+};
+
+// CIFAR-10 from Resources/Data, four batches trained and part of the fifth held out for early stopping
+class ImageTask : public hhTask
+{
+public:
+    static constexpr int numValidation = 2000;
+
+    void Configure(hhModel& model) override;
+
+    // pixels are decoded per batch straight from the mapping, inputs and targets stay empty
+    int NumSamples() const override { return images.Count(); }
+    void GatherBatch(const int* indices, int count, tensor& batchInputs, tensor& batchTargets) const override
+    {
+        images.Decode(indices, count, batchInputs, batchTargets);
+    }
+
+    hhCifarDataset images;
+};
@@ -0,0 +1,15 @@
+#include "tensor.h"
+
+#include <new>
+
+// the aligned operator new rather than the C runtime, so a program that replaces operator new sees tensor
+// storage too. the allocation tests count heap traffic that way.
+void* alignedAlloc(size_t bytes)
+{
+    return ::operator new(bytes, std::align_val_t(tensorAlignment));
+}
+
+void alignedFree(void* ptr)
+{
+    ::operator delete(ptr, std::align_val_t(tensorAlignment));
+}
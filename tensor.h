@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+// every tensor buffer starts on a cache line, which is also the width of an AVX-512 register
+const int tensorAlignment = 64;
+
+void* alignedAlloc(size_t bytes);
+void alignedFree(void* ptr);
+
+// Contiguous, row-major 2D buffer of T with 64-byte alignment.
+// Rows can be padded so each row starts on an aligned boundary and the
+// padding (always zero) can be read by SIMD loops without a scalar tail.
+template <typename T>
+class hhTensor
+{
+public:
+    // number of elements a padded row is rounded up to
+    static const int padding = tensorAlignment / sizeof(T);
+
+    hhTensor() = default;
+
+    hhTensor(int rows, int cols, bool padded = false)
+    {
+        Resize(rows, cols, padded);
+    }
+
+    hhTensor(const std::vector<T>& values)
+    {
+        Resize(1, int(values.size()));
+        std::memcpy(data, values.data(), values.size() * sizeof(T));
+    }
+
+    hhTensor(const std::vector<std::vector<T>>& values)
+    {
+        Assign(values.begin(), values.end());
+    }
+
+    hhTensor(std::initializer_list<std::vector<T>> values)
+    {
+        Assign(values.begin(), values.end());
+    }
+
+    hhTensor(const hhTensor& other)
+    {
+        *this = other;
+    }
+
+    hhTensor(hhTensor&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    ~hhTensor()
+    {
+        Release();
+    }
+
+    hhTensor& operator=(const hhTensor& other)
+    {
+        if (this == &other)
+            return *this;
+
+        Resize(other.rows, other.cols, other.stride != other.cols);
+        for (int r = 0; r < rows; r++)
+        {
+            std::memcpy((*this)[r], other[r], cols * sizeof(T));
+        }
+        return *this;
+    }
+
+    hhTensor& operator=(hhTensor&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        Release();
+        rows = other.rows;
+        cols = other.cols;
+        stride = other.stride;
+        data = other.data;
+        capacity = other.capacity;
+        owner = other.owner;
+
+        other.rows = other.cols = other.stride = 0;
+        other.data = nullptr;
+        other.capacity = 0;
+        other.owner = true;
+        return *this;
+    }
+
+    // reshape, keeping the allocation when it is large enough. contents are zeroed on any change.
+    void Resize(int newRows, int newCols, bool padded = false)
+    {
+        assert(newRows >= 0 && newCols >= 0);
+        const int newStride = padded ? (newCols + padding - 1) / padding * padding : newCols;
+        if (newRows == rows && newCols == cols && newStride == stride)
+            return;
+
+        const size_t needed = size_t(newRows) * newStride;
+        if (!owner || needed > capacity)
+        {
+            Release();
+            data = needed > 0 ? static_cast<T*>(alignedAlloc(needed * sizeof(T))) : nullptr;
+            capacity = needed;
+        }
+
+        rows = newRows;
+        cols = newCols;
+        stride = newStride;
+        Zero();
+    }
+
+    // sets every element, leaving row padding at zero
+    void Fill(T value)
+    {
+        for (int r = 0; r < rows; r++)
+        {
+            T* row = (*this)[r];
+            for (int c = 0; c < cols; c++)
+                row[c] = value;
+        }
+    }
+
+    // clears every element including row padding
+    void Zero()
+    {
+        if (data != nullptr)
+            std::memset(data, 0, size_t(rows) * stride * sizeof(T));
+    }
+
+    // non-owning window onto [first, first+count) rows
+    hhTensor View(int first, int count)
+    {
+        assert(first >= 0 && first + count <= rows);
+        return Wrap(data + size_t(first) * stride, count, cols, stride);
+    }
+
+    const hhTensor View(int first, int count) const
+    {
+        assert(first >= 0 && first + count <= rows);
+        return Wrap(data + size_t(first) * stride, count, cols, stride);
+    }
+
+    // non-owning tensor over external memory
+    static hhTensor Wrap(T* values, int rows, int cols, int stride)
+    {
+        hhTensor t;
+        t.data = values;
+        t.rows = rows;
+        t.cols = cols;
+        t.stride = stride;
+        t.owner = false;
+        return t;
+    }
+
+    T* operator[](int row) { return data + size_t(row) * stride; }
+    const T* operator[](int row) const { return data + size_t(row) * stride; }
+
+    T& operator()(int row, int col) { return data[size_t(row) * stride + col]; }
+    const T& operator()(int row, int col) const { return data[size_t(row) * stride + col]; }
+
+    T* Data() { return data; }
+    const T* Data() const { return data; }
+
+    size_t Size() const { return size_t(rows) * cols; }
+    bool IsView() const { return !owner; }
+
+    int rows = 0;
+    int cols = 0;
+    int stride = 0;
+
+private:
+    template <typename It>
+    void Assign(It begin, It end)
+    {
+        const int numRows = int(end - begin);
+        const int numCols = numRows > 0 ? int(begin->size()) : 0;
+        Resize(numRows, numCols);
+        for (int r = 0; begin != end; ++begin, ++r)
+        {
+            assert(int(begin->size()) == numCols);
+            std::memcpy((*this)[r], begin->data(), numCols * sizeof(T));
+        }
+    }
+
+    void Release()
+    {
+        if (owner && data != nullptr)
+            alignedFree(data);
+        data = nullptr;
+        capacity = 0;
+        owner = true;
+    }
+
+    T* data = nullptr;
+    size_t capacity = 0;
+    bool owner = true;
+};
+
+using tensor = hhTensor<float>;
@@ -1,6 +1,24 @@
 #include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
 
 #include "model.h"
+#include "kernels.h"
+#include "kernels_exp.h"
+#include "gemm.h"
+#include "dataset.h"
+#include "static_model.h"
 
 bool nothing()
 {
@@ -65,20 +83,20 @@ bool predict()
         hhModel m;
         initSimpleModel(m, hhLayerType::Sigmoid);
 
-        column out1(1), out2(1);
+        tensor out1, out2;
         out1 = m.Predict(simpleInputs[0]);
         out2 = m.Predict(simpleInputs[0]);
-        assert(out1[0] == out2[0]);
+        assert(out1[0][0] == out2[0][0]);
     }
 
     {
         hhModel m;
         initSimpleModel(m, hhLayerType::Relu);
 
-        column out1(1), out2(1);
+        tensor out1, out2;
         out1 = m.Predict(simpleInputs[0]);
         out2 = m.Predict(simpleInputs[0]);
-        assert(out1[0] == out2[0]);
+        assert(out1[0][0] == out2[0][0]);
     }
 
     {
@@ -87,14 +105,14 @@ bool predict()
         m.AddLayer(hhLayerType::Relu, 1, 2);
         m.AddLayer(hhLayerType::Softmax, softmaxTestSize, 1);
 
-        column out1(softmaxTestSize), out2(softmaxTestSize);
+        tensor out1, out2;
         out1 = m.Predict(simpleInputs[0]);
         out2 = m.Predict(simpleInputs[0]);
-        assert(out1[0] == out2[0]);
-        assert(argmax(out1) == argmax(out2));
+        assert(out1[0][0] == out2[0][0]);
+        assert(argmax(out1[0], softmaxTestSize) == argmax(out2[0], softmaxTestSize));
 
         double total = 0;
-        for (auto o : out1) total+= o;
+        for (int i = 0; i < softmaxTestSize; i++) total+= out1[0][i];
         assert(pow((total-1),2) < 0.0001);
     }
 
@@ -104,7 +122,7 @@ bool predict()
         hhInputLayer il(2, 0);
         hhSigmoidLayer dl(1, 2);
 
-        dl.biases = {0.3f};
+        dl.biases[0][0] = 0.3f;
         dl.weights[0][0] = 0.23f;
         dl.weights[0][1] = -0.1f;
 
@@ -115,7 +133,7 @@ bool predict()
         dl.Forward(inputs);
 
         const double expectedActivationValue = 0.6295f;
-        assert(abs(dl.activationValue[0]-expectedActivationValue) < 0.001);
+        assert(abs(dl.activationValue[0][0]-expectedActivationValue) < 0.001);
     }
 
     {
@@ -123,7 +141,7 @@ bool predict()
         hhSigmoidLayer dl(1, 1);
         hhSigmoidLayer ol(1, 1);
 
-        dl.biases = {0.3f};
+        dl.biases[0][0] = 0.3f;
         dl.weights[0][0] = 0.3f;
 
         column inputs(1);
@@ -134,8 +152,10 @@ bool predict()
 
         dl.Forward(inputs);
         
-        ol.Backward(dl, nullptr, 0.5, targets);
-        dl.Backward(il, &ol, 0.5, ol.activationValue);
+        ol.Backward(dl, nullptr, targets);
+        dl.Backward(il, &ol, ol.activationValue);
+        ol.UpdateWeightsAndBiases(hhOptimizer().Step(0.5f, 1));
+        dl.UpdateWeightsAndBiases(hhOptimizer().Step(0.5f, 1));
 
     }
 
@@ -165,12 +185,16 @@ bool backwards()
         TestTask t;
         m.Configure(t);
 
-        column out1(1);
+        tensor out1;
 
-        out1 = m.Predict(simpleInputs[0]);
+        // Backward reads the inputs Forward saw, they have to stay alive until then
+        const tensor input0 = simpleInputs[0];
+        const tensor input1 = simpleInputs[1];
+
+        out1 = m.Predict(input0);
         double loss1 = m.Backward(simpleTargets[0]);
 
-        out1 = m.Predict(simpleInputs[1]);
+        out1 = m.Predict(input1);
         double loss2 = m.Backward(simpleTargets[0]);
 
         assert(loss2 != loss1);
@@ -179,6 +203,277 @@ bool backwards()
     return true;
 }
 
+bool batches()
+{
+    // a batched forward pass matches running each sample on its own
+    hhModel m;
+    TestTask t;
+    m.Configure(t);
+
+    const tensor batch = simpleInputs;
+    m.Forward(batch);
+    const tensor batched = m.layers.back()->activationValue;
+    assert(batched.rows == 2);
+
+    for (int i = 0; i < batch.rows; i++)
+    {
+        const tensor& single = m.Predict(simpleInputs[i]);
+        assert(abs(single[0][0] - batched[i][0]) < 0.00001);
+    }
+
+    // one update per batch, averaged over the samples
+    const float before = m.layers[1]->weights[0][0];
+    m.Forward(batch);
+    m.Backward(simpleTargets);
+    assert(m.layers[1]->weights[0][0] != before);
+
+    return true;
+}
+
+// ------------------------------ simd kernels test ------------------------------
+
+bool closeTo(float a, float b, float tolerance = 0.0001f)
+{
+    return std::fabs(a - b) <= tolerance * std::max(1.0f, std::fabs(b));
+}
+
+bool simdKernels()
+{
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    // odd sizes exercise every tail path
+    const int rows = 7;
+    const int cols = 37;
+    tensor w(rows, cols, true);
+    tensor x(1, cols, true);
+    for (int r = 0; r < rows; r++)
+        for (int c = 0; c < cols; c++)
+            w[r][c] = distribution(generator);
+    for (int c = 0; c < cols; c++)
+        x[0][c] = distribution(generator);
+
+    const hhKernels& ref = scalarKernels;
+    for (hhSimdLevel level : {hhSimdLevel::SSE2, hhSimdLevel::AVX2, hhSimdLevel::AVX512})
+    {
+        const hhKernels* k = kernelsFor(level);
+        if (k == nullptr)
+            continue;
+
+        assert(closeTo(k->dot(w[0], x[0], cols), ref.dot(w[0], x[0], cols)));
+
+        float expected[rows], actual[rows];
+        ref.gemv(w.Data(), w.stride, x[0], expected, rows, cols);
+        k->gemv(w.Data(), w.stride, x[0], actual, rows, cols);
+        for (int r = 0; r < rows; r++)
+            assert(closeTo(actual[r], expected[r]));
+
+        tensor y1 = w, y2 = w;
+        ref.axpy(0.3f, x[0], y1[1], cols);
+        k->axpy(0.3f, x[0], y2[1], cols);
+        ref.biasAdd(y1[2], x[0], cols);
+        k->biasAdd(y2[2], x[0], cols);
+        for (int c = 0; c < cols; c++)
+        {
+            assert(closeTo(y2[1][c], y1[1][c]));
+            assert(closeTo(y2[2][c], y1[2][c]));
+        }
+        // the padding past cols is never written
+        assert(y2[1][cols] == 0.0f && y2[2][cols] == 0.0f);
+
+        // integer sums are exact, every level must agree with scalar bit for bit. 6 samples and 77 columns
+        // cover the 4 sample tiles, the leftover samples and the byte tails.
+        const int samples = 6, inner = 77;
+        hhTensor<int8_t> wq(rows, inner, true), xq(samples, inner, true);
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < inner; c++)
+                wq[r][c] = int8_t((r * 37 + c * 11) % 255 - 127);
+        for (int s = 0; s < samples; s++)
+            for (int c = 0; c < inner; c++)
+                xq[s][c] = int8_t(127 - (s * 53 + c * 29) % 255);
+        hhTensor<int32_t> expectedInt(samples, rows), actualInt(samples, rows);
+        ref.gemmInt8(samples, rows, inner, xq.Data(), xq.stride, wq.Data(), wq.stride, expectedInt.Data(), expectedInt.stride);
+        k->gemmInt8(samples, rows, inner, xq.Data(), xq.stride, wq.Data(), wq.stride, actualInt.Data(), actualInt.stride);
+        for (int s = 0; s < samples; s++)
+            for (int r = 0; r < rows; r++)
+                assert(actualInt[s][r] == expectedInt[s][r]);
+
+        // rounding and clamping match too, including the tail
+        for (int c = 0; c < cols; c++)
+            y1[0][c] = (c - 18) * 9.37f;
+        hhTensor<int8_t> q1(1, cols), q2(1, cols);
+        ref.quantizeInt8(y1[0], q1[0], 0.83f, cols);
+        k->quantizeInt8(y1[0], q2[0], 0.83f, cols);
+        for (int c = 0; c < cols; c++)
+            assert(q1[0][c] == q2[0][c] && q1[0][c] >= -127);
+
+        // display bytes clamp out of range colours and NaN the same way, 77 values cover the tails
+        float colours[inner];
+        for (int c = 0; c < inner; c++)
+            colours[c] = (c - 10) * 0.0173f;
+        colours[3] = std::nanf("");
+        colours[40] = INFINITY;
+        colours[41] = -INFINITY;
+        uint8_t b1[inner], b2[inner];
+        ref.floatToBytes(colours, b1, inner);
+        k->floatToBytes(colours, b2, inner);
+        for (int c = 0; c < inner; c++)
+            assert(b1[c] == b2[c]);
+    }
+
+    const float edges[] = { -0.5f, 0.0f, 0.5f, 0.9999f, 1.0f, 7.0f };
+    uint8_t bytes[6];
+    ref.floatToBytes(edges, bytes, 6);
+    assert(bytes[0] == 0 && bytes[1] == 0 && bytes[2] == 127 && bytes[3] == 254 && bytes[4] == 255 && bytes[5] == 255);
+    return true;
+}
+
+// ------------------------------ activations test ------------------------------
+
+// distance from the double reference in units of the float spacing at the reference
+double ulpError(float actual, double expected)
+{
+    const float r = std::fabs(float(expected));
+    return std::fabs(actual - expected) / (std::nextafter(r, INFINITY) - r);
+}
+
+bool fastActivations()
+{
+    const int count = 100003;
+    tensor x(1, count), y(1, count);
+
+    for (hhSimdLevel level : {hhSimdLevel::Scalar, hhSimdLevel::SSE2, hhSimdLevel::AVX2, hhSimdLevel::AVX512})
+    {
+        const hhKernels* k = kernelsFor(level);
+        if (k == nullptr)
+            continue;
+
+        // sweep the whole unclamped range, odd count for the tails
+        for (int i = 0; i < count; i++)
+            x[0][i] = std::min(expHi, expLo + (expHi - expLo) * float(i) / (count - 1));
+        k->fastExp(x[0], y[0], count);
+        for (int i = 0; i < count; i++)
+            assert(ulpError(y[0][i], std::exp(double(x[0][i]))) <= 1.5);
+
+        k->fastSigmoid(x[0], y[0], count);
+        for (int i = 0; i < count; i++)
+            assert(ulpError(y[0][i], 1.0 / (1.0 + std::exp(-double(x[0][i])))) <= 3.0);
+
+        // large logits would overflow without the max subtraction
+        std::default_random_engine generator;
+        std::uniform_real_distribution<float> distribution(60.0f, 100.0f);
+        for (int n : {1, 3, 10, 17, 33, 100})
+        {
+            for (int i = 0; i < n; i++)
+                x[0][i] = distribution(generator);
+            k->fastSoftmax(x[0], y[0], n);
+
+            const float highest = *std::max_element(x[0], x[0] + n);
+            double sum = 0.0;
+            for (int i = 0; i < n; i++)
+                sum += std::exp(double(x[0][i] - highest));
+            for (int i = 0; i < n; i++)
+                assert(ulpError(y[0][i], std::exp(double(x[0][i] - highest)) / sum) <= 7.0);
+        }
+    }
+
+    // both switch settings give the same layer output
+    hhSoftmaxLayer fast(10, 4), precise(10, 4);
+    precise.activationMath = hhActivationMath::Precise;
+    precise.weights = fast.weights;
+    precise.biases = fast.biases;
+    tensor input = {{ 0.5f, -2.0f, 30.0f, 1.0f }, { 90.0f, 0.0f, -1.0f, 4.0f }};
+    fast.Forward(input);
+    precise.Forward(input);
+    for (int b = 0; b < input.rows; b++)
+        for (int n = 0; n < 10; n++)
+            assert(closeTo(fast.activationValue[b][n], precise.activationValue[b][n], 1e-5f));
+    return true;
+}
+
+// ------------------------------ gemm test ------------------------------
+
+// C = op(A) * op(B) the plain way
+void referenceGemm(bool transA, bool transB, int m, int n, int k, const tensor& a, const tensor& b, tensor& c)
+{
+    for (int i = 0; i < m; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            double sum = 0.0;
+            for (int p = 0; p < k; p++)
+                sum += (transA ? a[p][i] : a[i][p]) * (transB ? b[j][p] : b[p][j]);
+            c[i][j] = float(sum);
+        }
+    }
+}
+
+bool gemmEngine()
+{
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    // sizes straddle the register tiles and the k blocking
+    const int shapes[][3] = { {37, 45, 300}, {1, 33, 17}, {24, 200, 150}, {6, 16, 1} };
+
+    for (hhSimdLevel level : {hhSimdLevel::Scalar, hhSimdLevel::SSE2, hhSimdLevel::AVX2, hhSimdLevel::AVX512})
+    {
+        const hhKernels* kernels = kernelsFor(level);
+        if (kernels == nullptr)
+            continue;
+
+        for (const auto& shape : shapes)
+        {
+            const int m = shape[0], n = shape[1], k = shape[2];
+            for (int t = 0; t < 4; t++)
+            {
+                const bool transA = (t & 1) != 0;
+                const bool transB = (t & 2) != 0;
+
+                tensor a(transA ? k : m, transA ? m : k, true);
+                tensor b(transB ? n : k, transB ? k : n, true);
+                for (int r = 0; r < a.rows; r++)
+                    for (int c = 0; c < a.cols; c++)
+                        a[r][c] = distribution(generator);
+                for (int r = 0; r < b.rows; r++)
+                    for (int c = 0; c < b.cols; c++)
+                        b[r][c] = distribution(generator);
+
+                tensor expected(m, n), actual(m, n, true);
+                referenceGemm(transA, transB, m, n, k, a, b, expected);
+                actual.Fill(5.0f); // beta = 0 must overwrite
+                gemm(*kernels, transA, transB, m, n, k, 1.0f, a.Data(), a.stride, b.Data(), b.stride, 0.0f, actual.Data(), actual.stride);
+
+                for (int i = 0; i < m; i++)
+                    for (int j = 0; j < n; j++)
+                        assert(closeTo(actual[i][j], expected[i][j], 0.001f));
+            }
+        }
+    }
+
+    // layer forward against the original inner_product loop
+    {
+        hhReluLayer layer(33, 50);
+        tensor input(5, 50, true);
+        for (int r = 0; r < input.rows; r++)
+            for (int c = 0; c < input.cols; c++)
+                input[r][c] = distribution(generator);
+
+        layer.Forward(input);
+        for (int b = 0; b < input.rows; b++)
+        {
+            for (int n = 0; n < layer.numNeurons; n++)
+            {
+                float raw = layer.biases[0][n];
+                for (int i = 0; i < layer.numInputs; i++)
+                    raw += input[b][i] * layer.weights[n][i];
+                assert(closeTo(layer.activationValue[b][n], std::max(0.0f, raw), 0.001f));
+            }
+        }
+    }
+    return true;
+}
+
 // // ------------------------------ float->int  test  ------------------------------
 
 // // doubles and their corresponding integers
@@ -315,6 +610,1585 @@ bool seeds()
     return true;
 }
 
+bool predictBatch()
+{
+    hhModel m;
+    SeedTask t;
+    m.Configure(t);
+
+    tensor outputs;
+    m.PredictBatch(seedsDataset, outputs);
+    assert(outputs.rows == int(seedsDataset.size()) && outputs.cols == 2);
+
+    const float* storage = outputs.Data();
+    for (int i = 0; i < outputs.rows; i++)
+    {
+        const tensor& single = m.Predict(seedsDataset[i]);
+        for (int c = 0; c < outputs.cols; c++)
+            assert(std::fabs(single[0][c] - outputs[i][c]) < 0.00001);
+    }
+
+    // caller storage of the right shape is reused
+    m.PredictBatch(seedsDataset, outputs);
+    assert(outputs.Data() == storage);
+    return true;
+}
+
+// ------------------------------ data parallel test ------------------------------
+
+class ParallelSeedTask : public SeedTask
+{
+    public:
+    ParallelSeedTask(int threads) { numThreads = threads; }
+
+    void Configure(hhModel& model) override
+    {
+        SeedTask::Configure(model);
+        batchSize = 8;
+        seed = 1234;
+    }
+};
+
+bool sameWeights(hhModel& a, hhModel& b)
+{
+    for (size_t l = 1; l < a.layers.size(); l++)
+    {
+        const tensor& wa = a.layers[l]->weights;
+        const tensor& wb = b.layers[l]->weights;
+        for (int r = 0; r < wa.rows; r++)
+            for (int c = 0; c < wa.cols; c++)
+                if (wa[r][c] != wb[r][c])
+                    return false;
+    }
+    return true;
+}
+
+bool dataParallel()
+{
+    // a fixed seed and thread count reproduce the same weights bit for bit
+    hhModel m1, m2, single;
+    ParallelSeedTask t1(3), t2(3), t3(1);
+    m1.Configure(t1);
+    m2.Configure(t2);
+    single.Configure(t3);
+
+    for (int i = 0; i < 5; i++)
+    {
+        m1.Train();
+        m2.Train();
+        single.Train();
+    }
+    assert(sameWeights(m1, m2));
+
+    // sharding only changes the summation order, not the result
+    for (size_t l = 1; l < m1.layers.size(); l++)
+        for (int c = 0; c < m1.layers[l]->weights.cols; c++)
+            assert(closeTo(m1.layers[l]->weights[0][c], single.layers[l]->weights[0][c], 0.001f));
+
+    return true;
+}
+
+// ------------------------------ prefetch test ------------------------------
+
+bool prefetch()
+{
+    // the ring holds exactly its capacity
+    hhSpscQueue<int> queue(2);
+    int value = 0;
+    assert(!queue.TryPop(value));
+    assert(queue.TryPush(1) && queue.TryPush(2) && !queue.TryPush(3));
+    assert(queue.TryPop(value) && value == 1);
+    assert(queue.TryPush(3));
+    assert(queue.TryPop(value) && value == 2);
+    assert(queue.TryPop(value) && value == 3);
+    assert(!queue.TryPop(value));
+
+    // loading ahead on another thread trains on the same batches in the same order as gathering inline
+    hhModel inline_, prefetched;
+    ParallelSeedTask t1(1), t2(1);
+    t1.prefetchDepth = 0;
+    t2.prefetchDepth = 3;
+    inline_.Configure(t1);
+    prefetched.Configure(t2);
+    for (int i = 0; i < 5; i++)
+    {
+        inline_.Train();
+        prefetched.Train();
+    }
+    assert(sameWeights(inline_, prefetched));
+    assert(inline_.lastTrainError == prefetched.lastTrainError);
+    assert(inline_.numEpochs == prefetched.numEpochs);
+
+    const hhPrefetchStats& stats = prefetched.prefetcher.stats;
+    assert(stats.batches == (int(seedsDataset.size()) + 7) / 8 * t2.epochs);
+    assert(stats.stalls <= stats.batches && stats.stallSeconds >= 0.0);
+    return true;
+}
+
+// ------------------------------ checkpoint test ------------------------------
+
+bool checkpoints()
+{
+    hhModel trained;
+    SeedTask task;
+    trained.Configure(task);
+    for (int i = 0; i < 3; i++)
+        trained.Train();
+    assert(trained.Save("checkpoint_test.hhm"));
+
+    // an empty model takes its layers from the file and predicts the same without copying
+    hhModel loaded;
+    assert(loaded.Load("checkpoint_test.hhm"));
+    assert(loaded.layers.size() == trained.layers.size());
+    assert(sameWeights(loaded, trained));
+    assert(loaded.arena.IsShared() && loaded.layers[1]->weights.IsView());
+    tensor expected, actual;
+    trained.PredictBatch(seedsDataset, expected);
+    loaded.PredictBatch(seedsDataset, actual);
+    for (int r = 0; r < expected.rows; r++)
+        for (int c = 0; c < expected.cols; c++)
+            assert(expected[r][c] == actual[r][c]);
+
+    // a configured model keeps its layers and swaps in the saved weights
+    hhModel configured;
+    SeedTask other;
+    configured.Configure(other);
+    assert(configured.Load("checkpoint_test.hhm"));
+    assert(sameWeights(configured, trained));
+
+    // training a loaded model writes private pages, the file is unchanged
+    configured.Train();
+    assert(!sameWeights(configured, trained));
+    hhModel reloaded;
+    assert(reloaded.Load("checkpoint_test.hhm"));
+    assert(sameWeights(reloaded, trained));
+
+    // wrong shapes, missing and damaged files are refused
+    hhModel mismatched;
+    mismatched.AddLayer(hhLayerType::Input, 7, 0);
+    assert(!mismatched.Load("checkpoint_test.hhm"));
+    assert(mismatched.layers.size() == 1 && !mismatched.arena.IsShared());
+    assert(mismatched.layers[0]->biases.Data() == mismatched.arena.Block(0) && mismatched.layers[0]->biases[0][0] == 1.0f);
+    assert(!loaded.Load("checkpoint_missing.hhm"));
+
+    FILE* file = fopen("checkpoint_test.hhm", "r+b");
+    fputc('X', file);
+    fclose(file);
+    hhModel damaged;
+    assert(!damaged.Load("checkpoint_test.hhm"));
+    assert(damaged.layers.empty());
+
+    remove("checkpoint_test.hhm");
+    return true;
+}
+
+// ------------------------------ quantize test ------------------------------
+
+bool quantize()
+{
+    // a fixed shuffle, the agreement bound below holds for this run rather than most runs
+    hhModel m;
+    SeedTask task;
+    task.seed = 1234;
+    m.Configure(task);
+    for (int i = 0; i < 5; i++)
+        m.Train();
+
+    m.Quantize();
+    const hhDenseLayer* first = static_cast<const hhDenseLayer*>(m.layers[1].get());
+    assert(first->quantized && first->inputScale > 0.0f);
+
+    // per row scales bring every weight back to within half a step
+    for (int n = 0; n < first->numNeurons; n++)
+        for (int i = 0; i < first->numInputs; i++)
+            assert(std::fabs(first->quantizedWeights[n][i] * first->weightScales[0][n] - first->weights[n][i]) <= first->weightScales[0][n] * 0.5f + 1e-6f);
+
+    const hhQuantizationReport report = m.CompareQuantized(task.inputs, task.targets);
+    assert(report.samples == task.inputs.rows);
+    assert(report.agreement >= 0.9f);
+    assert(std::fabs(report.floatAccuracy - report.int8Accuracy) <= 0.1f);
+    assert(report.maxOutputDelta < 0.1f);
+    // one byte per weight plus a float per row
+    size_t weights = 0, rows = 0;
+    for (size_t l = 1; l < m.layers.size(); l++)
+    {
+        weights += m.layers[l]->weights.Size();
+        rows += m.layers[l]->numNeurons;
+    }
+    assert(report.floatWeightBytes == weights * sizeof(float));
+    assert(report.int8WeightBytes == weights + rows * sizeof(float));
+
+    // training moves the weights, so the int8 copy goes
+    m.Train();
+    assert(!first->quantized && first->quantizedWeights.rows == 0);
+    return true;
+}
+
+// ------------------------------ precision test ------------------------------
+
+bool sameBits(float a, float b)
+{
+    return std::memcmp(&a, &b, sizeof(a)) == 0 || (std::isnan(a) && std::isnan(b));
+}
+
+bool halfPrecision()
+{
+    // rounding to nearest even at the overflow edge, on ties and in the denormals
+    const hhKernels& ref = scalarKernels;
+    const float values[] = { 65519.0f, 65520.0f, 1.0f + 1.0f / 2048, 1.0f + 3.0f / 2048, std::ldexp(1.0f, -25), std::ldexp(3.0f, -25), -0.0f, 1e-40f };
+    const uint16_t halves[] = { 0x7bff, 0x7c00, 0x3c00, 0x3c02, 0x0000, 0x0002, 0x8000, 0x0000 };
+    const uint16_t bfloats[] = { 0x4780, 0x4780, 0x3f80, 0x3f80, 0x3300, 0x33c0, 0x8000, 0x0000 };
+    const int numValues = sizeof(values) / sizeof(values[0]);
+    uint16_t narrowed[numValues];
+    ref.floatToHalf(values, narrowed, numValues);
+    for (int i = 0; i < numValues; i++)
+        assert(narrowed[i] == halves[i]);
+    ref.floatToBfloat16(values, narrowed, numValues);
+    for (int i = 0; i < numValues; i++)
+        assert(narrowed[i] == bfloats[i]);
+
+    // every 16-bit pattern, plus float bit patterns spread over the whole range with an odd count for the tails
+    const int numPatterns = 65536;
+    std::vector<uint16_t> patterns(numPatterns);
+    for (int i = 0; i < numPatterns; i++)
+        patterns[i] = uint16_t(i);
+    const int numFloats = 100003;
+    std::vector<float> floats(numFloats);
+    for (int i = 0; i < numFloats; i++)
+    {
+        const uint32_t bits = uint32_t(i) * 42947u;
+        std::memcpy(&floats[i], &bits, sizeof(bits));
+    }
+
+    std::vector<float> expected(numFloats), actual(numFloats);
+    std::vector<uint16_t> expectedBits(numFloats), actualBits(numFloats);
+    for (hhSimdLevel level : {hhSimdLevel::SSE2, hhSimdLevel::AVX2, hhSimdLevel::AVX512})
+    {
+        const hhKernels* k = kernelsFor(level);
+        if (k == nullptr)
+            continue;
+
+        ref.halfToFloat(patterns.data(), expected.data(), numPatterns);
+        k->halfToFloat(patterns.data(), actual.data(), numPatterns - 1);
+        for (int i = 0; i < numPatterns - 1; i++)
+            assert(sameBits(actual[i], expected[i]));
+
+        // widening is exact, so narrowing gives back every half that is not a NaN
+        k->floatToHalf(actual.data(), actualBits.data(), numPatterns - 1);
+        for (int i = 0; i < numPatterns - 1; i++)
+            assert(actualBits[i] == patterns[i] || std::isnan(actual[i]));
+
+        ref.bfloat16ToFloat(patterns.data(), expected.data(), numPatterns);
+        k->bfloat16ToFloat(patterns.data(), actual.data(), numPatterns - 1);
+        for (int i = 0; i < numPatterns - 1; i++)
+            assert(sameBits(actual[i], expected[i]));
+
+        ref.floatToHalf(floats.data(), expectedBits.data(), numFloats);
+        k->floatToHalf(floats.data(), actualBits.data(), numFloats);
+        for (int i = 0; i < numFloats; i++)
+            assert(actualBits[i] == expectedBits[i] || std::isnan(floats[i]));
+
+        ref.floatToBfloat16(floats.data(), expectedBits.data(), numFloats);
+        k->floatToBfloat16(floats.data(), actualBits.data(), numFloats);
+        for (int i = 0; i < numFloats; i++)
+            assert(actualBits[i] == expectedBits[i]);
+
+        // 7 rows of 37 cover the four row blocks and every tail
+        const int rows = 7, cols = 37;
+        hhTensor<uint16_t> w(rows, cols, true);
+        std::vector<float> x(cols);
+        for (int r = 0; r < rows; r++)
+        {
+            for (int c = 0; c < cols; c++)
+                x[c] = float((r * 37 + c * 11) % 201 - 100) / 64.0f;
+            ref.floatToHalf(x.data(), w[r], cols);
+        }
+        float y1[rows], y2[rows];
+        ref.gemvHalf(w.Data(), w.stride, x.data(), y1, rows, cols);
+        k->gemvHalf(w.Data(), w.stride, x.data(), y2, rows, cols);
+        for (int r = 0; r < rows; r++)
+            assert(closeTo(y1[r], y2[r], 0.001f));
+        ref.gemvBfloat16(w.Data(), w.stride, x.data(), y1, rows, cols);
+        k->gemvBfloat16(w.Data(), w.stride, x.data(), y2, rows, cols);
+        for (int r = 0; r < rows; r++)
+            assert(closeTo(y1[r], y2[r], 0.001f));
+    }
+
+    // a gemm reading 16-bit B matches the float gemm on the widened values
+    const hhKernels& k = activeKernels();
+    const int m = 5, n = 37, inner = 300;
+    tensor a(m, inner, true), bt(n, inner, true), widened(n, inner, true);
+    hhTensor<uint16_t> stored(n, inner, true);
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    for (int r = 0; r < m; r++)
+        for (int c = 0; c < inner; c++)
+            a[r][c] = distribution(generator);
+    for (int r = 0; r < n; r++)
+    {
+        for (int c = 0; c < inner; c++)
+            bt[r][c] = distribution(generator);
+        k.floatToHalf(bt[r], stored[r], inner);
+        k.halfToFloat(stored[r], widened[r], inner);
+    }
+    tensor c1(m, n, true), c2(m, n, true);
+    for (int rows : {m, 1})
+    {
+        gemm(false, true, rows, n, inner, 1.0f, a.Data(), a.stride, widened.Data(), widened.stride, 0.0f, c1.Data(), c1.stride);
+        gemm(false, true, rows, n, inner, 1.0f, a.Data(), a.stride, stored.Data(), stored.stride, hhPrecision::Float16, 0.0f, c2.Data(), c2.stride);
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < n; c++)
+                assert(closeTo(c1[r][c], c2[r][c], 0.001f));
+    }
+    // and untransposed, as back propagation uses it
+    tensor e(m, n, true), d1(m, inner, true), d2(m, inner, true);
+    for (int r = 0; r < m; r++)
+        for (int c = 0; c < n; c++)
+            e[r][c] = distribution(generator);
+    gemm(false, false, m, inner, n, 1.0f, e.Data(), e.stride, widened.Data(), widened.stride, 0.0f, d1.Data(), d1.stride);
+    gemm(false, false, m, inner, n, 1.0f, e.Data(), e.stride, stored.Data(), stored.stride, hhPrecision::Float16, 0.0f, d2.Data(), d2.stride);
+    for (int r = 0; r < m; r++)
+        for (int c = 0; c < inner; c++)
+            assert(d1[r][c] == d2[r][c]);
+
+    // 16-bit models train like the float32 one, and the stored copy tracks the master weights
+    hhModel reference;
+    ParallelSeedTask referenceTask(1);
+    reference.Configure(referenceTask);
+    for (int i = 0; i < 5; i++)
+        reference.Train();
+    tensor expectedOutputs, outputs;
+    reference.PredictBatch(seedsDataset, expectedOutputs);
+
+    for (hhPrecision precision : {hhPrecision::Float16, hhPrecision::BFloat16})
+    {
+        for (int threads : {1, 3})
+        {
+            hhModel reduced;
+            ParallelSeedTask task(threads);
+            task.precision = precision;
+            reduced.Configure(task);
+            for (int i = 0; i < 5; i++)
+                reduced.Train();
+
+            reduced.PredictBatch(seedsDataset, outputs);
+            for (int r = 0; r < outputs.rows; r++)
+                for (int c = 0; c < outputs.cols; c++)
+                    assert(std::fabs(outputs[r][c] - expectedOutputs[r][c]) < 0.05f);
+
+            const hhDenseLayer* first = static_cast<const hhDenseLayer*>(reduced.layers[1].get());
+            uint16_t narrowedWeight;
+            if (precision == hhPrecision::BFloat16)
+                scalarKernels.floatToBfloat16(first->weights[0], &narrowedWeight, 1);
+            else
+                scalarKernels.floatToHalf(first->weights[0], &narrowedWeight, 1);
+            assert(first->storedWeights.rows == first->numNeurons && first->storedWeights[0][0] == narrowedWeight);
+        }
+    }
+    assert(static_cast<const hhDenseLayer*>(reference.layers[1].get())->storedWeights.rows == 0);
+    return true;
+}
+
+// ------------------------------ fused layer test ------------------------------
+
+// one training step on the layers of m, fused or as separate backward and update passes
+void trainLayers(hhModel& m, const tensor& inputs, const tensor& targets, float rate, bool fused)
+{
+    m.Forward(inputs);
+    hhLayer* next = nullptr;
+    for (size_t i = m.layers.size() - 1; i > 0; i--)
+    {
+        const tensor& useTarget = (next == nullptr) ? targets : next->activationValue;
+        if (fused)
+            m.layers[i]->BackwardUpdate(*m.layers[i - 1], next, useTarget, rate);
+        else
+            m.layers[i]->Backward(*m.layers[i - 1], next, useTarget);
+        next = m.layers[i].get();
+    }
+    if (!fused)
+    {
+        for (size_t i = 1; i < m.layers.size(); i++)
+            m.layers[i]->UpdateWeightsAndBiases(hhOptimizer().Step(rate, 1));
+    }
+}
+
+bool fusedLayers()
+{
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    // the epilogue inside gemm gives the same bits as applying it to the finished product
+    const int shapes[][3] = { {37, 45, 300}, {1, 33, 17}, {6, 40, 1} };
+    const hhEpilogueOp ops[] = { hhEpilogueOp::Bias, hhEpilogueOp::BiasSigmoid, hhEpilogueOp::BiasRelu };
+    for (hhSimdLevel level : {hhSimdLevel::Scalar, hhSimdLevel::SSE2, hhSimdLevel::AVX2, hhSimdLevel::AVX512})
+    {
+        const hhKernels* kernels = kernelsFor(level);
+        if (kernels == nullptr)
+            continue;
+
+        for (const auto& shape : shapes)
+        {
+            const int m = shape[0], n = shape[1], k = shape[2];
+            tensor a(m, k, true), b(n, k, true), bias(1, n, true);
+            hhTensor<uint16_t> stored(n, k, true);
+            for (int r = 0; r < m; r++)
+                for (int c = 0; c < k; c++)
+                    a[r][c] = distribution(generator);
+            for (int r = 0; r < n; r++)
+            {
+                for (int c = 0; c < k; c++)
+                    b[r][c] = distribution(generator);
+                kernels->floatToHalf(b[r], stored[r], k);
+            }
+            for (int c = 0; c < n; c++)
+                bias[0][c] = distribution(generator);
+
+            for (hhEpilogueOp op : ops)
+            {
+                const hhGemmEpilogue epilogue = { op, bias[0] };
+                tensor expected(m, n, true), actual(m, n, true);
+                gemm(*kernels, false, true, m, n, k, 1.0f, a.Data(), a.stride, b.Data(), b.stride, 0.0f, expected.Data(), expected.stride);
+                for (int r = 0; r < m; r++)
+                    applyEpilogue(*kernels, epilogue, expected[r], 0, n);
+                gemm(*kernels, false, true, m, n, k, 1.0f, a.Data(), a.stride, b.Data(), b.stride, 0.0f, actual.Data(), actual.stride, epilogue);
+                for (int r = 0; r < m; r++)
+                    for (int c = 0; c < n; c++)
+                        assert(actual[r][c] == expected[r][c]);
+
+                gemm(*kernels, false, true, m, n, k, 1.0f, a.Data(), a.stride, stored.Data(), stored.stride, hhPrecision::Float16, 0.0f, expected.Data(), expected.stride);
+                for (int r = 0; r < m; r++)
+                    applyEpilogue(*kernels, epilogue, expected[r], 0, n);
+                gemm(*kernels, false, true, m, n, k, 1.0f, a.Data(), a.stride, stored.Data(), stored.stride, hhPrecision::Float16, 0.0f, actual.Data(), actual.stride, epilogue);
+                for (int r = 0; r < m; r++)
+                    for (int c = 0; c < n; c++)
+                        assert(actual[r][c] == expected[r][c]);
+            }
+        }
+
+        // the fused backward sweep against the scalar reference, with and without propagation
+        const int rows = 13, cols = 37, batch = 5;
+        tensor errors(batch, rows, true), inputs(batch, cols, true), w(rows, cols, true), expectedW(rows, cols, true);
+        tensor propagated(batch, cols, true), expectedPropagated(batch, cols, true);
+        for (int b = 0; b < batch; b++)
+        {
+            for (int r = 0; r < rows; r++)
+                errors[b][r] = distribution(generator);
+            for (int c = 0; c < cols; c++)
+                inputs[b][c] = distribution(generator);
+        }
+        for (bool propagate : {true, false})
+        {
+            for (int r = 0; r < rows; r++)
+                for (int c = 0; c < cols; c++)
+                    w[r][c] = expectedW[r][c] = distribution(generator);
+            propagated.Fill(0.5f);
+            expectedPropagated.Fill(0.5f);
+
+            scalarKernels.denseBackward(rows, cols, batch, errors.Data(), errors.stride, inputs.Data(), inputs.stride,
+                propagate ? expectedPropagated.Data() : nullptr, expectedPropagated.stride, expectedW.Data(), expectedW.stride, 0.1f);
+            kernels->denseBackward(rows, cols, batch, errors.Data(), errors.stride, inputs.Data(), inputs.stride,
+                propagate ? propagated.Data() : nullptr, propagated.stride, w.Data(), w.stride, 0.1f);
+            for (int r = 0; r < rows; r++)
+                for (int c = 0; c < cols; c++)
+                    assert(closeTo(w[r][c], expectedW[r][c]));
+            for (int b = 0; b < batch; b++)
+                for (int c = 0; c < cols; c++)
+                    assert(closeTo(propagated[b][c], expectedPropagated[b][c]) && (propagate || propagated[b][c] == 0.5f));
+        }
+    }
+
+    // a fused step lands on the same weights as backward, then update, for every layer type
+    hhModel fused, separate;
+    for (hhModel* m : {&fused, &separate})
+    {
+        m->AddLayer(hhLayerType::Input, 150, 0);
+        m->AddLayer(hhLayerType::Relu, 40, 150);
+        m->AddLayer(hhLayerType::Sigmoid, 21, 40);
+        m->AddLayer(hhLayerType::Softmax, 10, 21);
+    }
+    tensor inputs(7, 150, true), targets(7, 10, true);
+    for (int b = 0; b < inputs.rows; b++)
+    {
+        for (int c = 0; c < inputs.cols; c++)
+            inputs[b][c] = distribution(generator);
+        targets[b][b % targets.cols] = 1.0f;
+    }
+    for (int step = 0; step < 3; step++)
+    {
+        trainLayers(fused, inputs, targets, 0.1f, true);
+        trainLayers(separate, inputs, targets, 0.1f, false);
+    }
+    for (size_t l = 1; l < fused.layers.size(); l++)
+    {
+        const hhLayer& a = *fused.layers[l];
+        const hhLayer& b = *separate.layers[l];
+        for (int r = 0; r < a.weights.rows; r++)
+        {
+            for (int c = 0; c < a.weights.cols; c++)
+                assert(closeTo(a.weights[r][c], b.weights[r][c]));
+            assert(closeTo(a.biases[0][r], b.biases[0][r]));
+        }
+    }
+    return true;
+}
+
+// ------------------------------ sparse backward test ------------------------------
+
+bool deadUnits()
+{
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    tensor inputs(7, 40, true), targets(7, 10, true);
+    for (int b = 0; b < inputs.rows; b++)
+    {
+        for (int c = 0; c < inputs.cols; c++)
+            inputs[b][c] = distribution(generator);
+        targets[b][b % targets.cols] = 1.0f;
+    }
+
+    // skipping the units a batch leaves dead gives the dense path's weights, and the errors it propagates
+    // reach the layer below unchanged
+    for (hhPrecision precision : {hhPrecision::Float32, hhPrecision::Float16})
+    {
+        for (bool fused : {true, false})
+        {
+            hhModel sparse, dense;
+            for (hhModel* m : {&sparse, &dense})
+            {
+                m->AddLayer(hhLayerType::Input, 40, 0);
+                m->AddLayer(hhLayerType::Sigmoid, 30, 40);
+                m->AddLayer(hhLayerType::Relu, 64, 30);
+                m->AddLayer(hhLayerType::Softmax, 10, 64);
+
+                // three quarters of the relu units can never fire
+                hhDenseLayer* relu = static_cast<hhDenseLayer*>(m->layers[2].get());
+                relu->sparseBackward = m == &sparse;
+                for (int n = 0; n < 48; n++)
+                    relu->biases[0][n] = -100.0f;
+                for (size_t l = 1; l < m->layers.size(); l++)
+                {
+                    m->layers[l]->precision = precision;
+                    static_cast<hhDenseLayer*>(m->layers[l].get())->StoreWeights();
+                }
+            }
+
+            for (int step = 0; step < 3; step++)
+            {
+                trainLayers(sparse, inputs, targets, 0.1f, fused);
+                trainLayers(dense, inputs, targets, 0.1f, fused);
+            }
+            const hhDenseLayer* relu = static_cast<const hhDenseLayer*>(sparse.layers[2].get());
+            assert(relu->liveUnits.size() > 0 && relu->liveUnits.size() <= 16 && relu->liveUnits.back() >= 48);
+            assert(static_cast<const hhDenseLayer*>(dense.layers[2].get())->liveUnits.empty());
+
+            for (size_t l = 1; l < sparse.layers.size(); l++)
+            {
+                const hhDenseLayer& a = static_cast<const hhDenseLayer&>(*sparse.layers[l]);
+                const hhDenseLayer& b = static_cast<const hhDenseLayer&>(*dense.layers[l]);
+                for (int r = 0; r < a.weights.rows; r++)
+                {
+                    for (int c = 0; c < a.weights.cols; c++)
+                    {
+                        assert(closeTo(a.weights[r][c], b.weights[r][c]));
+                        assert(precision == hhPrecision::Float32 || a.storedWeights[r][c] == b.storedWeights[r][c]);
+                    }
+                    assert(closeTo(a.biases[0][r], b.biases[0][r]));
+                }
+            }
+        }
+    }
+
+    // with most units live the dense path runs as before
+    hhModel busy;
+    busy.AddLayer(hhLayerType::Input, 40, 0);
+    busy.AddLayer(hhLayerType::Relu, 64, 40);
+    busy.AddLayer(hhLayerType::Softmax, 10, 64);
+    hhDenseLayer* relu = static_cast<hhDenseLayer*>(busy.layers[1].get());
+    relu->biases.Fill(1.0f);
+    trainLayers(busy, inputs, targets, 0.1f, false);
+    assert(relu->liveUnits.empty());
+    return true;
+}
+
+// ------------------------------ dataset test ------------------------------
+
+// writes count records whose label and pixel bytes derive from first + record number
+void writeCifar(const char* filename, int first, int count)
+{
+    FILE* file = fopen(filename, "wb");
+    std::vector<unsigned char> record(hhCifarDataset::recordSize);
+    for (int i = 0; i < count; i++)
+    {
+        record[0] = (unsigned char)((first + i) % hhCifarDataset::numCategories);
+        for (int p = 1; p < hhCifarDataset::recordSize; p++)
+            record[p] = (unsigned char)((first + i + p) & 255);
+        fwrite(record.data(), 1, record.size(), file);
+    }
+    fclose(file);
+}
+
+bool cifarDataset()
+{
+    writeCifar("cifar_a.bin", 0, 3);
+    writeCifar("cifar_b.bin", 3, 4);
+
+    {
+        hhCifarDataset data;
+        assert(!data.Open({ "cifar_a.bin", "cifar_missing.bin" }));
+        assert(data.Open({ "cifar_a.bin", "cifar_b.bin" }));
+        assert(data.Count() == 7);
+
+        // records run on across files
+        for (int i = 0; i < data.Count(); i++)
+        {
+            assert(data.Label(i) == i % hhCifarDataset::numCategories);
+            assert(data.Record(i)[1] == ((i + 1) & 255));
+        }
+
+        const int indices[] = { 5, 0, 3 };
+        tensor images, categories;
+        data.Decode(indices, 3, images, categories);
+        assert(images.rows == 3 && images.cols == hhCifarDataset::imageSize);
+        for (int b = 0; b < 3; b++)
+        {
+            // pixel 1 of the green plane is record byte 1 + 1024 + 1
+            const int byte = 1 + 1024 + 1;
+            assert(closeTo(images[b][1024 + 1], ((indices[b] + byte) & 255) / 255.0f));
+            assert(argmax(categories[b], hhCifarDataset::numCategories) == indices[b]);
+        }
+
+        // same shape, same storage
+        const float* storage = images.Data();
+        data.Decode(indices, 3, images, categories);
+        assert(images.Data() == storage);
+    }
+
+    remove("cifar_a.bin");
+    remove("cifar_b.bin");
+    return true;
+}
+
+class StatsTask : public hhTask
+{
+    public:
+    void Configure(hhModel& model) override
+    {
+        learningRate = 0.1f;
+        epochs = 2;
+        batchSize = 3;
+        inputs.Resize(6, 4);
+        inputs.Fill(0.5f);
+        targets.Resize(6, 2);
+        for (int i = 0; i < targets.rows; i++)
+            targets[i][0] = 1.0f;
+        AddLayer(hhLayerType::Input, 4, 0);
+        AddLayer(hhLayerType::Relu, 3, 4);
+        AddLayer(hhLayerType::Softmax, 2, 3);
+    }
+};
+
+bool modelStats()
+{
+    hhModel m;
+    StatsTask t;
+    m.Configure(t);
+    assert(m.stats.layers.size() == m.layers.size());
+
+    m.Train();
+    assert(m.lastTrainTime > 0.0f);
+
+#if HH_STATS
+    // two epochs of two batches of three, all on the fused path
+    const hhLayerStats& hidden = m.stats.layers[1];
+    const hhLayerStats& output = m.stats.layers[2];
+    assert(m.stats.epochs == 2 && m.stats.trainSamples == 12);
+    assert(m.stats.trainSeconds > 0.0 && m.stats.lastEpochSeconds > 0.0 && m.stats.SamplesPerSecond() > 0.0);
+    assert(hidden.forwardSamples == 12 && hidden.backwardSamples == 12);
+    assert(hidden.forwardFlops == 2.0 * 12 * 4 * 3 && output.forwardFlops == 2.0 * 12 * 3 * 2);
+
+    // the hidden layer has nothing to propagate into, the output layer does
+    assert(hidden.backwardFlops == 4 * (2.0 * 3 * 12 + 2.0 * 12));
+    assert(output.backwardFlops == 4 * (2.0 * 3 * 6 * 2 + 2.0 * 6));
+    assert(hidden.forwardSeconds > 0.0 && hidden.backwardSeconds > 0.0 && hidden.updateSeconds == 0.0);
+    assert(hidden.ForwardIntensity() > 0.0 && output.BackwardGflops() > 0.0);
+
+    // data-parallel steps time the reduce and the separate update
+    m.stats.Reset();
+    assert(m.stats.layers.size() == 3 && m.stats.trainSamples == 0 && m.stats.layers[1].forwardFlops == 0.0);
+    t.numThreads = 2;
+    m.Train();
+    const hhLayerStats& shard = m.stats.layers[1];
+    assert(m.stats.epochs == 2 && m.stats.trainSamples == 12);
+    assert(shard.reduceSeconds > 0.0 && shard.updateSeconds > 0.0);
+    assert(shard.forwardSamples == 4 * 1);   // worker 0 runs one of each three samples
+
+    // switched off, only the Train totals move
+    m.stats.Reset();
+    m.stats.layerTiming = false;
+    m.Train();
+    assert(m.stats.trainSamples == 12 && m.stats.layers[1].forwardSeconds == 0.0 && m.stats.layers[1].forwardFlops == 0.0);
+#else
+    assert(m.stats.epochs == 0 && m.stats.trainSamples == 0 && m.stats.layers[1].forwardFlops == 0.0);
+#endif
+
+    return true;
+}
+
+// ------------------------------ static model test ------------------------------
+
+class StaticTask : public hhTask
+{
+    public:
+    explicit StaticTask(int batch) { batchSize = batch; }
+
+    void Configure(hhModel& model) override
+    {
+        learningRate = 0.5f;
+        epochs = 20;
+        seed = 7;
+        prefetchDepth = 0;
+        inputs = seedsDataset;
+        targets = seedsOutputs;
+        AddLayer(hhLayerType::Input, 2, 0);
+        AddLayer(hhLayerType::Sigmoid, 9, 2);
+        AddLayer(hhLayerType::Sigmoid, 2, 9);
+    }
+};
+
+using StaticSeeds = hhStaticModel<hhInput<2>, hhSigmoid<9>, hhSigmoid<2>>;
+
+// the static model's outputs against the dynamic model's, row by row
+template <typename Static>
+bool samePredictions(Static& fixed, hhModel& dynamic, const tensor& inputs, float tolerance)
+{
+    tensor expected;
+    dynamic.PredictBatch(inputs, expected);
+    for (int r = 0; r < inputs.rows; r++)
+    {
+        const float* actual = fixed.Predict(inputs[r]);
+        for (int c = 0; c < Static::numOutputs; c++)
+            if (!closeTo(actual[c], expected[r][c], tolerance))
+                return false;
+    }
+    return true;
+}
+
+bool staticModel()
+{
+    const tensor samples = seedsDataset;
+
+    // single samples and mini-batches train like the dynamic model from the same task and seed
+    for (int batch : { 0, 4 })
+    {
+        StaticTask dynamicTask(batch), staticTask(batch);
+        hhModel dynamic;
+        dynamic.Configure(dynamicTask);
+        StaticSeeds fixed;
+        assert(fixed.Configure(staticTask));
+        assert(samePredictions(fixed, dynamic, samples, 0.00001f));
+
+        for (int i = 0; i < 3; i++)
+        {
+            dynamic.Train();
+            fixed.Train();
+        }
+        assert(fixed.numEpochs == dynamic.numEpochs);
+        assert(samePredictions(fixed, dynamic, samples, 0.001f));
+    }
+
+    // a task describing another topology is refused
+    {
+        StaticTask task(0);
+        hhStaticModel<hhInput<2>, hhSigmoid<8>, hhSigmoid<2>> other;
+        assert(!other.Configure(task));
+    }
+
+    // checkpoints go both ways
+    {
+        StaticTask task(0);
+        StaticSeeds fixed;
+        assert(fixed.Configure(task));
+        fixed.Train();
+        assert(fixed.Save("static_test.hhm"));
+
+        hhModel loaded;
+        assert(loaded.Load("static_test.hhm"));
+        assert(samePredictions(fixed, loaded, samples, 0.00001f));
+
+        StaticSeeds reloaded;
+        assert(reloaded.Load("static_test.hhm"));
+        for (int r = 0; r < samples.rows; r++)
+        {
+            const float expected = fixed.Predict(samples[r])[1];
+            assert(reloaded.Predict(samples[r])[1] == expected);
+        }
+        hhStaticModel<hhInput<2>, hhRelu<9>, hhSigmoid<2>> relu;
+        assert(!relu.Load("static_test.hhm"));
+        remove("static_test.hhm");
+    }
+
+    // relu and softmax layers, and an unrolled layer beside a looped one
+    {
+        using Wide = hhStaticModel<hhInput<40>, hhRelu<12>, hhSoftmax<3>>;
+        Wide fixed;
+        hhModel dynamic;
+        assert(fixed.CopyTo(dynamic));
+        StaticTask settings(5);     // TrainBatch reads its learning rate and thread count
+        settings.learningRate = 0.1f;
+        dynamic.task = &settings;
+        assert(!std::get<0>(fixed.layers).unrolled && std::get<1>(fixed.layers).unrolled);
+
+        std::default_random_engine generator;
+        std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+        tensor inputs(5, 40, true), targets(5, 3, true);
+        for (int r = 0; r < inputs.rows; r++)
+        {
+            for (int c = 0; c < inputs.cols; c++)
+                inputs[r][c] = distribution(generator);
+            targets[r][r % 3] = 1.0f;
+        }
+        assert(samePredictions(fixed, dynamic, inputs, 0.00001f));
+
+        for (int step = 0; step < 5; step++)
+        {
+            fixed.TrainBatch(inputs, targets, settings.learningRate);
+            dynamic.TrainBatch(inputs, targets);
+        }
+        assert(samePredictions(fixed, dynamic, inputs, 0.0001f));
+    }
+
+    return true;
+}
+
+// ------------------------------ conv test ------------------------------
+
+// images of the given shape with values in [-1, 1], and one-hot targets
+void randomImages(int count, const hhConvShape& shape, int numCategories, tensor& images, tensor& categories, unsigned seed)
+{
+    std::default_random_engine generator(seed);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    images.Resize(count, shape.InputSize(), true);
+    categories.Resize(count, numCategories, true);
+    for (int b = 0; b < count; b++)
+    {
+        for (int i = 0; i < shape.InputSize(); i++)
+            images[b][i] = distribution(generator);
+        categories[b][b % numCategories] = 1.0f;
+    }
+}
+
+class ConvTask : public hhTask
+{
+    public:
+    ConvTask(int threads) { numThreads = threads; }
+
+    void Configure(hhModel& model) override
+    {
+        learningRate = 0.05f;
+        epochs = 2;
+        batchSize = 6;
+        seed = 4321;
+
+        // 6x6 RGB, an unpadded convolution gives 5x5x4, a strided padded one 3x3x4, overlapping pooling 2x2x4,
+        // then padded and pointwise convolutions end at 2x2x3
+        const hhConvShape first = hhConvShape::Conv(3, 6, 6, 4, 2);
+        const hhConvShape strided = hhConvShape::Conv(4, 5, 5, 4, 3, 2, 1);
+        const hhConvShape pool = hhConvShape::Pool(4, 3, 3, 2, 1);
+        const hhConvShape padded = hhConvShape::Conv(4, 2, 2, 4, 3, 1, 1);
+        const hhConvShape pointwise = hhConvShape::Conv(4, 2, 2, 3, 1);
+        randomImages(18, first, 3, inputs, targets, 7);
+
+        AddLayer(hhLayerType::Input, first.InputSize(), 0);
+        AddLayer(hhLayerType::Conv2D, first);
+        AddLayer(hhLayerType::Conv2D, strided);
+        AddLayer(hhLayerType::MaxPool, pool);
+        AddLayer(hhLayerType::Conv2D, padded);
+        AddLayer(hhLayerType::Conv2D, pointwise);
+        AddLayer(hhLayerType::Softmax, 3, pointwise.OutputSize());
+    }
+};
+
+// summed cross-entropy of the model's softmax outputs
+double crossEntropy(hhModel& m, const tensor& inputs, const tensor& targets)
+{
+    m.Forward(inputs);
+    const tensor& outputs = m.layers.back()->activationValue;
+    double loss = 0.0;
+    for (int b = 0; b < outputs.rows; b++)
+        for (int c = 0; c < outputs.cols; c++)
+            loss -= targets[b][c] * std::log(double(outputs[b][c]));
+    return loss;
+}
+
+bool convLayers()
+{
+    // shapes are checked against the previous layer and each other
+    {
+        hhModel m;
+        m.AddLayer(hhLayerType::Input, 3 * 4 * 4, 0);
+        assert(m.AddLayer(hhLayerType::Conv2D, 32, 48) == nullptr);
+        assert(m.AddLayer(hhLayerType::Relu, hhConvShape::Conv(3, 4, 4, 2, 3)) == nullptr);
+        assert(m.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(3, 4, 5, 2, 3)) == nullptr);
+        assert(m.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(3, 4, 4, 2, 5)) == nullptr);
+        assert(m.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(3, 4, 4, 2, 3, 1, 3)) == nullptr);
+        assert(m.AddLayer(hhLayerType::MaxPool, hhConvShape::Conv(3, 4, 4, 3, 2, 2, 1)) == nullptr);
+        hhLayer* conv = m.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(3, 4, 4, 2, 3));
+        assert(conv != nullptr && conv->numNeurons == 2 * 2 * 2 && conv->weights.rows == 2 && conv->weights.cols == 27);
+        assert(m.AddLayer(hhLayerType::MaxPool, hhConvShape::Pool(2, 2, 2, 2, 2)) != nullptr);
+        assert(m.layers.back()->numNeurons == 2 && m.layers.back()->weights.Size() == 0);
+    }
+
+    ConvTask task(1);
+    hhModel m;
+    m.Configure(task);
+    assert(m.layers.size() == 7);
+    std::default_random_engine generator(11);
+    std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+    for (size_t l = 1; l < m.layers.size(); l++)
+    {
+        m.layers[l]->activationMath = hhActivationMath::Precise;
+        for (int f = 0; f < m.layers[l]->biases.cols; f++)
+            m.layers[l]->biases[0][f] = distribution(generator);
+    }
+
+    // softmax layers start at zero, which would hide every gradient behind it
+    tensor& output = m.layers[6]->weights;
+    for (int r = 0; r < output.rows; r++)
+        for (int c = 0; c < output.cols; c++)
+            output[r][c] = 4.0f * distribution(generator);
+
+    // forward against the convolutions and pooling written out as loops
+    const tensor batch = task.inputs.View(0, 4);
+    m.Forward(batch);
+    for (size_t l = 1; l < 5; l++)
+    {
+        const hhLayer& layer = *m.layers[l];
+        const hhConvShape& s = layer.shape;
+        const tensor& in = m.layers[l - 1]->activationValue;
+        for (int b = 0; b < batch.rows; b++)
+        for (int f = 0; f < s.filters; f++)
+        for (int oy = 0; oy < s.OutputHeight(); oy++)
+        for (int ox = 0; ox < s.OutputWidth(); ox++)
+        {
+            const bool pool = layer.type == hhLayerType::MaxPool;
+            double value = pool ? -1e30 : layer.biases[0][f];
+            for (int c = 0; c < s.channels; c++)
+            for (int ky = 0; ky < s.kernel; ky++)
+            for (int kx = 0; kx < s.kernel; kx++)
+            {
+                const int y = oy * s.stride - s.padding + ky, x = ox * s.stride - s.padding + kx;
+                if (y < 0 || y >= s.height || x < 0 || x >= s.width)
+                    continue;
+                const float pixel = in[b][(c * s.height + y) * s.width + x];
+                if (!pool)
+                    value += layer.weights[f][(c * s.kernel + ky) * s.kernel + kx] * pixel;
+                else if (c == f)
+                    value = std::max(value, double(pixel));
+            }
+            const float actual = layer.activationValue[b][(f * s.OutputHeight() + oy) * s.OutputWidth() + ox];
+            assert(pool ? actual == float(value) : closeTo(actual, float(std::max(0.0, value)), 0.0001f));
+        }
+    }
+
+    // Backward's gradients match finite differences of the loss, through the pooling and every convolution
+    const tensor targets = task.targets.View(0, 4);
+    m.Forward(batch);
+    hhLayer* next = nullptr;
+    for (size_t i = m.layers.size() - 1; i > 0; i--)
+    {
+        m.layers[i]->Backward(*m.layers[i - 1], next, next == nullptr ? targets : next->activationValue);
+        next = m.layers[i].get();
+    }
+    for (size_t l : { size_t(1), size_t(2), size_t(4), size_t(5) })
+    {
+        hhDenseLayer& layer = *static_cast<hhDenseLayer*>(m.layers[l].get());
+        for (int f = 0; f < layer.weights.rows; f++)
+        {
+            for (int j = 0; j < layer.weights.cols; j += 5)
+            {
+                const float saved = layer.weights[f][j];
+                const float h = 0.001f;
+                layer.weights[f][j] = saved + h;
+                const double up = crossEntropy(m, batch, targets);
+                layer.weights[f][j] = saved - h;
+                const double down = crossEntropy(m, batch, targets);
+                layer.weights[f][j] = saved;
+                const double numeric = (up - down) / (2.0 * h);
+                assert(std::fabs(numeric - layer.weightGradients[f][j]) < 0.002 + 0.002 * std::fabs(numeric));
+            }
+            const float saved = layer.biases[0][f];
+            layer.biases[0][f] = saved + 0.001f;
+            const double up = crossEntropy(m, batch, targets);
+            layer.biases[0][f] = saved - 0.001f;
+            const double down = crossEntropy(m, batch, targets);
+            layer.biases[0][f] = saved;
+            assert(std::fabs((up - down) / 0.002 - layer.biasGradients[0][f]) < 0.002 + 0.002 * std::fabs(layer.biasGradients[0][f]));
+        }
+    }
+
+    // the fused single-worker step and the sharded gradients train to the same weights
+    hhModel single, sharded;
+    ConvTask t1(1), t2(2);
+    single.Configure(t1);
+    sharded.Configure(t2);
+    for (int i = 0; i < 3; i++)
+    {
+        single.Train();
+        sharded.Train();
+    }
+    assert(!sameWeights(single, m));
+    for (size_t l = 1; l < single.layers.size(); l++)
+        for (int r = 0; r < single.layers[l]->weights.rows; r++)
+            for (int c = 0; c < single.layers[l]->weights.cols; c++)
+                assert(closeTo(single.layers[l]->weights[r][c], sharded.layers[l]->weights[r][c], 0.0001f));
+
+    // checkpoints keep the window geometry and the filter weights
+    assert(single.Save("conv_test.hhm"));
+    hhModel loaded;
+    assert(loaded.Load("conv_test.hhm"));
+    assert(loaded.layers.size() == single.layers.size() && loaded.layers[3]->type == hhLayerType::MaxPool);
+    assert(loaded.layers[2]->shape.stride == 2 && loaded.layers[2]->shape.padding == 1);
+    assert(sameWeights(loaded, single));
+    tensor expected, actual;
+    single.PredictBatch(task.inputs, expected);
+    loaded.PredictBatch(task.inputs, actual);
+    for (int r = 0; r < expected.rows; r++)
+        for (int c = 0; c < expected.cols; c++)
+            assert(expected[r][c] == actual[r][c]);
+
+    // the same sizes with another geometry are refused
+    hhModel reshaped;
+    reshaped.AddLayer(hhLayerType::Input, 108, 0);
+    reshaped.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(3, 6, 6, 4, 2));
+    reshaped.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(4, 5, 5, 4, 3, 2, 1));
+    reshaped.AddLayer(hhLayerType::MaxPool, hhConvShape::Pool(4, 3, 3, 2, 1));
+    reshaped.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(4, 2, 2, 4, 3, 1, 1));
+    reshaped.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(4, 2, 2, 3, 1));
+    reshaped.AddLayer(hhLayerType::Softmax, 3, 12);
+    assert(reshaped.Load("conv_test.hhm"));
+    hhModel other;
+    other.AddLayer(hhLayerType::Input, 108, 0);
+    other.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(3, 6, 6, 4, 4, 1, 1));
+    other.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(4, 5, 5, 4, 3, 2, 1));
+    other.AddLayer(hhLayerType::MaxPool, hhConvShape::Pool(4, 3, 3, 2, 1));
+    other.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(4, 2, 2, 4, 3, 1, 1));
+    other.AddLayer(hhLayerType::Conv2D, hhConvShape::Conv(4, 2, 2, 3, 1));
+    other.AddLayer(hhLayerType::Softmax, 3, 12);
+    assert(other.layers.size() == 7 && !other.Load("conv_test.hhm"));
+
+    remove("conv_test.hhm");
+    return true;
+}
+
+// ------------------------------ optimizer test ------------------------------
+
+// three noisy clusters in the plane, one per class
+class OptimizerTask : public hhTask
+{
+    public:
+    OptimizerTask(hhOptimizerType type, float rate, int threads = 1)
+    {
+        optimizer.type = type;
+        learningRate = rate;
+        numThreads = threads;
+    }
+
+    void Configure(hhModel& model) override
+    {
+        epochs = 1;
+        batchSize = 16;
+        seed = 99;
+        prefetchDepth = 0;
+
+        std::default_random_engine generator(3);
+        std::normal_distribution<float> noise(0.0f, 0.4f);
+        inputs.Resize(96, 2, true);
+        targets.Resize(96, 3, true);
+        for (int r = 0; r < inputs.rows; r++)
+        {
+            const int category = r % 3;
+            inputs[r][0] = std::cos(category * 2.1f) + noise(generator);
+            inputs[r][1] = std::sin(category * 2.1f) + noise(generator);
+            targets[r][category] = 1.0f;
+        }
+        AddLayer(hhLayerType::Input, 2, 0);
+        AddLayer(hhLayerType::Relu, 16, 2);
+        AddLayer(hhLayerType::Softmax, 3, 16);
+    }
+};
+
+double lossAfter(hhOptimizerType type, float rate, int epochs)
+{
+    hhModel m;
+    OptimizerTask t(type, rate);
+    m.Configure(t);
+    for (int e = 0; e < epochs; e++)
+        m.Train();
+    return crossEntropy(m, t.inputs, t.targets);
+}
+
+bool optimizers()
+{
+    std::default_random_engine generator;
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+    // three steps of every rule on every level match the scalar kernels, 37 columns cover the tails
+    const int cols = 37;
+    tensor g(3, cols, true);
+    for (int s = 0; s < g.rows; s++)
+        for (int c = 0; c < cols; c++)
+            g[s][c] = distribution(generator);
+    hhOptimizer settings;
+    settings.weightDecay = 0.01f;
+    for (hhOptimizerType type : { hhOptimizerType::Momentum, hhOptimizerType::Nesterov, hhOptimizerType::Adam, hhOptimizerType::AdamW })
+    {
+        settings.type = type;
+        for (hhSimdLevel level : {hhSimdLevel::SSE2, hhSimdLevel::AVX2, hhSimdLevel::AVX512})
+        {
+            const hhKernels* k = kernelsFor(level);
+            if (k == nullptr)
+                continue;
+
+            tensor expected(3, cols, true), actual(3, cols, true);
+            for (int c = 0; c < cols; c++)
+                expected[0][c] = actual[0][c] = distribution(generator);
+            for (int step = 1; step <= 3; step++)
+            {
+                hhUpdateStep s = settings.Step(0.05f, step);
+                s.scale = 0.5f;
+                const hhKernels* both[] = { &scalarKernels, k };
+                tensor* state[] = { &expected, &actual };
+                for (int i = 0; i < 2; i++)
+                {
+                    tensor& t = *state[i];
+                    if (type == hhOptimizerType::Adam || type == hhOptimizerType::AdamW)
+                        both[i]->adamUpdate(s, t[0], g[step - 1], t[1], t[2], cols);
+                    else
+                        both[i]->momentumUpdate(s, t[0], g[step - 1], t[1], cols);
+                }
+            }
+            for (int r = 0; r < 3; r++)
+                for (int c = 0; c < cols; c++)
+                    assert(closeTo(actual[r][c], expected[r][c], 0.00001f));
+            assert(actual[0][cols] == 0.0f && actual[1][cols] == 0.0f && actual[2][cols] == 0.0f);
+        }
+    }
+
+    // worked by hand: gradient 2 then 1, momentum 0.5 and rate 0.1
+    {
+        hhOptimizer nesterov;
+        nesterov.type = hhOptimizerType::Nesterov;
+        nesterov.momentum = 0.5f;
+        float w = 1.0f, v = 0.0f;
+        const float gradients[] = { 2.0f, 1.0f };
+        for (int step = 1; step <= 2; step++)
+            scalarKernels.momentumUpdate(nesterov.Step(0.1f, step), &w, &gradients[step - 1], &v, 1);
+        // v = 2 then 2, w -= 0.1 * (2 + 1) then 0.1 * (1 + 1)
+        assert(closeTo(v, 2.0f) && closeTo(w, 0.5f));
+
+        // Adam's first step moves every weight by the rate whatever the gradient's scale
+        hhOptimizer adam;
+        adam.type = hhOptimizerType::Adam;
+        float weights[2] = { 0.0f, 0.0f }, m[2] = {}, squares[2] = {};
+        const float steep[2] = { 300.0f, -0.002f };
+        scalarKernels.adamUpdate(adam.Step(0.01f, 1), weights, steep, m, squares, 2);
+        assert(closeTo(weights[0], -0.01f, 0.001f) && closeTo(weights[1], 0.01f, 0.001f));
+    }
+
+    // momentum and Adam reach a lower loss than SGD in the same number of epochs
+    const double sgd = lossAfter(hhOptimizerType::Sgd, 0.02f, 20);
+    const double momentum = lossAfter(hhOptimizerType::Momentum, 0.02f, 20);
+    const double nesterov = lossAfter(hhOptimizerType::Nesterov, 0.02f, 20);
+    const double adam = lossAfter(hhOptimizerType::Adam, 0.02f, 20);
+    assert(momentum < sgd && nesterov < sgd && adam < sgd);
+
+    // sharded gradients step the moments the same way, and every batch counts one step
+    hhModel single, sharded;
+    OptimizerTask t1(hhOptimizerType::AdamW, 0.01f, 1), t2(hhOptimizerType::AdamW, 0.01f, 2);
+    t1.optimizer.weightDecay = t2.optimizer.weightDecay = 0.1f;
+    single.Configure(t1);
+    sharded.Configure(t2);
+    for (int i = 0; i < 3; i++)
+    {
+        single.Train();
+        sharded.Train();
+    }
+    assert(single.optimizerSteps == 3 * 96 / 16 && sharded.optimizerSteps == single.optimizerSteps);
+    for (size_t l = 1; l < single.layers.size(); l++)
+        for (int r = 0; r < single.layers[l]->weights.rows; r++)
+            for (int c = 0; c < single.layers[l]->weights.cols; c++)
+                assert(closeTo(single.layers[l]->weights[r][c], sharded.layers[l]->weights[r][c], 0.0001f));
+
+    // loading weights starts the optimizer over
+    assert(single.Save("optimizer_test.hhm") && single.Load("optimizer_test.hhm"));
+    hhDenseLayer& hidden = *static_cast<hhDenseLayer*>(single.layers[1].get());
+    assert(single.optimizerSteps == 0 && hidden.weightSquares[0][0] == 0.0f && hidden.weightVelocities[0][0] == 0.0f);
+    remove("optimizer_test.hhm");
+    return true;
+}
+
+// ------------------------------ schedule test ------------------------------
+
+bool schedules()
+{
+    hhSchedule s;
+    assert(s.Factor(0.0) == 1.0 && s.Factor(123.0) == 1.0);
+    s.warmupEpochs = 2.0f;
+    assert(closeTo(float(s.Factor(0.5)), 0.25f) && s.Factor(2.0) == 1.0);
+
+    // the schedules count from the end of the warm-up
+    s.type = hhScheduleType::Step;
+    s.stepEpochs = 3.0f;
+    s.stepFactor = 0.5f;
+    assert(s.Factor(4.9) == 1.0 && closeTo(float(s.Factor(5.0)), 0.5f) && closeTo(float(s.Factor(8.5)), 0.25f));
+    s.type = hhScheduleType::Cosine;
+    s.cosineEpochs = 10.0f;
+    s.minFactor = 0.1f;
+    assert(closeTo(float(s.Factor(2.0)), 1.0f) && closeTo(float(s.Factor(7.0)), 0.55f) && closeTo(float(s.Factor(12.0)), 0.1f));
+    assert(s.Factor(50.0) == s.minFactor);
+
+    // a training step uses the rate where its batch ends, the warm-up is half done after the first epoch
+    {
+        hhModel m;
+        OptimizerTask t(hhOptimizerType::Sgd, 0.1f);
+        t.schedule.warmupEpochs = 2.0f;
+        m.Configure(t);
+        m.Train();
+        assert(m.trainedEpochs == 1 && closeTo(m.learningRateScale, 0.5f));
+        m.Train();
+        assert(m.trainedEpochs == 2 && closeTo(m.learningRateScale, 1.0f));
+    }
+
+    // the validator judges the weights as they were when it started, whatever happens to them afterwards
+    hhModel m;
+    OptimizerTask t(hhOptimizerType::Adam, 0.02f);
+    m.Configure(t);
+    for (int e = 0; e < 5; e++)
+        m.Train();
+    const double loss = crossEntropy(m, t.inputs, t.targets) / t.inputs.rows;
+    int correct = 0;
+    for (int r = 0; r < t.inputs.rows; r++)
+        if (argmax(m.layers.back()->activationValue[r], 3) == argmax(t.targets[r], 3))
+            correct++;
+
+    hhValidator validator;
+    hhValidationResult result;
+    assert(!validator.Poll(result));
+    assert(validator.Start(m, t.inputs, t.targets, 7));
+    m.layers[2]->weights.Zero();
+    validator.Wait();
+    assert(validator.Poll(result) && !validator.Poll(result));
+    assert(result.epoch == 7 && closeTo(float(result.loss), float(loss)) && result.accuracy == float(correct) / t.inputs.rows);
+
+    // nothing to learn at rate zero, so every evaluation after the first is a plateau: two decays, then a stop
+    // part way through a run of the prefetcher
+    OptimizerTask flat(hhOptimizerType::Sgd, 0.0f);
+    hhModel stalled;
+    stalled.Configure(flat);
+    flat.epochs = 4;
+    flat.prefetchDepth = 2;
+    flat.validationInputs = flat.inputs;
+    flat.validationTargets = flat.targets;
+    flat.earlyStopping.patience = 2;
+    flat.earlyStopping.decayFactor = 0.5f;
+    for (int i = 0; i < 100000 && stalled.Train(); i++)
+    {
+    }
+    assert(stalled.stopped && stalled.rateDecays == 2 && stalled.plateauFactor == 0.25f && stalled.learningRateScale == 0.25f);
+    assert(stalled.bestValidation.epoch >= 1 && stalled.lastValidation.epoch > stalled.bestValidation.epoch);
+    assert(!stalled.Train());
+
+    // the loader gave back every buffer it held, clearing the stop trains whole runs again
+    const int batches = stalled.numEpochs;
+    stalled.stopped = false;
+    flat.earlyStopping.patience = 1000;
+    assert(stalled.Train() && stalled.numEpochs == batches + 4 * 6);
+    return true;
+}
+
+// ------------------------------ arena test ------------------------------
+
+bool parameterArena()
+{
+    // every layer's weights and biases are one aligned run of block 0, gradients the same run of block 1
+    hhModel m;
+    OptimizerTask t(hhOptimizerType::Adam, 0.01f, 1);
+    m.Configure(t);
+    size_t end = 0;
+    for (const std::unique_ptr<hhLayer>& layer : m.layers)
+    {
+        const tensor& w = layer->weights;
+        assert(layer->inArena && layer->arenaOffset == end);
+        assert(w.Data() == m.arena.Block(0) + layer->arenaOffset && size_t(w.Data()) % tensorAlignment == 0);
+        assert(layer->biases.Data() == w.Data() + size_t(w.rows) * w.stride);
+        end = layer->arenaOffset + size_t(w.rows) * w.stride + layer->biases.stride;
+        if (hasWeights(layer->type))
+            assert(static_cast<const hhDenseLayer&>(*layer).weightGradients.Data() == m.arena.Block(1) + layer->arenaOffset);
+    }
+    assert(end == m.arena.Floats() && m.arena.Blocks() == 2);
+
+    // one sweep over a layer's run steps exactly like the row by row update of a layer on its own
+    hhDenseLayer& hidden = static_cast<hhDenseLayer&>(*m.layers[1]);
+    hhReluLayer alone(hidden.numNeurons, hidden.numInputs);
+    m.Forward(t.inputs.View(0, 16));
+    m.Backward(t.targets.View(0, 16));
+    assert(m.arena.Blocks() == 4 && hidden.weightSquares.Data() == m.arena.Block(3) + hidden.arenaOffset);
+    alone.weights = hidden.weights;
+    alone.biases = hidden.biases;
+    alone.weightGradients = hidden.weightGradients;
+    alone.biasGradients = hidden.biasGradients;
+    alone.gradientSamples = hidden.gradientSamples;
+    alone.weightVelocities = hidden.weightVelocities;
+    alone.biasVelocities = hidden.biasVelocities;
+    alone.weightSquares = hidden.weightSquares;
+    alone.biasSquares = hidden.biasSquares;
+    const hhUpdateStep step = t.optimizer.Step(0.01f, 2);
+    hidden.UpdateWeightsAndBiases(step);
+    alone.UpdateWeightsAndBiases(step);
+    for (int n = 0; n < hidden.weights.rows; n++)
+    {
+        for (int i = 0; i < hidden.weights.stride; i++)
+            assert(hidden.weights[n][i] == alone.weights[n][i]);
+        assert(hidden.biases[0][n] == alone.biases[0][n]);
+    }
+
+    // growing moves every block, values included, and the layers follow
+    const float weight = hidden.weights[2][1], square = hidden.weightSquares[2][1];
+    const float* before = hidden.weights.Data();
+    hhLayer* extra = m.AddLayer(hhLayerType::Relu, 5, m.layers.back()->numNeurons);
+    assert(extra != nullptr && m.arena.Floats() > end && hidden.weights.Data() != before);
+    assert(hidden.weights[2][1] == weight && hidden.weightSquares[2][1] == square);
+    assert(extra->arenaOffset == end && static_cast<hhDenseLayer&>(*extra).weightVelocities.Data() == m.arena.Block(2) + end);
+
+    // a shared parameter block is used in place until the layout changes, then copied back in
+    hhParameterArena arena;
+    const size_t first = arena.Place(3, 5);
+    const size_t second = arena.Place(1, 40);
+    assert(first == 0 && second == 3 * 16);
+    arena.Grow(2);
+    assert(arena.Floats() == 3 * 16 + 48 && arena.Block(1) == arena.Block(0) + arena.Floats());
+    tensor external(1, int(arena.Floats()), true);
+    external[0][second + 7] = 4.0f;
+    arena.ShareParameters(external.Data());
+    assert(arena.IsShared() && arena.View(0, second, 1, 40)[0][7] == 4.0f);
+    arena.Grow(3);
+    assert(arena.IsShared() && arena.Block(0) == external.Data());
+    arena.Place(1, 1);
+    arena.Grow(3);
+    assert(!arena.IsShared() && arena.Block(0)[second + 7] == 4.0f && arena.Floats() == 3 * 16 + 48 + 16);
+
+    // a region of a huge page or more starts on one
+    hhParameterArena large;
+    large.Place(1024, 1024);
+    large.Grow(1);
+    assert(size_t(large.Block(0)) % (size_t(2) << 20) == 0);
+    return true;
+}
+
+// ------------------------------ snapshot test ------------------------------
+
+bool snapshots()
+{
+    // the reader gets the newest value once, values it missed are overwritten
+    {
+        hhTripleBuffer<int> buffer;
+        assert(!buffer.Acquire());
+        buffer.Back() = 1;
+        buffer.Publish();
+        buffer.Back() = 2;
+        buffer.Publish();
+        assert(buffer.Acquire() && buffer.Front() == 2);
+        assert(!buffer.Acquire() && buffer.Front() == 2);
+        buffer.Back() = 3;
+        buffer.Publish();
+        assert(buffer.Acquire() && buffer.Front() == 3);
+    }
+
+    // a reader racing a writer only ever sees whole values, in publishing order
+    {
+        hhTripleBuffer<std::vector<int>> buffer;
+        const int count = 20000;
+        std::thread writer([&]()
+        {
+            for (int v = 1; v <= count; v++)
+            {
+                buffer.Back().assign(64, v);
+                buffer.Publish();
+            }
+        });
+        int last = 0;
+        while (last < count)
+        {
+            if (!buffer.Acquire())
+                continue;
+            const std::vector<int>& value = buffer.Front();
+            assert(value.size() == 64 && value.front() > last);
+            for (int x : value)
+                assert(x == value.front());
+            last = value.front();
+        }
+        writer.join();
+    }
+
+    // a model training on its own thread hands its weights to one that only predicts
+    hhModel trained, display;
+    OptimizerTask t(hhOptimizerType::Adam, 0.01f, 1);
+    t.epochs = 50;
+    trained.Configure(t);
+    for (const std::unique_ptr<hhLayer>& layer : trained.layers)
+        display.AddLayer(layer->type, layer->numNeurons, layer->numInputs);
+    hhTripleBuffer<hhModelSnapshot> buffer;
+    std::atomic<int> published{0};
+    std::thread trainer([&]()
+    {
+        while (!trained.interrupt.load())
+        {
+            trained.Train();
+            trained.PublishSnapshot(buffer);
+            published++;
+        }
+    });
+    while (published.load() < 2)
+        std::this_thread::yield();
+    long long version = 0;
+    for (int frames = 0; frames < 100; frames++)
+    {
+        if (display.TakeSnapshot(buffer))
+        {
+            assert(display.optimizerSteps > version);
+            version = display.optimizerSteps;
+        }
+        display.Predict(t.inputs.View(0, 4));
+    }
+
+    // an interrupt ends the Train call in progress and every one after it until it is cleared
+    trained.interrupt = true;
+    trainer.join();
+    const int epochs = trained.trainedEpochs;
+    assert(trained.Train() && trained.trainedEpochs == epochs);
+    trained.interrupt = false;
+
+    // the last snapshot carries the weights the trainer stopped with
+    trained.PublishSnapshot(buffer);
+    assert(display.TakeSnapshot(buffer) && sameWeights(display, trained));
+    assert(display.optimizerSteps == trained.optimizerSteps && display.trainedEpochs == trained.trainedEpochs);
+    return true;
+}
+
+// ------------------------------ allocations test ------------------------------
+
+// every operator new in the program lands here, tensor storage included
+static std::atomic<long long> heapAllocations(0);
+
+// gcc inlines the replacements into their callers and then takes the free in delete for a mismatch
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpragmas"
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t bytes)
+{
+    heapAllocations++;
+    if (void* ptr = std::malloc(bytes > 0 ? bytes : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t bytes, std::align_val_t alignment)
+{
+    heapAllocations++;
+    const size_t align = size_t(alignment);
+    bytes = (bytes + align - 1) / align * align;
+#if defined(_MSC_VER)
+    void* ptr = _aligned_malloc(bytes > 0 ? bytes : align, align);
+#else
+    void* ptr = std::aligned_alloc(align, bytes > 0 ? bytes : align);
+#endif
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+#if defined(_MSC_VER)
+void operator delete(void* ptr, std::align_val_t) noexcept { _aligned_free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { _aligned_free(ptr); }
+#else
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+#endif
+
+class AllocationTask : public hhTask
+{
+    public:
+    void Configure(hhModel& model) override
+    {
+        learningRate = 0.1f;
+        epochs = 3;
+        batchSize = 5;      // the last batch of each epoch is short
+        prefetchDepth = 0;
+        inputs = seedsDataset;
+        targets = seedsOutputs;
+        AddLayer(hhLayerType::Input, 2, 0);
+        AddLayer(hhLayerType::Relu, 9, 2);
+        AddLayer(hhLayerType::Softmax, 2, 9);
+    }
+};
+
+// heap allocations made by call
+template <typename F>
+long long allocationsIn(F call)
+{
+    const long long before = heapAllocations;
+    call();
+    return heapAllocations - before;
+}
+
+bool allocations()
+{
+    hhModel m;
+    AllocationTask t;
+    m.Configure(t);
+
+    // the first call sizes every workspace, later ones reuse them
+    m.Train();
+    assert(allocationsIn([&] { m.Train(); }) == 0);
+
+    const tensor single = seedsDataset[3];
+    const tensor all = seedsDataset;
+    tensor outputs;
+    m.Predict(single);
+    m.PredictBatch(all, outputs);
+    assert(allocationsIn([&] { m.Predict(single); }) == 0);
+    assert(allocationsIn([&] { m.PredictBatch(all, outputs); }) == 0);
+
+    // the input layer views the caller's rows rather than copying them
+    m.Forward(all);
+    assert(m.layers[0]->activationValue.Data() == all.Data());
+
+    // data-parallel steps allocate nothing once the replicas exist
+    t.numThreads = 2;
+    m.Train();
+    assert(allocationsIn([&] { m.Train(); }) == 0);
+
+    // moments are sized by the first step under a rule that keeps them
+    t.optimizer.type = hhOptimizerType::Adam;
+    m.Train();
+    assert(allocationsIn([&] { m.Train(); }) == 0);
+
+    // the prefetcher's loader thread outlives the call that started it, later calls allocate nothing
+    t.numThreads = 1;
+    t.prefetchDepth = 2;
+    m.Train();
+    assert(allocationsIn([&] { m.Train(); }) == 0);
+    t.epochs = 12;
+    assert(allocationsIn([&] { m.Train(); }) == 0);
+
+    return true;
+}
+
 void check(const char* name, const int result)
 {
     printf("TEST: [%-12s] %s\n", name, result ? "success" : "fail");
@@ -327,8 +2201,29 @@ int main(int, char**)
     check("layers", layers());
     check("predict", predict());
     check("backwards", backwards());
+    check("batches", batches());
+    check("simd", simdKernels());
+    check("gemm", gemmEngine());
+    check("activations", fastActivations());
     //check("numbers", numbers());
     check("seeds", seeds());
+    check("parallel", dataParallel());
+    check("predictBatch", predictBatch());
+    check("dataset", cifarDataset());
+    check("prefetch", prefetch());
+    check("checkpoint", checkpoints());
+    check("quantize", quantize());
+    check("precision", halfPrecision());
+    check("fused", fusedLayers());
+    check("sparse", deadUnits());
+    check("stats", modelStats());
+    check("allocations", allocations());
+    check("static", staticModel());
+    check("conv", convLayers());
+    check("optimizers", optimizers());
+    check("schedules", schedules());
+    check("arena", parameterArena());
+    check("snapshots", snapshots());
     printf("tests end\n");
     return 1;
 }
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "threads.h"
+
+#include <cassert>
+
+hhThreadPool::hhThreadPool(int numThreads)
+{
+    for (int i = 1; i < numThreads; i++)
+    {
+        threads.emplace_back(&hhThreadPool::WorkerLoop, this, i);
+    }
+}
+
+hhThreadPool::~hhThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+void hhThreadPool::Run(int count, hhJobRef work)
+{
+    assert(count <= Size());
+    if (count <= 0)
+        return;
+
+    if (count > 1)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &work;
+            jobCount = count;
+            pending = count - 1;
+            generation++;
+        }
+        wake.notify_all();
+    }
+
+    work(0);
+
+    if (count > 1)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+        job = nullptr;
+    }
+}
+
+void hhThreadPool::WorkerLoop(int index)
+{
+    unsigned seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping)
+            return;
+
+        seen = generation;
+        if (index >= jobCount)
+            continue;
+
+        const hhJobRef* work = job;
+        lock.unlock();
+        (*work)(index);
+        lock.lock();
+
+        if (--pending == 0)
+            done.notify_one();
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Non-owning reference to a callable taking the worker index. Unlike std::function it never allocates,
+// the callable only has to outlive the Run it is passed to.
+class hhJobRef
+{
+public:
+    template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, hhJobRef>::value>::type>
+    hhJobRef(const F& callable)
+        : callable(&callable), invoke([](const void* f, int t) { (*static_cast<const F*>(f))(t); })
+    {
+    }
+
+    void operator()(int t) const { invoke(callable, t); }
+
+private:
+    const void* callable;
+    void (*invoke)(const void*, int);
+};
+
+// Fixed set of worker threads that run one job at a time, with the calling thread acting as worker 0.
+class hhThreadPool
+{
+public:
+    explicit hhThreadPool(int numThreads);
+    ~hhThreadPool();
+
+    hhThreadPool(const hhThreadPool&) = delete;
+    hhThreadPool& operator=(const hhThreadPool&) = delete;
+
+    // calls job(t) for every t in [0, count) and returns once all of them finish. count <= Size().
+    void Run(int count, hhJobRef job);
+
+    int Size() const { return int(threads.size()) + 1; }
+
+private:
+    void WorkerLoop(int index);
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const hhJobRef* job = nullptr;
+    int jobCount = 0;
+    int pending = 0;
+    unsigned generation = 0;
+    bool stopping = false;
+};
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "model.h"
+#include "tasks.h"
+
+// Headless trainer. Trains one of the tasks helper and images show, without a window, until an epoch or time
+// budget runs out or early stopping ends it, then writes a checkpoint the windowed programs pick up.
+//
+//   trainer <color|images> [--epochs N] [--seconds S] [--report N] [--threads N] [--seed N] [--fresh]
+//           [--metrics file] [--checkpoint file]
+//
+// every --report epochs one JSON object goes to the metrics file, or stdout, on a line of its own. progress
+// messages and the layer stats go to stderr, so stdout stays clean JSON lines. without a budget it trains until
+// early stopping ends it, which the color task never does.
+
+using trainerClock = std::chrono::steady_clock;
+
+struct Options
+{
+    std::string task;
+    int epochs = 0;             // 0 is no limit
+    double seconds = 0.0;       // 0 is no limit
+    int report = 0;             // epochs per Train call and metrics line, 0 keeps the task's
+    int threads = 0;            // 0 keeps the task's
+    unsigned int seed = 0;
+    bool fresh = false;         // ignore an existing checkpoint
+    const char* metrics = nullptr;
+    const char* checkpoint = nullptr;
+};
+
+static bool usage()
+{
+    fprintf(stderr, "usage: trainer <color|images> [--epochs N] [--seconds S] [--report N] [--threads N] [--seed N] [--fresh]\n"
+                    "               [--metrics file] [--checkpoint file]\n");
+    return false;
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--epochs") == 0 && hasValue) options.epochs = std::max(0, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--seconds") == 0 && hasValue) options.seconds = std::max(0.0, std::atof(argv[++i]));
+        else if (std::strcmp(argv[i], "--report") == 0 && hasValue) options.report = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--threads") == 0 && hasValue) options.threads = std::max(1, std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--seed") == 0 && hasValue) options.seed = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(argv[i], "--metrics") == 0 && hasValue) options.metrics = argv[++i];
+        else if (std::strcmp(argv[i], "--checkpoint") == 0 && hasValue) options.checkpoint = argv[++i];
+        else if (std::strcmp(argv[i], "--fresh") == 0) options.fresh = true;
+        else if (argv[i][0] != '-' && options.task.empty()) options.task = argv[i];
+        else return usage();
+    }
+    if (options.task != "color" && options.task != "images")
+        return usage();
+    return true;
+}
+
+// interrupts the model once the time budget is spent, so an epoch in progress does not run past it
+class Deadline
+{
+public:
+    Deadline(hhModel& model, double seconds)
+    {
+        if (seconds <= 0.0)
+            return;
+        const trainerClock::time_point end = trainerClock::now() + std::chrono::duration_cast<trainerClock::duration>(std::chrono::duration<double>(seconds));
+        watcher = std::thread([this, &model, end]()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!wake.wait_until(lock, end, [this]() { return finished; }))
+                model.interrupt.store(true, std::memory_order_relaxed);
+        });
+    }
+
+    ~Deadline()
+    {
+        if (!watcher.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        wake.notify_one();
+        watcher.join();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool finished = false;
+    std::thread watcher;
+};
+
+static void writeMetrics(FILE* out, const hhModel& model, int epochs, double seconds)
+{
+    // samples of the whole epochs in the last Train call, an interrupted one is not counted
+    const double samples = double(epochs) * model.task->NumSamples();
+    const double rate = model.lastTrainTime > 0.0f ? samples / model.lastTrainTime : 0.0;
+    fprintf(out, "{\"epoch\": %d, \"seconds\": %.3f, \"samplesPerSec\": %.1f, \"trainError\": %.6f, \"learningRate\": %.6g",
+        model.trainedEpochs, seconds, rate, model.lastTrainError, model.task->learningRate * model.learningRateScale);
+    if (model.lastValidation.epoch >= 0)
+        fprintf(out, ", \"validationEpoch\": %d, \"validationLoss\": %.6f, \"validationAccuracy\": %.4f",
+            model.lastValidation.epoch, model.lastValidation.loss, model.lastValidation.accuracy);
+    fprintf(out, "}\n");
+    fflush(out);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+
+    const bool images = options.task == "images";
+    std::unique_ptr<hhTask> task;
+    if (images)
+        task.reset(new ImageTask());
+    else
+        task.reset(new ColorTask());
+
+    // the shuffler is seeded once, by Configure
+    if (options.seed != 0)
+        task->seed = options.seed;
+
+    // stdout carries nothing but the metrics when they go there
+    hhModel model;
+    model.log = stderr;
+    model.Configure(*task);
+    if (task->NumSamples() == 0)
+    {
+        fprintf(stderr, "no training samples for %s\n", options.task.c_str());
+        return 1;
+    }
+
+    // the same files helper and images load, so a run here carries on in the window and the other way round
+    const char* checkpoint = options.checkpoint != nullptr ? options.checkpoint : images ? "images.hhm" : "helper.hhm";
+    if (!options.fresh && model.Load(checkpoint))
+        fprintf(stderr, "loaded %s\n", checkpoint);
+
+    // read at every Train call, so they can be changed after Configure
+    if (options.report > 0)
+        task->epochs = options.report;
+    if (options.threads > 0)
+        task->numThreads = options.threads;
+    const int epochsPerCall = task->epochs;
+
+    FILE* out = options.metrics != nullptr ? fopen(options.metrics, "w") : stdout;
+    if (out == nullptr)
+    {
+        fprintf(stderr, "could not open %s\n", options.metrics);
+        return 1;
+    }
+
+    const int firstEpoch = model.trainedEpochs;
+    const trainerClock::time_point start = trainerClock::now();
+    {
+        Deadline deadline(model, options.seconds);
+        for (;;)
+        {
+            const int done = model.trainedEpochs - firstEpoch;
+            if (options.epochs > 0 && done >= options.epochs)
+                break;
+
+            // the last call only runs what is left of the budget
+            task->epochs = options.epochs > 0 ? std::min(epochsPerCall, options.epochs - done) : epochsPerCall;
+            const int before = model.trainedEpochs;
+            const bool more = model.Train();
+            const double seconds = std::chrono::duration<double>(trainerClock::now() - start).count();
+            if (model.trainedEpochs > before)
+                writeMetrics(out, model, model.trainedEpochs - before, seconds);
+
+            if (!more)
+            {
+                fprintf(stderr, "validation loss stopped improving after %d epochs, best %.4f at epoch %d\n",
+                    model.trainedEpochs, model.bestValidation.loss, model.bestValidation.epoch);
+                break;
+            }
+            if (model.interrupt.load(std::memory_order_relaxed))
+                break;
+        }
+    }
+    model.interrupt.store(false, std::memory_order_relaxed);
+    task->epochs = epochsPerCall;
+
+    if (out != stdout)
+        fclose(out);
+
+    if (!model.Save(checkpoint))
+    {
+        fprintf(stderr, "could not write %s\n", checkpoint);
+        return 1;
+    }
+    fprintf(stderr, "%d epochs in %.1f s, saved %s\n", model.trainedEpochs - firstEpoch,
+        std::chrono::duration<double>(trainerClock::now() - start).count(), checkpoint);
+    model.PrintStats();
+    return 0;
+}
@@ -7,6 +7,7 @@ using column = std::vector<float>;
 using matrix = std::vector<column>;
 
 int argmax(const column& values);
+int argmax(const float* values, int count);
 
 
 float dotProduct(const column& a, const column& b);
@@ -0,0 +1,116 @@
+#include "model.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// ---------------------------- validator ----------------------------
+
+hhValidator::hhValidator() = default;
+
+hhValidator::~hhValidator()
+{
+    Wait();
+}
+
+bool hhValidator::Start(const hhModel& source, const tensor& inputs, const tensor& targets, int epoch)
+{
+    // still running, or finished with a result nobody has polled yet
+    if (worker.joinable() || finished.load(std::memory_order_acquire))
+        return false;
+
+    // the copy keeps its layers between evaluations, only the weights are copied again
+    if (snapshot == nullptr || snapshot->layers.size() != source.layers.size())
+    {
+        snapshot.reset(new hhModel());
+        snapshot->stats.layerTiming = false;
+        for (const std::unique_ptr<hhLayer>& layer : source.layers)
+        {
+            hhLayer* copy = isWindowed(layer->type)
+                ? snapshot->AddLayer(layer->type, layer->shape)
+                : snapshot->AddLayer(layer->type, layer->numNeurons, layer->numInputs);
+            copy->activationMath = layer->activationMath;
+        }
+    }
+
+    // the same layers in the same order lay the arenas out alike, so the parameters are one copy
+    assert(snapshot->arena.Floats() == source.arena.Floats());
+    std::memcpy(snapshot->arena.Block(0), source.arena.Block(0), source.arena.Floats() * sizeof(float));
+
+    result = hhValidationResult();
+    result.epoch = epoch;
+    finished.store(false, std::memory_order_relaxed);
+    worker = std::thread(&hhValidator::Evaluate, this, std::cref(inputs), std::cref(targets));
+    return true;
+}
+
+bool hhValidator::Poll(hhValidationResult& latest)
+{
+    if (!finished.load(std::memory_order_acquire))
+        return false;
+
+    // Wait may have joined it already
+    if (worker.joinable())
+        worker.join();
+    finished.store(false, std::memory_order_relaxed);
+    latest = result;
+    return true;
+}
+
+void hhValidator::Wait()
+{
+    // the result stays for Poll
+    if (worker.joinable())
+        worker.join();
+}
+
+void hhValidator::Evaluate(const tensor& inputs, const tensor& targets)
+{
+    snapshot->PredictBatch(inputs, outputs);
+
+    const bool softmax = snapshot->layers.back()->type == hhLayerType::Softmax;
+    double loss = 0.0;
+    int correct = 0;
+    for (int r = 0; r < outputs.rows; r++)
+    {
+        for (int c = 0; c < outputs.cols; c++)
+        {
+            const double y = outputs[r][c], t = targets[r][c];
+            loss += softmax ? -t * std::log(std::max(y, 1e-30)) : (y - t) * (y - t);
+        }
+        if (argmax(outputs[r], outputs.cols) == argmax(targets[r], targets.cols))
+            correct++;
+    }
+    result.loss = loss / std::max(1, outputs.rows);
+    result.accuracy = float(correct) / std::max(1, outputs.rows);
+    finished.store(true, std::memory_order_release);
+}
+
+// ---------------------------- early stopping ----------------------------
+
+bool hhModel::ApplyValidation(const hhValidationResult& result)
+{
+    const hhEarlyStopping& rule = task->earlyStopping;
+    lastValidation = result;
+    if (bestValidation.epoch < 0 || result.loss < bestValidation.loss - rule.minDelta)
+    {
+        bestValidation = result;
+        plateauEvaluations = 0;
+        return true;
+    }
+
+    if (++plateauEvaluations < rule.patience)
+        return true;
+
+    // a plateau lowers the rate while decays are left, the one after that ends training
+    plateauEvaluations = 0;
+    if (rateDecays < rule.maxDecays)
+    {
+        rateDecays++;
+        plateauFactor *= rule.decayFactor;
+        return true;
+    }
+    stopped = true;
+    return false;
+}
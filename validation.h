@@ -0,0 +1,47 @@
+#pragma once
+
+#include "tensor.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+class hhModel;
+
+struct hhValidationResult
+{
+    int epoch = -1;         // the model's trainedEpochs when the weights were copied, -1 before any evaluation
+    double loss = 0.0;      // mean over samples, cross-entropy below a softmax output and squared error otherwise
+    float accuracy = 0.0f;  // fraction of samples whose largest output is their largest target
+};
+
+// Evaluates a copy of a model's weights on held-out samples on its own thread, so training carries on with
+// the live weights meanwhile. one evaluation runs at a time.
+class hhValidator
+{
+public:
+    hhValidator();
+    ~hhValidator();
+
+    hhValidator(const hhValidator&) = delete;
+    hhValidator& operator=(const hhValidator&) = delete;
+
+    // copies source's weights and starts evaluating them on inputs and targets, which have to stay untouched
+    // until the result is polled. returns false, copying nothing, while the previous evaluation is still running.
+    bool Start(const hhModel& source, const tensor& inputs, const tensor& targets, int epoch);
+
+    // true, once, when an evaluation has finished since the last call
+    bool Poll(hhValidationResult& result);
+
+    // blocks until the running evaluation, if any, has finished
+    void Wait();
+
+private:
+    void Evaluate(const tensor& inputs, const tensor& targets);
+
+    std::unique_ptr<hhModel> snapshot;  // float32 copy of the source's layers
+    tensor outputs;
+    hhValidationResult result;
+    std::thread worker;
+    std::atomic<bool> finished{false};
+};